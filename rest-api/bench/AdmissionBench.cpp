@@ -0,0 +1,103 @@
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <time.h>
+
+#include "include/ClientRateLimiter.h"
+#include "include/ConcurrencyLimiter.h"
+
+
+//Cost of admission checks done by APIController::dispatch, then an overload: handlers burning a fixed amount of CPU each,
+//hit by many more client threads than cores, so latency grows with the number of handlers running at once (they share
+//the cores). Without and with the adaptive concurrency limit: p50/p99 of admitted requests, share of shed ones, limit reached
+//execution = ./bin/AdmissionBench.app [client threads] [seconds per run]
+
+static const std::chrono::microseconds SERVICE_TIME(200);	//CPU time per request
+static volatile std::size_t admittedSink = 0;
+
+template <typename F>
+static double nanosPerCall(std::size_t calls, F call) {
+	auto start = std::chrono::steady_clock::now();
+	std::size_t admitted = 0;
+	for (std::size_t i = 0; i < calls; i++)
+		admitted += call(i);
+	admittedSink += admitted;	//Keeps calls from being optimized away
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+}
+
+static std::uint64_t threadCpuNanos() {
+	struct timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void burnCpu(std::chrono::microseconds time) {
+	std::uint64_t end = threadCpuNanos() + std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+	while (threadCpuNanos() < end);
+}
+
+static void overload(std::size_t threadCount, double seconds, std::size_t initialLimit) {
+	ConcurrencyLimiter limiter(initialLimit, 1, 1024, 2.0, 50);
+	std::atomic<bool> stop(false);
+	std::atomic<std::uint64_t> shed(0);
+	std::vector<std::vector<std::uint64_t>> latencies(threadCount);
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < threadCount; t++) {
+		threads.emplace_back([&, t] {
+			while (!stop.load(std::memory_order_relaxed)) {
+				auto start = std::chrono::steady_clock::now();
+				if (!limiter.tryAcquire()) {
+					shed++;
+					std::this_thread::sleep_for(SERVICE_TIME);	//Client backs off as after a 503
+					continue;
+				}
+				burnCpu(SERVICE_TIME);
+				std::uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+				limiter.release(nanos);
+				latencies[t].push_back(nanos);
+			}
+		});
+	}
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	stop = true;
+	for (std::thread & thread : threads)
+		thread.join();
+
+	std::vector<std::uint64_t> all;
+	for (const std::vector<std::uint64_t> & samples : latencies)
+		all.insert(all.end(), samples.begin(), samples.end());
+	std::sort(all.begin(), all.end());
+	double total = all.size() + shed;
+	std::cout << std::setw(12) << (initialLimit ? "adaptive" : "none") << std::fixed << std::setprecision(0) \
+		<< std::setw(12) << all.size() / seconds << std::setprecision(2) \
+		<< std::setw(12) << all[all.size() / 2] / 1e6 << std::setw(12) << all[all.size() * 99 / 100] / 1e6 \
+		<< std::setprecision(1) << std::setw(10) << 100.0 * shed / total << (initialLimit ? std::to_string(limiter.limit()) : "-") << '\n';
+}
+
+int main(int argc, const char * argv[]) {
+	std::size_t threadCount = (argc > 1) ? std::max(1ul, std::stoul(argv[1])) : 32;
+	double seconds = (argc > 2) ? std::stod(argv[2]) : 2;
+
+	std::vector<std::string> clients;
+	for (std::size_t i = 0; i < 10000; i++)
+		clients.push_back("10.0." + std::to_string(i / 256) + "." + std::to_string(i % 256));
+	ClientRateLimiter oneClient(1e9), manyClients(1e9);
+	ConcurrencyLimiter concurrency(64);
+	std::cout << "ns per check (single thread)\n";
+	std::cout << "  rate limiter, 1 client:       " << nanosPerCall(2000000, [&](std::size_t) { return oneClient.tryAcquire(clients[0]); }) << '\n';
+	std::cout << "  rate limiter, 10000 clients:  " << nanosPerCall(2000000, [&](std::size_t i) { return manyClients.tryAcquire(clients[i % clients.size()]); }) << '\n';
+	std::cout << "  concurrency acquire+release:  " << nanosPerCall(2000000, [&](std::size_t) { bool admitted = concurrency.tryAcquire(); concurrency.release(1000); return admitted; }) << "\n\n";
+
+	std::cout << "overload: " << threadCount << " clients, " << std::thread::hardware_concurrency() << " cores, " << SERVICE_TIME.count() << " us of CPU per request\n";
+	std::cout << std::left << std::setw(12) << "limit" << std::setw(12) << "admitted/s" << std::setw(12) << "p50 ms" << std::setw(12) << "p99 ms" \
+		<< std::setw(10) << "shed %" << "final limit\n";
+	overload(threadCount, seconds, 0);
+	overload(threadCount, seconds, 64);
+	return 0;
+}
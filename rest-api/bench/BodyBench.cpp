@@ -0,0 +1,110 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#if __has_include(<cpprest/http_msg.h>)
+	#include <cpprest/http_msg.h>
+	#include <cpprest/json.h>
+	#include "APIRequestContext.h"
+	#define BODY_BENCH_DOM 1
+#endif
+
+#include "include/JsonReader.h"
+
+
+//Cost of taking the JSON body of a write (PUT/POST/PATCH of /api/resource-a) from bytes received by a native listener
+//to the value stored, for bodies of 1 KiB, 64 KiB and 4 MiB: former path (body copied into the cpprest message, extracted
+//back as a string, parsed into a web::json::value DOM and serialized) against the view of the request context parsed
+//in place by JsonReader and compacted once into the stored value. Allocations, bytes allocated and body copies per request
+//(copies = bytes allocated / body size, so allocations of a DOM count as well). Without cpprest headers only the view
+//path is built (body read straight from the bytes received, as the context hands them out)
+//execution = ./bin/BodyBench.app
+
+static std::atomic<std::uint64_t> allocations(0);
+static std::atomic<std::uint64_t> allocatedBytes(0);
+
+void *operator new(std::size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	if (void *memory = std::malloc(size ? size : 1))
+		return memory;
+	throw std::bad_alloc();
+}
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+
+//Pretty-printed array of items (whitespace to compact, strings with escapes, numbers, literals) of about size bytes
+static std::string makeBody(std::size_t size) {
+	std::string body = "[\n";
+	for (std::size_t i = 0; body.size() < size; i++) {
+		if (i > 0)
+			body += ",\n";
+		body += "  {\"id\": " + std::to_string(i) + ", \"name\": \"item \\\"" + std::to_string(i) + "\\\"\", \"score\": " + std::to_string(i * 0.25) + \
+			", \"active\": " + ((i % 2) ? "true" : "false") + ", \"tags\": [\"a\", \"b\\tc\"], \"note\": null}";
+	}
+	return body + "\n]";
+}
+
+#ifdef BODY_BENCH_DOM
+//Former serveNativeRequest + extractJsonBody + body.serialize()
+static std::size_t domPath(const std::string & received) {
+	web::http::http_request message(web::http::methods::PUT);
+	message.set_body(received, "application/json");
+	web::json::value body = web::json::value::parse(message.extract_string(true).get());
+	std::string value = body.serialize();
+	return value.size();
+}
+#endif
+
+static std::size_t viewPath(const std::string & received) {
+	thread_local JsonReader body;
+#ifdef BODY_BENCH_DOM
+	APIRequestContext context(std::chrono::steady_clock::now(), std::chrono::milliseconds(0));
+	context.setBody(received);
+	std::string_view bytes = context.getBody();
+#else
+	std::string_view bytes = received;
+#endif
+	if (!body.parse(bytes))
+		return 0;
+	std::string value;
+	JsonReader::compact(body.root(), value);
+	return value.size();
+}
+
+static void measure(const std::string & name, const std::string & received, const std::function<std::size_t(const std::string &)> & path) {
+	std::size_t repetitions = std::max<std::size_t>(20, (64 << 20) / received.size());
+	std::size_t checksum = path(received);	//Warm up (thread_local reader reaches its final size)
+
+	std::uint64_t allocationsBefore = allocations, bytesBefore = allocatedBytes;
+	auto start = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < repetitions; i++)
+		checksum += path(received);
+	double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / repetitions;
+	double bytes = (double) (allocatedBytes - bytesBefore) / repetitions;
+
+	std::cout << std::left << std::setw(10) << (std::to_string(received.size() >> 10) + " KiB") << std::setw(10) << name << std::fixed << std::setprecision(1) \
+		<< std::setw(12) << micros << std::setw(14) << (double) (allocations - allocationsBefore) / repetitions \
+		<< std::setw(16) << bytes << std::setprecision(2) << std::setw(10) << bytes / received.size() \
+		<< std::setprecision(0) << received.size() / (micros * 1.048576) << " (stored " << checksum / (repetitions + 1) << " bytes)\n";
+}
+
+int main() {
+	std::cout << std::left << std::setw(10) << "body" << std::setw(10) << "path" << std::setw(12) << "us/req" << std::setw(14) << "allocs/req" \
+		<< std::setw(16) << "bytes/req" << std::setw(10) << "copies" << "MiB/s\n";
+	for (std::size_t size : {1ul << 10, 64ul << 10, 4ul << 20}) {
+		std::string received = makeBody(size);
+#ifdef BODY_BENCH_DOM
+		measure("dom", received, domPath);
+#endif
+		measure("view", received, viewPath);
+	}
+#ifndef BODY_BENCH_DOM
+	std::cout << "(dom rows not built: cpprest headers not found)\n";
+#endif
+	return 0;
+}
@@ -0,0 +1,71 @@
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "ResponseCache.h"
+#include "include/HttpCompression.h"
+#include "include/JsonWriter.h"
+
+
+//Cost of compressing a response body on every request (gzip/deflate at levels 1, 6 and 9) for JSON bodies of 1, 16 and 256 KiB,
+//against picking the precompressed variant of a ResponseCache entry (what static routes do)
+//execution = ./bin/CompressionBench.app [milliseconds per case]
+
+static std::string jsonBody(std::size_t size) {
+	JsonWriter writer;
+	writer.beginObject().member("status", "success").key("message").null().key("data").beginArray();
+	for (std::size_t i = 0; writer.str().size() < size; i++)
+		writer.beginObject().member("id", i).member("name", "item-" + std::to_string(i)).member("score", i * 0.25) \
+			.member("active", i % 3 == 0).endObject();
+	writer.endArray().endObject();
+	return writer.str();
+}
+
+template <typename F>
+static double microsPerCall(double milliseconds, F call) {
+	std::size_t calls = 0, checksum = 0;
+	auto start = std::chrono::steady_clock::now();
+	std::chrono::duration<double, std::milli> elapsed(0);
+	while (elapsed.count() < milliseconds) {
+		checksum += call();
+		calls++;
+		elapsed = std::chrono::steady_clock::now() - start;
+	}
+	return (checksum == 0) ? 0 : elapsed.count() * 1000 / calls;
+}
+
+int main(int argc, const char * argv[]) {
+	double milliseconds = (argc > 1) ? std::stod(argv[1]) : 500;
+
+	std::cout << std::left << std::setw(10) << "body" << std::setw(10) << "coding" << std::setw(8) << "level" \
+		<< std::setw(14) << "us/response" << std::setw(12) << "MB/s" << "ratio\n";
+	for (std::size_t size : {1024, 16 * 1024, 256 * 1024}) {
+		std::string body = jsonBody(size);
+		std::string label = std::to_string(body.size() / 1024) + " KiB";
+
+		for (HttpCompression::encodings::encoding encoding : {HttpCompression::encodings::encoding::GZIP, HttpCompression::encodings::encoding::DEFLATE}) {
+			for (int level : {1, 6, 9}) {
+				std::size_t compressedSize = HttpCompression::compress(body, encoding, level).size();
+				double micros = microsPerCall(milliseconds, [&] { return HttpCompression::compress(body, encoding, level).size(); });
+				std::cout << std::setw(10) << label << std::setw(10) << HttpCompression::encodings::to_string(encoding) << std::setw(8) << level \
+					<< std::fixed << std::setprecision(2) << std::setw(14) << micros << std::setprecision(0) << std::setw(12) << body.size() / micros \
+					<< std::setprecision(2) << (double) body.size() / compressedSize << '\n';
+			}
+		}
+
+		//Cached: negotiation plus lookup of the variant built once
+		ResponseCache cache;
+		cache.setCompression(1024, 6);
+		cache.put("/route", body);
+		double micros = microsPerCall(milliseconds, [&] {
+			std::shared_ptr<const ResponseCache::entry> cached = cache.get("/route", nullptr);
+			return cached->bodyFor(HttpCompression::negotiate("gzip, deflate, br")).size();
+		});
+		std::cout << std::setw(10) << label << std::setw(10) << "cached" << std::setw(8) << 6 << std::fixed << std::setprecision(2) \
+			<< std::setw(14) << micros << std::setprecision(0) << std::setw(12) << body.size() / micros << '\n';
+	}
+	return 0;
+}
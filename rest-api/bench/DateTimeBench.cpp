@@ -0,0 +1,48 @@
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <functional>
+
+#include "include/DateTimeUtils.h"
+
+
+//Compares timestamp formatting of DateTimeUtils against the per-call ostringstream it used before
+//execution = ./bin/DateTimeBench.app
+
+static const std::size_t CALLS = 2000000;
+
+//Former implementation of DateTimeUtils::currentTime
+static std::string legacyCurrentTime() {
+	boost::posix_time::ptime currLocTime = boost::posix_time::second_clock::local_time();
+
+	std::ostringstream timeStream;
+	timeStream << std::setfill('0') \
+		<< std::setw(2) << currLocTime.time_of_day().hours() << "." \
+		<< std::setw(2) << currLocTime.time_of_day().minutes() << "." \
+		<< std::setw(2) << currLocTime.time_of_day().seconds();
+
+	return timeStream.str();
+}
+
+static void measure(const std::string & name, const std::function<std::size_t()> & call) {
+	std::size_t checksum = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < CALLS; i++)
+		checksum += call();
+	double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / CALLS;
+
+	std::cout << std::left << std::setw(32) << name << std::fixed << std::setprecision(1) << nanos << " ns/call" \
+		<< ((checksum == 0) ? " (?)" : "") << '\n';
+}
+
+int main() {
+	char buffer[DateTimeUtils::TIME_MILLIS_LENGTH];
+
+	measure("legacy ostringstream", [] { return legacyCurrentTime().size(); });
+	measure("currentTime()", [] { return DateTimeUtils::currentTime().size(); });
+	measure("formatTimeInto()", [&buffer] { return DateTimeUtils::formatTimeInto(buffer); });
+	measure("formatTimeMillisInto()", [&buffer] { return DateTimeUtils::formatTimeMillisInto(buffer); });
+	return 0;
+}
@@ -0,0 +1,124 @@
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#if __has_include(<cpprest/json.h>)
+	#include <cpprest/json.h>
+	#define JSON_BENCH_DOM 1
+#endif
+
+#include "include/JsonWriter.h"
+
+
+//Compares the web::json::value DOM that APIService::assemblyResponse used to build (and serialize right away)
+//against JsonWriter streaming into a reused buffer, for the envelope of every response and for a larger payload
+//Bytes and allocations are counted per response, including the copy of body handed to the reply
+//DOM rows (the figures before JsonWriter) need cpprest headers; without them only JsonWriter rows are printed
+//execution = ./bin/JsonBench.app
+
+static const std::size_t RESPONSES = 500000;
+
+static std::atomic<std::uint64_t> allocations(0);
+static std::atomic<std::uint64_t> allocatedBytes(0);
+
+void *operator new(std::size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+	if (void *memory = std::malloc(size ? size : 1))
+		return memory;
+	throw std::bad_alloc();
+}
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+
+static const std::string MESSAGE = "Yeah! Nicely done handling GET for \"resourceA\"!\n";
+
+#ifdef JSON_BENCH_DOM
+//Former implementation of APIService::assemblyResponse (plus the serialization done by reply)
+static std::string domEnvelope() {
+	web::json::value response = web::json::value::object();
+	response["status"] = web::json::value::string("success");
+	response["message"] = web::json::value::null();
+	response["data"] = web::json::value::string(MESSAGE);
+	return response.serialize();
+}
+
+#endif
+
+static std::string writerEnvelope() {
+	thread_local JsonWriter writer;
+	writer.reset();
+	writer.beginObject().member("status", "success").key("message").null().member("data", MESSAGE).endObject();
+	return writer.str();
+}
+
+#ifdef JSON_BENCH_DOM
+//Payload of 32 items with numbers, booleans, strings and a nested array each
+static std::string domPayload() {
+	web::json::value items = web::json::value::array(32);
+	for (std::size_t i = 0; i < 32; i++) {
+		web::json::value item = web::json::value::object();
+		item["id"] = web::json::value::number((uint64_t) i);
+		item["name"] = web::json::value::string("item-" + std::to_string(i));
+		item["score"] = web::json::value::number(i * 0.25);
+		item["active"] = web::json::value::boolean(i % 2 == 0);
+		item["tags"] = web::json::value::array({web::json::value::string("a"), web::json::value::string("b\tc")});
+		items[i] = item;
+	}
+	web::json::value response = web::json::value::object();
+	response["status"] = web::json::value::string("success");
+	response["message"] = web::json::value::null();
+	response["data"] = items;
+	return response.serialize();
+}
+#endif
+
+static std::string writerPayload() {
+	thread_local JsonWriter writer;
+	writer.reset();
+	writer.beginObject().member("status", "success").key("message").null().key("data").beginArray();
+	char name[16];
+	for (std::size_t i = 0; i < 32; i++) {
+		std::snprintf(name, sizeof(name), "item-%zu", i);
+		writer.beginObject().member("id", i).member("name", name).member("score", i * 0.25).member("active", i % 2 == 0) \
+			.key("tags").beginArray().value("a").value("b\tc").endArray().endObject();
+	}
+	writer.endArray().endObject();
+	return writer.str();
+}
+
+static void measure(const std::string & name, const std::function<std::string()> & build) {
+	std::size_t checksum = build().size();	//Warm up (writer buffer reaches its final size)
+
+	std::uint64_t allocationsBefore = allocations, bytesBefore = allocatedBytes;
+	auto start = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < RESPONSES; i++)
+		checksum += build().size();
+	double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / RESPONSES;
+
+	std::cout << std::left << std::setw(20) << name << std::fixed << std::setprecision(1) \
+		<< std::setw(14) << nanos << std::setw(14) << (double) (allocations - allocationsBefore) / RESPONSES \
+		<< std::setw(14) << (double) (allocatedBytes - bytesBefore) / RESPONSES << (checksum / (RESPONSES + 1)) << '\n';
+}
+
+int main() {
+	std::cout << std::left << std::setw(20) << "response" << std::setw(14) << "ns/op" << std::setw(14) << "allocs/op" \
+		<< std::setw(14) << "bytes/op" << "body bytes\n";
+
+#ifdef JSON_BENCH_DOM
+	measure("envelope dom", domEnvelope);
+#endif
+	measure("envelope writer", writerEnvelope);
+#ifdef JSON_BENCH_DOM
+	measure("payload dom", domPayload);
+#else
+	std::cout << "(dom rows not built: cpprest headers not found)\n";
+#endif
+	measure("payload writer", writerPayload);
+	return 0;
+}
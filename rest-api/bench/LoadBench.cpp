@@ -0,0 +1,201 @@
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include <cpprest/http_client.h>
+
+#include "APIService.h"
+
+
+//HTTP load generator against an in-process APIService listening on loopback, one run per route of handleGET
+//Results are printed as JSON (one object per route) so they can be tracked across commits
+//execution = ./bin/LoadBench.app [--mode closed|open] [--connections N] [--rate REQ_PER_SEC] [--seconds S] [--port P] [--workers N]
+//  closed: N clients, each sending next request as soon as previous reply arrives (measures max throughput)
+//  open  : requests sent at fixed rate regardless of replies, latency measured from intended send time
+
+
+//Every allocation of the process (client and service sides) is counted
+static std::atomic<std::uint64_t> allocations(0);
+
+void *operator new(std::size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *memory = std::malloc(size ? size : 1))
+		return memory;
+	throw std::bad_alloc();
+}
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+
+
+class bench_options {
+	public:
+		std::string mode = "closed";
+		std::size_t connections = 8;
+		double rate = 10000;
+		double seconds = 5;
+		std::string port = "18080";
+		std::size_t workers = 0;	//0 = default cpprest scheduler
+};
+
+class route_result {
+	public:
+		std::string route;
+		std::size_t requests = 0;
+		std::size_t errors = 0;
+		double elapsedSeconds = 0;
+		std::uint64_t allocations = 0;
+		std::vector<double> latencies;	//Microseconds
+};
+
+static route_result runClosedLoop(const bench_options & options, const std::string & baseURI, const std::string & route) {
+	route_result result;
+	result.route = route;
+	std::mutex resultMutex;
+	std::atomic<bool> stop(false);
+
+	std::uint64_t allocationsBefore = allocations.load();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> clients;
+	for (std::size_t c = 0; c < options.connections; c++) {
+		clients.emplace_back([&] {
+			web::http::client::http_client client(baseURI);
+			std::vector<double> latencies;
+			std::size_t errors = 0;
+
+			while (!stop) {
+				std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+				try {
+					web::http::http_response response = client.request(web::http::methods::GET, route).get();
+					response.extract_string().wait();
+				}
+				catch (std::exception &) {
+					errors++;
+				}
+				latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - sent).count());
+			}
+
+			std::lock_guard<std::mutex> lock(resultMutex);
+			result.latencies.insert(result.latencies.end(), latencies.begin(), latencies.end());
+			result.errors += errors;
+		});
+	}
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+	stop = true;
+	for (std::thread & client : clients)
+		client.join();
+
+	result.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.allocations = allocations.load() - allocationsBefore;
+	result.requests = result.latencies.size();
+	return result;
+}
+
+static route_result runOpenLoop(const bench_options & options, const std::string & baseURI, const std::string & route) {
+	route_result result;
+	result.route = route;
+	std::mutex resultMutex;
+
+	std::vector<std::unique_ptr<web::http::client::http_client>> clients;
+	for (std::size_t c = 0; c < options.connections; c++)
+		clients.emplace_back(new web::http::client::http_client(baseURI));
+
+	std::size_t total = (std::size_t) (options.rate * options.seconds);
+	std::chrono::duration<double> interval(1.0 / options.rate);
+	std::vector<pplx::task<void>> pending;
+	pending.reserve(total);
+
+	std::uint64_t allocationsBefore = allocations.load();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (std::size_t i = 0; i < total; i++) {
+		std::chrono::steady_clock::time_point intended = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval * i);
+		std::this_thread::sleep_until(intended);
+
+		pending.push_back(clients[i % clients.size()]->request(web::http::methods::GET, route).then([&, intended](pplx::task<web::http::http_response> reply) {
+			bool failed = false;
+			try {
+				reply.get().extract_string().wait();
+			}
+			catch (std::exception &) {
+				failed = true;
+			}
+			double latency = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - intended).count();
+
+			std::lock_guard<std::mutex> lock(resultMutex);
+			result.latencies.push_back(latency);
+			result.errors += failed ? 1 : 0;
+		}));
+	}
+	pplx::when_all(pending.begin(), pending.end()).wait();
+
+	result.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.allocations = allocations.load() - allocationsBefore;
+	result.requests = result.latencies.size();
+	return result;
+}
+
+static std::string toJSON(const bench_options & options, const route_result & result) {
+	std::vector<double> sorted = result.latencies;
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&sorted](double p) { return sorted.empty() ? 0.0 : sorted[std::min(sorted.size() - 1, (std::size_t) (p * sorted.size()))]; };
+
+	std::ostringstream json;
+	json << std::fixed << std::setprecision(2) \
+		<< "{\"route\":\"" << result.route << "\",\"mode\":\"" << options.mode << "\",\"connections\":" << options.connections \
+		<< ",\"workers\":" << options.workers << ",\"requests\":" << result.requests << ",\"errors\":" << result.errors \
+		<< ",\"req_per_sec\":" << (result.requests / result.elapsedSeconds) \
+		<< ",\"latency_us\":{\"p50\":" << percentile(0.50) << ",\"p90\":" << percentile(0.90) \
+		<< ",\"p99\":" << percentile(0.99) << ",\"p99_9\":" << percentile(0.999) << "}" \
+		<< ",\"allocations_per_request\":" << (result.requests ? (double) result.allocations / result.requests : 0.0) << "}";
+	return json.str();
+}
+
+int main(int argc, const char * argv[]) {
+	bench_options options;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string option = argv[i], value = argv[i + 1];
+		if (option == "--mode")					options.mode = value;
+		else if (option == "--connections")		options.connections = std::max(1ul, std::stoul(value));
+		else if (option == "--rate")			options.rate = std::stod(value);
+		else if (option == "--seconds")			options.seconds = std::stod(value);
+		else if (option == "--port")			options.port = value;
+		else if (option == "--workers")			options.workers = std::stoul(value);
+	}
+
+	//Logger kept out of the way (async and quiet), it would otherwise dominate allocations
+	Logger::getLogger()->enableAsync();
+	Logger::getLogger()->setLevel(Logger::message_types::type::WARNING);
+
+	APIService service;
+	service.setEndpoint("http://127.0.0.1:" + options.port + "/api");
+	if (options.workers > 0) {
+		APIController::scheduler_config schedulerConfig;
+		schedulerConfig.type = APIController::scheduler_types::type::WORK_STEALING;
+		schedulerConfig.workerCount = options.workers;
+		service.setSchedulerConfig(schedulerConfig);
+	}
+	service.open().wait();
+
+	std::string baseURI = "http://127.0.0.1:" + options.port;
+	std::vector<std::string> routes = { "/api", "/api/resource-a", "/api/resource-a/subresource", "/api/not-found" };
+
+	std::cout << "[\n";
+	for (std::size_t i = 0; i < routes.size(); i++) {
+		route_result result = (options.mode == "open") ? runOpenLoop(options, baseURI, routes[i]) : runClosedLoop(options, baseURI, routes[i]);
+		std::cout << "  " << toJSON(options, result) << ((i + 1 < routes.size()) ? ",\n" : "\n") << std::flush;
+	}
+	std::cout << "]\n";
+
+	service.close().wait();
+	return 0;
+}
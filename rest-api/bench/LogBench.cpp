@@ -0,0 +1,48 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "include/Logger.h"
+#include "include/DateTimeUtils.h"
+
+
+//Cost per record on the producer side of Logger (async mode, buffer large enough that nothing is dropped) for a
+//typical request log line: text records (time prefix + LogFormat) against binary ones (header + raw arguments)
+//CPU time of producing thread, best of ROUNDS. Text runs first: binary mode cannot be turned off once enabled
+//execution = ./bin/LogBench.app
+
+static const std::size_t RECORDS = 200000;
+static const std::size_t ROUNDS = 5;
+
+static void measure(const std::string & name, Logger *logger) {
+	const std::string path = "/api/resource-a/3f2a9c";
+	double bestNanos = 0;
+
+	for (std::size_t round = 0; round < ROUNDS; round++) {
+		std::uint64_t written = logger->getAsyncStats().writtenRecords;
+		std::uint64_t cpuStart = DateTimeUtils::threadCpuNanos();
+		for (std::size_t i = 0; i < RECORDS; i++)
+			logger->log<Logger::message_types::type::INFO>("{} for path <{}> replied {} in {} us ({} bytes)", "GET", path, 200, 123.5, i);
+		double nanos = (double) (DateTimeUtils::threadCpuNanos() - cpuStart) / RECORDS;
+		bestNanos = (round == 0) ? nanos : std::min(bestNanos, nanos);
+
+		while (logger->getAsyncStats().writtenRecords < written + RECORDS)		//Writer catches up before next round
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	std::cout << std::left << std::setw(10) << name << std::fixed << std::setprecision(1) << std::setw(14) << bestNanos \
+		<< logger->getAsyncStats().droppedNewest << "\n";
+}
+
+int main() {
+	Logger *logger = Logger::getLogger("LogBench.log");
+	logger->enableAsync(1 << 18, Logger::overflow_policies::policy::DROP_NEWEST);
+
+	std::cout << std::left << std::setw(10) << "format" << std::setw(14) << "ns/record" << "dropped\n";
+	measure("text", logger);
+	logger->enableBinary();
+	measure("binary", logger);
+	return 0;
+}
@@ -0,0 +1,73 @@
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+
+#include "APIRouter.h"
+
+
+//Compares APIRouter lookup against the chained string compares it replaced in APIService::handleGET
+//execution = ./bin/RouterBench.app
+
+static const std::size_t LOOKUPS = 1000000;
+
+//Same cost model as the old "if (path == ...) else if (path == ...)" chain
+static int chainLookup(const std::vector<std::string> & routes, const std::string & path) {
+	for (std::size_t i = 0; i < routes.size(); i++)
+		if (path == routes[i])
+			return (int) i;
+	return -1;
+}
+
+static std::vector<std::string> buildRoutes(std::size_t count) {
+	std::vector<std::string> routes;
+	for (std::size_t i = 0; routes.size() < count; i++) {
+		routes.push_back("/api/resource-" + std::to_string(i));
+		if (routes.size() < count)
+			routes.push_back("/api/resource-" + std::to_string(i) + "/subresource");
+	}
+	return routes;
+}
+
+int main() {
+	std::cout << std::left << std::setw(8) << "routes" << std::setw(16) << "chain ns/op" << std::setw(16) << "router ns/op" << "speedup\n";
+
+	for (std::size_t count : {10, 100, 1000}) {
+		std::vector<std::string> routes = buildRoutes(count);
+
+		APIRouter<int> router;
+		for (std::size_t i = 0; i < routes.size(); i++)
+			router.add("GET", routes[i], (int) i);
+
+		//Same random sequence of registered paths for both
+		std::mt19937 engine(42);
+		std::uniform_int_distribution<std::size_t> pick(0, routes.size() - 1);
+		std::vector<std::size_t> sequence(LOOKUPS);
+		for (std::size_t & index : sequence)
+			index = pick(engine);
+
+		long long checksum = 0;
+
+		auto start = std::chrono::steady_clock::now();
+		for (std::size_t index : sequence)
+			checksum += chainLookup(routes, routes[index]);
+		double chainNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / LOOKUPS;
+
+		start = std::chrono::steady_clock::now();
+		for (std::size_t index : sequence)
+			checksum -= *router.find("GET", routes[index]).handler;
+		double routerNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / LOOKUPS;
+
+		if (checksum != 0) {
+			std::cerr << ">> ERROR! Router and chain disagree for " << count << " routes\n";
+			return 1;
+		}
+
+		std::cout << std::left << std::fixed << std::setprecision(1) << std::setw(8) << count \
+			<< std::setw(16) << chainNs << std::setw(16) << routerNs << (chainNs / routerNs) << "x\n";
+	}
+	return 0;
+}
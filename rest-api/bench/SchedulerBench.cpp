@@ -0,0 +1,70 @@
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "APIScheduler.h"
+
+
+//Compares dispatch latency (task creation -> task start) of pplx tasks between cpprest's default scheduler
+//and APIScheduler (work-stealing pool, with and without pinning)
+//execution = ./bin/SchedulerBench.app <workers> <producers>
+
+static const std::size_t BURSTS = 200;
+static const std::size_t BURST_SIZE = 64;
+
+static std::vector<double> measure(std::size_t producers) {
+	std::vector<double> latencies(producers * BURSTS * BURST_SIZE);
+	std::vector<std::thread> threads;
+
+	for (std::size_t p = 0; p < producers; p++) {
+		threads.emplace_back([&latencies, p] {
+			for (std::size_t burst = 0; burst < BURSTS; burst++) {
+				std::vector<pplx::task<void>> tasks;
+				for (std::size_t i = 0; i < BURST_SIZE; i++) {
+					std::size_t slot = (p * BURSTS + burst) * BURST_SIZE + i;
+					std::chrono::steady_clock::time_point created = std::chrono::steady_clock::now();
+					tasks.push_back(pplx::create_task([&latencies, slot, created] {
+						latencies[slot] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - created).count();
+					}));
+				}
+				pplx::when_all(tasks.begin(), tasks.end()).wait();
+			}
+		});
+	}
+	for (std::thread & thread : threads)
+		thread.join();
+
+	std::sort(latencies.begin(), latencies.end());
+	return latencies;
+}
+
+static void report(const std::string & name, const std::vector<double> & latencies) {
+	auto percentile = [&latencies](double p) { return latencies[std::min(latencies.size() - 1, (std::size_t) (p * latencies.size()))]; };
+
+	std::cout << std::left << std::setw(28) << name << std::fixed << std::setprecision(1) \
+		<< "p50 " << std::setw(10) << percentile(0.50) << "p99 " << std::setw(10) << percentile(0.99) \
+		<< "p99.9 " << std::setw(10) << percentile(0.999) << "(us)\n";
+}
+
+int main(int argc, const char * argv[]) {
+	std::size_t workers = (argc > 1) ? std::stoul(argv[1]) : std::thread::hardware_concurrency();
+	std::size_t producers = (argc > 2) ? std::stoul(argv[2]) : 4;
+
+	std::cout << ">> " << producers << " producers, " << BURSTS * BURST_SIZE << " tasks each\n";
+
+	report("default", measure(producers));
+
+	pplx::set_ambient_scheduler(std::make_shared<APIScheduler>(workers, WorkStealingPool::affinity_modes::mode::NONE));
+	report("work-stealing", measure(producers));
+
+	pplx::set_ambient_scheduler(std::make_shared<APIScheduler>(workers, WorkStealingPool::affinity_modes::mode::CORE));
+	report("work-stealing (core pin)", measure(producers));
+
+	pplx::set_ambient_scheduler(std::make_shared<APIScheduler>(workers, WorkStealingPool::affinity_modes::mode::NUMA_NODE));
+	report("work-stealing (numa pin)", measure(producers));
+	return 0;
+}
@@ -0,0 +1,149 @@
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <arpa/inet.h>
+
+#include "APIService.h"
+
+
+//Throughput of APIService in REUSEPORT_SHARDS listener mode, from 1 shard up to N (doubling), on loopback
+//Clients are raw keep-alive sockets (one thread each), so the client side costs as little as possible
+//Results are printed as JSON (one object per shard count), including how requests were spread among shards
+//execution = ./bin/ShardBench.app [--max-shards N] [--connections N] [--seconds S] [--port P] [--route PATH]
+
+
+class bench_options {
+	public:
+		std::size_t maxShards = std::max(1u, std::thread::hardware_concurrency());
+		std::size_t connections = 64;
+		double seconds = 5;
+		unsigned short port = 18081;
+		std::string route = "/api";
+};
+
+static int connectTo(unsigned short port) {
+	int connection = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+	if (connect(connection, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+		::close(connection);
+		return -1;
+	}
+	int enable = 1;
+	setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+	return connection;
+}
+
+//Sends request and reads whole response (headers plus Content-Length bytes); false if connection broke
+static bool roundTrip(int connection, const std::string & request, std::string & buffer) {
+	if (send(connection, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t) request.size())
+		return false;
+
+	buffer.clear();
+	char chunk[4096];
+	while (true) {
+		std::size_t headerEnd = buffer.find("\r\n\r\n");
+		if (headerEnd != std::string::npos) {
+			std::size_t lengthPosition = buffer.find("Content-Length: ");
+			std::size_t length = (lengthPosition < headerEnd) ? std::stoul(buffer.substr(lengthPosition + 16)) : 0;
+			if (buffer.size() >= headerEnd + 4 + length)
+				return true;
+		}
+		ssize_t received = recv(connection, chunk, sizeof(chunk), 0);
+		if (received <= 0)
+			return false;
+		buffer.append(chunk, received);
+	}
+}
+
+static std::string runShards(const bench_options & options, std::size_t shards) {
+	APIService service;
+	service.setEndpoint("http://127.0.0.1:" + std::to_string(options.port) + "/api");
+
+	APIController::listener_config listenerConfig;
+	listenerConfig.type = APIController::listener_types::type::REUSEPORT_SHARDS;
+	listenerConfig.shardCount = shards;
+	service.setListenerConfig(listenerConfig);
+	service.open().wait();
+
+	std::atomic<bool> stop(false);
+	std::atomic<std::uint64_t> requests(0), errors(0);
+	std::string request = "GET " + options.route + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::thread> clients;
+	for (std::size_t c = 0; c < options.connections; c++) {
+		clients.emplace_back([&] {
+			std::string buffer;
+			std::uint64_t done = 0, failed = 0;
+			int connection = connectTo(options.port);
+			while (!stop) {
+				if (connection >= 0 and roundTrip(connection, request, buffer)) {
+					done++;
+					continue;
+				}
+				failed++;
+				if (connection >= 0)
+					::close(connection);
+				connection = connectTo(options.port);
+			}
+			if (connection >= 0)
+				::close(connection);
+			requests += done;
+			errors += failed;
+		});
+	}
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+	stop = true;
+	for (std::thread & client : clients)
+		client.join();
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::vector<std::uint64_t> perShard = service.getShardRequestCounts();
+	service.close().wait();
+
+	std::ostringstream json;
+	json << std::fixed << std::setprecision(2) \
+		<< "{\"shards\":" << shards << ",\"connections\":" << options.connections << ",\"route\":\"" << options.route << "\"" \
+		<< ",\"requests\":" << requests << ",\"errors\":" << errors << ",\"req_per_sec\":" << (requests / elapsed) << ",\"requests_per_shard\":[";
+	for (std::size_t i = 0; i < perShard.size(); i++)
+		json << ((i > 0) ? "," : "") << perShard[i];
+	json << "]}";
+	return json.str();
+}
+
+int main(int argc, const char * argv[]) {
+	bench_options options;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string option = argv[i], value = argv[i + 1];
+		if (option == "--max-shards")			options.maxShards = std::max(1ul, std::stoul(value));
+		else if (option == "--connections")		options.connections = std::max(1ul, std::stoul(value));
+		else if (option == "--seconds")			options.seconds = std::stod(value);
+		else if (option == "--port")			options.port = (unsigned short) std::stoul(value);
+		else if (option == "--route")			options.route = value;
+	}
+
+	Logger::getLogger()->enableAsync();
+	Logger::getLogger()->setLevel(Logger::message_types::type::WARNING);
+
+	std::vector<std::size_t> shardCounts;
+	for (std::size_t shards = 1; shards < options.maxShards; shards *= 2)
+		shardCounts.push_back(shards);
+	shardCounts.push_back(options.maxShards);
+
+	std::cout << "[\n";
+	for (std::size_t i = 0; i < shardCounts.size(); i++)
+		std::cout << "  " << runShards(options, shardCounts[i]) << ((i + 1 < shardCounts.size()) ? ",\n" : "\n") << std::flush;
+	std::cout << "]\n";
+	return 0;
+}
@@ -0,0 +1,73 @@
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#include "ResourceStore.h"
+
+
+//Throughput of ResourceStore at varying read/write ratios, with one shard (single lock) and with the default striping
+//Each thread picks random keys among a preloaded set; writes are unconditional puts of a small JSON value
+//execution = ./bin/StoreBench.app [threads] [seconds per run]
+
+static const std::size_t KEYS = 10000;
+
+static double run(ResourceStore & store, std::size_t threadCount, double seconds, unsigned readPercent) {
+	std::vector<std::string> keys;
+	for (std::size_t i = 0; i < KEYS; i++) {
+		keys.push_back(std::to_string(i));
+		store.put(keys.back(), "{\"n\":0}");
+	}
+
+	std::atomic<bool> stop(false);
+	std::atomic<std::uint64_t> operations(0);
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < threadCount; t++) {
+		threads.emplace_back([&, t] {
+			std::mt19937 engine((unsigned) t + 1);
+			std::uniform_int_distribution<std::size_t> pickKey(0, KEYS - 1);
+			std::uniform_int_distribution<unsigned> pickOperation(0, 99);
+			std::uint64_t done = 0, checksum = 0;
+			while (!stop.load(std::memory_order_relaxed)) {
+				const std::string & key = keys[pickKey(engine)];
+				if (pickOperation(engine) < readPercent) {
+					std::shared_ptr<const ResourceStore::entry> item = store.get(key);
+					checksum += item ? item->value.size() : 0;
+				}
+				else
+					store.put(key, "{\"n\":" + std::to_string(done) + "}");
+				done++;
+			}
+			operations += done + (checksum == 0 ? 1 : 0);
+		});
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+	stop = true;
+	for (std::thread & thread : threads)
+		thread.join();
+	return operations / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, const char * argv[]) {
+	std::size_t threadCount = (argc > 1) ? std::max(1ul, std::stoul(argv[1])) : std::max(1u, std::thread::hardware_concurrency());
+	double seconds = (argc > 2) ? std::stod(argv[2]) : 2;
+
+	std::cout << "threads: " << threadCount << '\n';
+	std::cout << std::left << std::setw(10) << "reads %" << std::setw(18) << "1 shard ops/s" << std::setw(18) << "64 shards ops/s" << "speedup\n";
+	for (unsigned readPercent : {100, 95, 80, 50, 0}) {
+		ResourceStore single(1), striped(64);
+		double singleOps = run(single, threadCount, seconds, readPercent);
+		double stripedOps = run(striped, threadCount, seconds, readPercent);
+		std::cout << std::setw(10) << readPercent << std::fixed << std::setprecision(0) << std::setw(18) << singleOps << std::setw(18) << stripedOps \
+			<< std::setprecision(2) << stripedOps / singleOps << "x\n";
+	}
+	return 0;
+}
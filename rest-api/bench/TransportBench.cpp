@@ -0,0 +1,163 @@
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <arpa/inet.h>
+
+#include "APIService.h"
+
+
+//Side-by-side throughput of APIService on each listener type (cpprest, reuseport-shards, epoll, io_uring), same routes, same load
+//Clients are raw keep-alive sockets (one thread each) sending <depth> pipelined requests per round trip,
+//so differences come from the server side. Results are printed as JSON (one object per listener type and route)
+//execution = ./bin/TransportBench.app [--listener all|cpprest|reuseport-shards|epoll|io_uring] [--threads N] [--connections N]
+//                                     [--depth N] [--seconds S] [--port P]
+//  threads: shards/event loops of native listeners (cpprest keeps its own pool)
+//  depth  : pipelined requests per round trip (cpprest listener is only measured with depth 1)
+
+
+class bench_options {
+	public:
+		std::string listener = "all";
+		std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+		std::size_t connections = 32;
+		std::size_t depth = 1;
+		double seconds = 5;
+		unsigned short port = 18082;
+};
+
+static int connectTo(unsigned short port) {
+	int connection = socket(AF_INET, SOCK_STREAM, 0);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+	if (connect(connection, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+		::close(connection);
+		return -1;
+	}
+	int enable = 1;
+	setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+	return connection;
+}
+
+//Sends the (pipelined) requests and reads <expected> whole responses; false if connection broke
+static bool roundTrip(int connection, const std::string & requests, std::size_t expected, std::string & buffer) {
+	if (send(connection, requests.data(), requests.size(), MSG_NOSIGNAL) != (ssize_t) requests.size())
+		return false;
+
+	buffer.clear();
+	std::size_t position = 0;
+	char chunk[16 * 1024];
+	while (expected > 0) {
+		std::size_t headerEnd = buffer.find("\r\n\r\n", position);
+		if (headerEnd != std::string::npos) {
+			std::size_t lengthPosition = buffer.find("Content-Length: ", position);
+			std::size_t length = (lengthPosition < headerEnd) ? std::stoul(buffer.substr(lengthPosition + 16, 12)) : 0;
+			if (buffer.size() >= headerEnd + 4 + length) {
+				position = headerEnd + 4 + length;
+				expected--;
+				continue;
+			}
+		}
+		ssize_t received = recv(connection, chunk, sizeof(chunk), 0);
+		if (received <= 0)
+			return false;
+		buffer.append(chunk, received);
+	}
+	return true;
+}
+
+static std::string runListener(const bench_options & options, APIController::listener_types::type type, const std::string & route) {
+	APIService service;
+	service.setEndpoint("http://127.0.0.1:" + std::to_string(options.port) + "/api");
+
+	APIController::listener_config listenerConfig;
+	listenerConfig.type = type;
+	listenerConfig.shardCount = options.threads;
+	service.setListenerConfig(listenerConfig);
+	service.open().wait();
+
+	std::size_t depth = (type == APIController::listener_types::type::CPPREST) ? 1 : options.depth;
+	std::string requests;
+	for (std::size_t i = 0; i < depth; i++)
+		requests += "GET " + route + " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+	std::atomic<bool> stop(false);
+	std::atomic<std::uint64_t> completed(0), errors(0);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::thread> clients;
+	for (std::size_t c = 0; c < options.connections; c++) {
+		clients.emplace_back([&] {
+			std::string buffer;
+			std::uint64_t done = 0, failed = 0;
+			int connection = connectTo(options.port);
+			while (!stop) {
+				if (connection >= 0 and roundTrip(connection, requests, depth, buffer)) {
+					done += depth;
+					continue;
+				}
+				failed++;
+				if (connection >= 0)
+					::close(connection);
+				connection = connectTo(options.port);
+			}
+			if (connection >= 0)
+				::close(connection);
+			completed += done;
+			errors += failed;
+		});
+	}
+
+	std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+	stop = true;
+	for (std::thread & client : clients)
+		client.join();
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	service.close().wait();
+
+	std::ostringstream json;
+	json << std::fixed << std::setprecision(2) \
+		<< "{\"listener\":\"" << APIController::listener_types::to_string(type) << "\",\"route\":\"" << route << "\"" \
+		<< ",\"threads\":" << options.threads << ",\"connections\":" << options.connections << ",\"depth\":" << depth \
+		<< ",\"requests\":" << completed << ",\"errors\":" << errors << ",\"req_per_sec\":" << (completed / elapsed) << "}";
+	return json.str();
+}
+
+int main(int argc, const char * argv[]) {
+	bench_options options;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		std::string option = argv[i], value = argv[i + 1];
+		if (option == "--listener")				options.listener = value;
+		else if (option == "--threads")			options.threads = std::max(1ul, std::stoul(value));
+		else if (option == "--connections")		options.connections = std::max(1ul, std::stoul(value));
+		else if (option == "--depth")			options.depth = std::max(1ul, std::stoul(value));
+		else if (option == "--seconds")			options.seconds = std::stod(value);
+		else if (option == "--port")			options.port = (unsigned short) std::stoul(value);
+	}
+
+	Logger::getLogger()->enableAsync();
+	Logger::getLogger()->setLevel(Logger::message_types::type::WARNING);
+
+	std::vector<APIController::listener_types::type> listeners;
+	for (APIController::listener_types::type type : {APIController::listener_types::type::CPPREST, \
+			APIController::listener_types::type::REUSEPORT_SHARDS, APIController::listener_types::type::EPOLL, APIController::listener_types::type::IO_URING})
+		if (options.listener == "all" or options.listener == APIController::listener_types::to_string(type))
+			listeners.push_back(type);
+	std::vector<std::string> routes = { "/api", "/api/resource-a/subresource", "/api/not-found" };
+
+	std::cout << "[\n";
+	for (std::size_t l = 0; l < listeners.size(); l++)
+		for (std::size_t r = 0; r < routes.size(); r++) {
+			bool last = (l + 1 == listeners.size() and r + 1 == routes.size());
+			std::cout << "  " << runListener(options, listeners[l], routes[r]) << (last ? "\n" : ",\n") << std::flush;
+		}
+	std::cout << "]\n";
+	return 0;
+}
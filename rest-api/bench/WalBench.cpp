@@ -0,0 +1,74 @@
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <unistd.h>
+
+#include "ResourceStore.h"
+#include "StoreDurability.h"
+
+
+//Acknowledged writes per second of a durable ResourceStore for each durability mode: every thread does put + waitDurable,
+//as a write handler does before replying. Records per fsync shows how many writes share a flush in group mode
+//execution = ./bin/WalBench.app [threads] [seconds per run] [directory]
+
+static void clear(const std::string & directory) {
+	for (std::uint64_t segment : WriteAheadLog::listSegments(directory))
+		unlink(WriteAheadLog::segmentPath(directory, segment).c_str());
+	unlink((directory + "/snapshot.bin").c_str());
+}
+
+int main(int argc, const char * argv[]) {
+	std::size_t threadCount = (argc > 1) ? std::max(1ul, std::stoul(argv[1])) : 4;
+	double seconds = (argc > 2) ? std::stod(argv[2]) : 2;
+	std::string directory = (argc > 3) ? argv[3] : "wal-bench";
+
+	std::cout << "threads: " << threadCount << '\n';
+	std::cout << std::left << std::setw(8) << "mode" << std::setw(16) << "writes/s" << std::setw(12) << "fsyncs" << "records/fsync\n";
+	for (StoreDurability::durability_modes::mode mode : {StoreDurability::durability_modes::mode::NONE, StoreDurability::durability_modes::mode::ASYNC, \
+			StoreDurability::durability_modes::mode::GROUP, StoreDurability::durability_modes::mode::SYNC}) {
+		clear(directory);
+		ResourceStore store;
+		StoreDurability::durability_config config;
+		config.mode = mode;
+		config.directory = directory;
+		config.snapshotInterval = std::chrono::seconds(0);
+		StoreDurability durability(store, config);
+		durability.open();
+
+		std::atomic<bool> stop(false);
+		std::atomic<std::uint64_t> writes(0);
+		std::vector<std::thread> threads;
+		for (std::size_t t = 0; t < threadCount; t++) {
+			threads.emplace_back([&, t] {
+				std::uint64_t done = 0;
+				while (!stop.load(std::memory_order_relaxed)) {
+					ResourceStore::write_result written = store.put(std::to_string(t * 1000 + done % 1000), "{\"n\":" + std::to_string(done) + "}");
+					durability.waitDurable(written.sequence);
+					done++;
+				}
+				writes += done;
+			});
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+		stop = true;
+		for (std::thread & thread : threads)
+			thread.join();
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		durability.close();
+
+		std::cout << std::setw(8) << StoreDurability::durability_modes::to_string(mode) << std::fixed << std::setprecision(0) \
+			<< std::setw(16) << writes / elapsed << std::setw(12) << durability.fsyncs() << std::setprecision(1) \
+			<< (durability.fsyncs() ? double(writes) / durability.fsyncs() : 0.0) << '\n';
+	}
+	clear(directory);
+	rmdir(directory.c_str());
+	return 0;
+}
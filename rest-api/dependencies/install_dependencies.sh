@@ -1,3 +1,3 @@
 #!/bin/bash
 
-sudo apt install libboost-all-dev libcpprest-dev -y
\ No newline at end of file
+sudo apt install libboost-all-dev libcpprest-dev zlib1g-dev -y
\ No newline at end of file
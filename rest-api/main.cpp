@@ -1,5 +1,10 @@
 
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <limits>
+#include <cmath>
+#include <stdexcept>
 #include "APIService.h"
 #include "include/DateTimeUtils.h"
 
@@ -7,17 +12,168 @@
 #define LOGGER Logger::getLogger()
 
 
-//execution = ./bin/restapi.app <port_number>
+//execution = ./bin/restapi.app <port_number> <drain_deadline_seconds> <worker_threads> <bind_addresses> <listener_shards> <listener_type>
+//                               <durability_mode> <data_directory> <client_rate> <concurrency_limit> <default_timeout_ms> <config_file>
+//                               <log_format>
+static const char *USAGE = "Usage: ./bin/restapi.app [port_number] [drain_deadline_seconds] [worker_threads] [bind_addresses] [listener_shards]\n"
+	"                         [listener_type] [durability_mode] [data_directory] [client_rate] [concurrency_limit]\n"
+	"                         [default_timeout_ms] [config_file] [log_format]\n";
+
+//Whole argument as a non-negative integer up to maximum, throws std::invalid_argument or std::out_of_range (naming it) otherwise
+static unsigned long long countArgument(const char * text, const char * name, unsigned long long maximum = std::numeric_limits<long long>::max()) {
+	std::string value(text);
+	if (value.empty() or value.find_first_not_of("0123456789") != std::string::npos)
+		throw std::invalid_argument(std::string(name) + " is not a non-negative integer: " + value);
+	//Up to 19 digits always fit (maximum is no larger either), so stoull never throws
+	unsigned long long count = (value.size() <= 19) ? std::stoull(value) : 0;
+	if (value.size() > 19 or count > maximum)
+		throw std::out_of_range(std::string(name) + " is out of range: " + value);
+	return count;
+}
+
+//Whole argument as a finite non-negative number, throws std::invalid_argument (naming it) otherwise
+static double rateArgument(const char * text, const char * name) {
+	std::string value(text);
+	std::size_t used = 0;
+	double rate = -1;
+	try {
+		rate = std::stod(value, &used);
+	}
+	catch (std::exception &) { }
+	if (value.empty() or used != value.size() or !std::isfinite(rate) or rate < 0)
+		throw std::invalid_argument(std::string(name) + " is not a non-negative number: " + value);
+	return rate;
+}
+
 int main(int argc, const char * argv[])
 {
+	//Before any thread starts (logger, pools), so every thread inherits the mask and SIGINT/SIGTERM reach run()
+	APIController::blockShutdownSignals();
+
+	//Numeric arguments checked before anything starts: a bad one stops here, with usage
+	std::chrono::seconds drainDeadline(5);
+	std::size_t workerThreads = 0, listenerShards = 0, concurrencyLimit = 0;
+	double clientRate = 0;
+	std::chrono::milliseconds defaultTimeout(0);
+	try {
+		if (argc > 2)
+			drainDeadline = std::chrono::seconds(countArgument(argv[2], "drain_deadline_seconds", 24 * 3600));
+		if (argc > 3)
+			workerThreads = countArgument(argv[3], "worker_threads", 4096);
+		if (argc > 5)
+			listenerShards = countArgument(argv[5], "listener_shards", 4096);
+		if (argc > 9)
+			clientRate = rateArgument(argv[9], "client_rate");
+		if (argc > 10)
+			concurrencyLimit = countArgument(argv[10], "concurrency_limit");
+		if (argc > 11)
+			defaultTimeout = std::chrono::milliseconds(countArgument(argv[11], "default_timeout_ms"));
+	}
+	catch (std::exception & e) {
+		std::cout << ">> ERROR! <" << e.what() << ">\n" << USAGE;
+		return 1;
+	}
+
+	LOGGER->enableAsync(8192, Logger::overflow_policies::policy::DROP_NEWEST);
+
+	//Log format "binary": records written undecoded to <log>.blog (render with ./bin/logdecode.app), text otherwise
+	if (argc > 13 and std::string(argv[13]) == "binary") {
+		try {
+			LOGGER->enableBinary();
+		}
+		catch (std::exception & e) {
+			std::cout << ">> Binary log not enabled <" << e.what() << ">\n";
+		}
+	}
+
+	//Last records kept in a mapped ring file that survives a crash (./bin/logextract.app reads it)
+	try {
+		std::string preserved = LOGGER->enableCrashRing();
+		if (!preserved.empty())
+			std::cout << ">> Previous run did not exit normally, its last log records are in <" << preserved << ">\n";
+	}
+	catch (std::exception & e) {
+		std::cout << ">> Crash ring not enabled <" << e.what() << ">\n";
+	}
+
+	//New file per day and every 100 MiB, older ones gzipped, last 14 kept (size and retention can be changed by config file)
+	Logger::rotation_config rotationConfig;
+	rotationConfig.maxFileSize = 100 << 20;
+	LOGGER->setRotationConfig(rotationConfig);
+
     APIService service;
 	std::string port = ((argc > 1) ? argv[1] : "8080");
-    service.setEndpoint("http://host_IPV4:" + port + "/api");	//host_IPV4 is internally replaced by actual IP of host!
 
-	LOGGER->log(">> Endpoint configured: " + service.getEndpoint());
-	std::cout << ">> Endpoint configured: " << service.getEndpoint() << '\n';
+	//Worker threads given: service runs on its own work-stealing scheduler, one worker pinned per core
+	if (workerThreads > 0) {
+		APIController::scheduler_config schedulerConfig;
+		schedulerConfig.type = APIController::scheduler_types::type::WORK_STEALING;
+		schedulerConfig.workerCount = workerThreads;
+		schedulerConfig.affinity = WorkStealingPool::affinity_modes::mode::CORE;
+		service.setSchedulerConfig(schedulerConfig);
+	}
+	//Shards given: that many SO_REUSEPORT sockets (or event loops, when type is "epoll" or "io_uring") per bind address instead of one cpprest listener
+	if (listenerShards > 0) {
+		APIController::listener_config listenerConfig;
+		listenerConfig.type = (argc > 6) ? APIController::listener_types::from_string(argv[6]) : APIController::listener_types::type::REUSEPORT_SHARDS;
+		listenerConfig.shardCount = listenerShards;
+		service.setListenerConfig(listenerConfig);
+	}
+
+	//Admission given: requests per second per client address (429 beyond it) and initial limit of requests inside
+	//handlers, adapted to their latency (503 beyond it); 0 disables either one
+	if (argc > 9) {
+		APIController::admission_config admissionConfig;
+		admissionConfig.clientRate = clientRate;
+		admissionConfig.initialLimit = concurrencyLimit;
+		service.setAdmissionConfig(admissionConfig);
+	}
+
+	//Default deadline given (ms, 0 = none): requests still queued past it get 504 without reaching a handler
+	if (argc > 11) {
+		APIController::deadline_config deadlineConfig;
+		deadlineConfig.defaultTimeout = defaultTimeout;
+		service.setDeadlineConfig(deadlineConfig);
+	}
+
+	//Bind addresses given (comma separated, e.g. "0.0.0.0,::"): one listener per address
+	std::vector<std::string> bindAddresses;
+	std::istringstream addressList((argc > 4) ? argv[4] : APIController::HOST_PLACEHOLDER);
+	for (std::string address; std::getline(addressList, address, ',');)
+		if (!address.empty())
+			bindAddresses.push_back(address);
+    service.setEndpoint("http://host_IPV4:" + port + "/api", bindAddresses);	//host_IPV4 is internally replaced by actual IP of host!
+
+	for (const std::string & endpoint : service.getEndpoints()) {
+		LOGGER->log<Logger::message_types::type::INFO>(">> Endpoint configured: {}", endpoint);
+		std::cout << ">> Endpoint configured: " << endpoint << '\n';
+	}
 
     try {
+		//Durability given (none, async, group or sync): resources are recovered from data directory and every write is logged
+		if (argc > 7) {
+			StoreDurability::durability_config durabilityConfig;
+			durabilityConfig.mode = StoreDurability::durability_modes::from_string(argv[7]);
+			durabilityConfig.directory = (argc > 8) ? argv[8] : "data";
+			StoreDurability::recovery_stats recovery = service.setDurabilityConfig(durabilityConfig);
+			std::cout << ">> Recovered " << (recovery.snapshotEntries + recovery.walRecords) << " records (" \
+				<< StoreDurability::durability_modes::to_string(durabilityConfig.mode) << ")\n";
+		}
+
+		//Config file given: applied before serving and again whenever it changes (log level, rate limits, workers, routes,
+		//cache TTL); a file that can not be applied stops here, before any request is accepted
+		if (argc > 12) {
+			try {
+				service.setConfigFile(argv[12]);
+			}
+			catch (std::exception & e) {
+				LOGGER->log<Logger::message_types::type::ERROR>(">> Config file <{}> not applied: {}", argv[12], e.what());
+				std::cout << ">> ERROR! Config file <" << argv[12] << "> not applied <" << e.what() << ">\n";
+				return 1;
+			}
+			std::cout << ">> Watching config file " << argv[12] << '\n';
+		}
+
 		LOGGER->log(">> Opening...", Logger::message_types::type::INFO);
 		std::cout << ">> Opening...\n";
 		
@@ -26,13 +182,24 @@ int main(int argc, const char * argv[])
 		LOGGER->log(">> Service listening for requests!", Logger::message_types::type::INFO);
         std::cout << ">> Service listening for requests!\n\n";
 
-		while (true);
-  
-        service.close().wait();
+		//Blocks until SIGINT/SIGTERM, then drains in-flight requests and closes the listener
+		APIController::shutdown_report report = service.run(drainDeadline);
+
+		std::string reportMessage = ">> Service closed! Drain took " + std::to_string(report.drainTime.count()) + " ms" \
+			+ " (drained: " + std::to_string(report.drainedRequests) \
+			+ ", dropped: " + std::to_string(report.droppedRequests) \
+			+ ", rejected: " + std::to_string(report.rejectedRequests) + ")";
+		LOGGER->log(reportMessage, (report.droppedRequests > 0) ? Logger::message_types::type::WARNING : Logger::message_types::type::INFO);
+		std::cout << reportMessage << '\n';
+
+		Logger::async_stats logStats = LOGGER->getAsyncStats();
+		if (logStats.droppedNewest > 0 or logStats.droppedOldest > 0)
+			std::cout << ">> Logger dropped " << (logStats.droppedNewest + logStats.droppedOldest) << " records (buffer full)\n";
     }
     catch(std::exception & e) {
-		LOGGER->log(">> " + (std::string) e.what(), Logger::message_types::type::ERROR);
+		LOGGER->log<Logger::message_types::type::ERROR>(">> {}", e.what());
         std::cout << ">> ERROR! <" <<  e.what() << ">\n";
+		return 1;
     }
 
     return 0;
@@ -2,40 +2,482 @@
 #include "APIController.h"
 
 
-APIController::APIController() {}
+APIController::APIController() : draining(false), inFlightRequests(0), rejectedRequests(0), \
+	expiredBeforeDispatch(0), cancelledInHandler(0), skippedWork(0), handledRequests(0), handlerNanos(0) {
+	setAdmissionConfig(admission_config());
+}
 
 APIController::~APIController() {}
 
 void APIController::setEndpoint(const std::string &URI) {
+	setEndpoint(URI, {web::uri(URI).host()});
+}
+
+void APIController::setEndpoint(const std::string &URI, const std::vector<std::string> &bindAddresses) {
 	web::uri endpointURI(URI);
-	
-	//URI example = https://127.0.0.1:123/forum/questions
-	web::uri_builder endpointBuilder;
-	endpointBuilder.set_scheme(endpointURI.scheme());	// https
-	endpointBuilder.set_host(getHostIP());				// 127.0.0.1
-	endpointBuilder.set_port(endpointURI.port());		// 123
-	endpointBuilder.set_path(endpointURI.path());		// /forum/questions
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	startupTimings.hostResolution = std::chrono::microseconds(0);
+	httpListeners.clear();
+
+	for (const std::string & address : bindAddresses) {
+		std::string host = address;
+		if (boost::algorithm::iequals(address, HOST_PLACEHOLDER)) {
+			std::chrono::steady_clock::time_point resolveStart = std::chrono::steady_clock::now();
+			host = getHostIP();
+			startupTimings.hostResolution += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - resolveStart);
+		}
+
+		//URI example = https://127.0.0.1:123/forum/questions
+		web::uri_builder endpointBuilder;
+		endpointBuilder.set_scheme(endpointURI.scheme());	// https
+		endpointBuilder.set_host(formatHost(host));			// 127.0.0.1 (or [::1])
+		endpointBuilder.set_port(endpointURI.port());		// 123
+		endpointBuilder.set_path(endpointURI.path());		// /forum/questions
+
+		httpListeners.emplace_back(endpointBuilder.to_uri());
+	}
 
-	this->httpListener = web::http::experimental::listener::http_listener(endpointBuilder.to_uri());
+	startupTimings.listenerSetup = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start) - startupTimings.hostResolution;
 }
 
 std::string APIController::getEndpoint() const {
-	return this->httpListener.uri().to_string();
+	return httpListeners.empty() ? std::string() : httpListeners.front().uri().to_string();
+}
+
+std::vector<std::string> APIController::getEndpoints() const {
+	std::vector<std::string> endpoints;
+	for (const web::http::experimental::listener::http_listener & listener : httpListeners)
+		endpoints.push_back(listener.uri().to_string());
+	return endpoints;
 }
 
 std::string APIController::getHostIP() {
-	boost::asio::io_service ioService;
-	boost::asio::ip::tcp::resolver resolver(ioService);
-	return resolver.resolve(boost::asio::ip::host_name(), "")->endpoint().address().to_string();
+	//Blocking DNS lookup of own host name, done only by first caller (others wait for it); a failure is retried next call
+	static std::once_flag resolved;
+	static std::string hostIP;
+	std::call_once(resolved, [] {
+		boost::asio::io_service ioService;
+		boost::asio::ip::tcp::resolver resolver(ioService);
+		boost::asio::ip::tcp::resolver::iterator entry = resolver.resolve(boost::asio::ip::tcp::resolver::query(boost::asio::ip::host_name(), ""));
+
+		boost::asio::ip::address fallback;
+		bool hasFallback = false;
+		for (; entry != boost::asio::ip::tcp::resolver::iterator(); entry++) {
+			boost::asio::ip::address address = entry->endpoint().address();
+			if (address.is_v4() and !address.is_loopback()) {
+				hostIP = address.to_string();
+				return;
+			}
+			if (!hasFallback or (address.is_v4() and !fallback.is_v4())) {
+				fallback = address;
+				hasFallback = true;
+			}
+		}
+		if (!hasFallback)
+			throw std::runtime_error("no address found for host " + boost::asio::ip::host_name());
+		hostIP = fallback.to_string();
+	});
+	return hostIP;
+}
+
+std::string APIController::formatHost(const std::string &address) {
+	//IPv6 literals go between brackets inside an URI
+	if (address.find(':') != std::string::npos and address[0] != '[')
+		return "[" + address + "]";
+	return address;
+}
+
+APIController::startup_timings APIController::getStartupTimings() const {
+	return startupTimings;
 }
 
 pplx::task<void> APIController::open() {
+	//Threads of listeners inherit the mask; the ones started before open() (logger, compression pool) only have it when
+	//main called blockShutdownSignals first
+	blockShutdownSignals();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	applySchedulerConfig();
+	startupTimings.schedulerSetup = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
 	addSupportToMethodsHTTP();
-	return this->httpListener.open();
+	std::vector<pplx::task<void>> openings;
+	start = std::chrono::steady_clock::now();
+	if (listenerConfig.type != listener_types::type::CPPREST)
+		openings = openNativeListeners();
+	else
+		for (web::http::experimental::listener::http_listener & listener : httpListeners) {
+			listener.support([this](web::http::http_request message) { dispatch(message, message.remote_address(), std::chrono::steady_clock::now()); });
+			openings.push_back(listener.open());
+		}
+
+	std::size_t listenerCount = openings.size();
+	return pplx::when_all(openings.begin(), openings.end()).then([this, start, listenerCount] {
+		startupTimings.listenerOpen = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		Logger::getLogger()->log<Logger::message_types::type::INFO>( \
+			"Startup: host resolution {} us, listener setup {} us, scheduler {} us, listener open {} us ({} listeners)", \
+			startupTimings.hostResolution.count(), startupTimings.listenerSetup.count(), startupTimings.schedulerSetup.count(), \
+			startupTimings.listenerOpen.count(), listenerCount);
+	});
 }
 
 pplx::task<void> APIController::close() {
-	return this->httpListener.close();
+	std::vector<pplx::task<void>> closings;
+	if (listenerConfig.type != listener_types::type::CPPREST)
+		for (std::unique_ptr<NativeListener> & native : nativeListeners) {
+			NativeListener *listener = native.get();
+			closings.push_back(pplx::create_task([listener] { listener->close(); }));
+		}
+	else
+		for (web::http::experimental::listener::http_listener & listener : httpListeners)
+			closings.push_back(listener.close());
+	return pplx::when_all(closings.begin(), closings.end());
+}
+
+void APIController::setListenerConfig(const listener_config &config) {
+	listenerConfig = config;
+}
+
+void APIController::setAdmissionConfig(const admission_config &config) {
+	admissionConfig = config;
+	rateLimiter.reset(new ClientRateLimiter(config.clientRate, config.clientBurst, config.clientSlots));
+	concurrencyLimiter.reset(new ConcurrencyLimiter(config.initialLimit, config.minimumLimit, config.maximumLimit, config.latencyTolerance, config.windowSize));
+}
+
+void APIController::setClientLimits(double rate, double burst) {
+	rateLimiter->setLimits(rate, burst);
+}
+
+APIController::admission_stats APIController::getAdmissionStats() const {
+	admission_stats stats;
+	stats.rateLimited = rateLimiter->limited();
+	stats.overloaded = concurrencyLimiter->shed();
+	stats.concurrencyLimit = concurrencyLimiter->limit();
+	stats.inFlight = concurrencyLimiter->inFlight();
+	stats.latencyBaselineNanos = concurrencyLimiter->baselineNanos();
+	return stats;
+}
+
+APIController::admission_config APIController::getAdmissionConfig() const {
+	return admissionConfig;
+}
+
+void APIController::setDeadlineConfig(const deadline_config &config) {
+	deadlineConfig = config;
+}
+
+APIController::deadline_stats APIController::getDeadlineStats() const {
+	deadline_stats stats;
+	stats.expiredBeforeDispatch = expiredBeforeDispatch.load(std::memory_order_relaxed);
+	stats.cancelledInHandler = cancelledInHandler.load(std::memory_order_relaxed);
+	stats.skippedWork = skippedWork.load(std::memory_order_relaxed);
+	std::uint64_t handled = handledRequests.load(std::memory_order_relaxed);
+	if (handled > 0)
+		stats.savedSeconds = stats.expiredBeforeDispatch * (handlerNanos.load(std::memory_order_relaxed) / (double) handled) / 1e9;
+	return stats;
+}
+
+std::chrono::milliseconds APIController::requestTimeout(const web::http::http_request &message) const {
+	std::chrono::milliseconds timeout = deadlineConfig.defaultTimeout;
+	auto asked = message.headers().find(TIMEOUT_HEADER);
+	if (asked != message.headers().end()) {
+		//Invalid or non-positive values are ignored (default applies)
+		char *end = nullptr;
+		long long millis = std::strtoll(asked->second.c_str(), &end, 10);
+		if (end != asked->second.c_str() and *end == '\0' and millis > 0)
+			timeout = std::chrono::milliseconds(millis);
+	}
+	//0 (no deadline) stays as is: cap only applies to timeouts given
+	if (deadlineConfig.maximumTimeout.count() > 0 and timeout > deadlineConfig.maximumTimeout)
+		timeout = deadlineConfig.maximumTimeout;
+	return timeout;
+}
+
+std::vector<std::uint64_t> APIController::getShardRequestCounts() const {
+	std::vector<std::uint64_t> counts;
+	for (const std::unique_ptr<NativeListener> & listener : nativeListeners)
+		for (std::uint64_t served : listener->servedRequests())
+			counts.push_back(served);
+	return counts;
+}
+
+std::vector<pplx::task<void>> APIController::openNativeListeners() {
+	//Own sockets replace cpprest listeners, which are kept only as the parsed URIs of bind addresses
+	std::size_t shardCount = (listenerConfig.shardCount > 0) ? listenerConfig.shardCount : std::max(1u, std::thread::hardware_concurrency());
+	std::vector<pplx::task<void>> openings;
+	nativeListeners.clear();
+
+	listener_types::type type = listenerConfig.type;
+	if (type == listener_types::type::IO_URING and !UringListener::supported()) {
+		Logger::getLogger()->log<Logger::message_types::type::WARNING>("io_uring not supported by kernel, listener falls back to epoll");
+		type = listener_types::type::EPOLL;
+	}
+
+	for (const web::http::experimental::listener::http_listener & listener : httpListeners) {
+		std::string basePath = listener.uri().path();
+		HttpCodec::request_handler handler = [this, basePath](const HttpCodec::request & request, HttpCodec::responder respond) {
+			serveNativeRequest(basePath, request, respond);
+		};
+
+		//Opened here rather than in a task: listener threads must inherit the signal mask of caller (see open())
+		try {
+			if (type == listener_types::type::EPOLL or type == listener_types::type::IO_URING) {
+				if (type == listener_types::type::IO_URING)
+					nativeListeners.emplace_back(new UringListener(listener.uri().host(), listener.uri().port(), shardCount, handler, listenerConfig.backlog));
+				else
+					nativeListeners.emplace_back(new EpollListener(listener.uri().host(), listener.uri().port(), shardCount, handler, listenerConfig.backlog));
+				nativeListeners.back()->setMaxBodyLength(listenerConfig.maxBodyLength);
+				nativeListeners.back()->open();
+				openings.push_back(pplx::task_from_result());
+				continue;
+			}
+			for (std::size_t i = 0; i < shardCount; i++) {
+				nativeListeners.emplace_back(new ReusePortListener(listener.uri().host(), listener.uri().port(), listenerConfig.threadsPerShard, \
+					handler, listenerConfig.backlog));
+				nativeListeners.back()->setMaxBodyLength(listenerConfig.maxBodyLength);
+				nativeListeners.back()->open();
+				openings.push_back(pplx::task_from_result());
+			}
+		}
+		catch (std::exception &) {
+			openings.push_back(pplx::task_from_exception<void>(std::current_exception()));
+		}
+	}
+	return openings;
+}
+
+void APIController::serveNativeRequest(const std::string &basePath, const HttpCodec::request &request, const HttpCodec::responder &respond) {
+	//Same rule of http_listener: only paths under the one of endpoint are delivered
+	web::uri target(request.target);
+	const std::string &path = target.path();
+	if (path.compare(0, basePath.size(), basePath) != 0 or (path.size() > basePath.size() and basePath.back() != '/' and path[basePath.size()] != '/')) {
+		HttpCodec::response response;
+		response.status = web::http::status_codes::NotFound;
+		respond(std::move(response));
+		return;
+	}
+
+	web::http::http_request message(request.method);
+	message.set_request_uri(target);
+	for (const std::pair<std::string, std::string> & header : request.headers)
+		message.headers().add(header.first, header.second);
+
+	//Body is not copied into message: handlers read it from their context, as a view of request (alive until dispatch returns)
+	dispatch(message, request.remoteAddress, request.receivedAt, &request.body);
+
+	//Without a server context, reply() only completes the response task: replies given before handler returned are taken
+	//right away (written inline by the loop), the ones given later (e.g. by a compression worker) when their task completes
+	pplx::task<web::http::http_response> reply = message.get_response();
+	if (reply.is_done()) {
+		respond(nativeResponse(reply.get()));
+		return;
+	}
+	reply.then([respond](pplx::task<web::http::http_response> replied) {
+		HttpCodec::response response;
+		try {
+			response = nativeResponse(replied.get());
+		}
+		catch (std::exception &) {
+			response = HttpCodec::response();
+			response.status = web::http::status_codes::InternalError;
+		}
+		respond(std::move(response));
+	});
+}
+
+HttpCodec::response APIController::nativeResponse(web::http::http_response reply) {
+	HttpCodec::response response;
+	response.status = reply.status_code();
+	response.reason = reply.reason_phrase();
+	for (const std::pair<const std::string, std::string> & header : reply.headers())
+		response.headers.emplace_back(header.first, header.second);
+	std::vector<unsigned char> body = reply.extract_vector().get();
+	response.body.assign(body.begin(), body.end());
+	return response;
+}
+
+APIController::shutdown_report APIController::run(std::chrono::milliseconds drainDeadline) {
+	sigset_t shutdownSignals = blockShutdownSignals();
+	int receivedSignal = 0;
+	while (sigwait(&shutdownSignals, &receivedSignal) != 0);
+
+	//Stop accepting (new requests are rejected by dispatch) and wait for the ones inside handlers
+	std::chrono::steady_clock::time_point drainStart = std::chrono::steady_clock::now();
+	std::size_t inFlightAtSignal = inFlightRequests;
+	draining = true;
+	{
+		std::unique_lock<std::mutex> lock(drainMutex);
+		drainCondition.wait_for(lock, drainDeadline, [this] { return inFlightRequests == 0; });
+	}
+
+	shutdown_report report;
+	report.droppedRequests = inFlightRequests;
+	report.drainedRequests = (inFlightAtSignal > report.droppedRequests) ? inFlightAtSignal - report.droppedRequests : 0;
+	report.rejectedRequests = rejectedRequests;
+	report.drainTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - drainStart);
+
+	close().wait();
+	return report;
+}
+
+void APIController::setSchedulerConfig(const scheduler_config &config) {
+	schedulerConfig = config;
+	scheduler.reset();
+	if (config.type == scheduler_types::type::WORK_STEALING)
+		scheduler = std::make_shared<APIScheduler>(config.workerCount, config.affinity);
+}
+
+std::shared_ptr<APIScheduler> APIController::getScheduler() const {
+	return scheduler;
+}
+
+void APIController::applySchedulerConfig() {
+	if (!scheduler)
+		return;
+	pplx::set_ambient_scheduler(scheduler);
+
+	//Listener I/O runs on cpprest's own thread pool, sized alike when still possible
+	try {
+		crossplat::threadpool::initialize_with_threads(scheduler->getPool().size());
+	}
+	catch (std::exception & e) {
+		Logger::getLogger()->log<Logger::message_types::type::WARNING>("I/O thread pool keeps its size: {}", e.what());
+	}
+	Logger::getLogger()->log<Logger::message_types::type::INFO>("Scheduler: {} workers (affinity: {})", \
+		scheduler->getPool().size(), WorkStealingPool::affinity_modes::to_string(schedulerConfig.affinity));
+}
+
+void APIController::supportMethod(const web::http::method &method, const std::function<void(web::http::http_request, APIRequestContext &)> &handler) {
+	methodHandlers[method] = handler;
+}
+
+void APIController::dispatch(web::http::http_request message, const std::string &clientAddress, std::chrono::steady_clock::time_point receivedAt, \
+	const std::string *body) {
+	//Counted before checking draining, so run() never misses a request that already passed the check
+	inFlightRequests++;
+
+	if (draining) {
+		rejectedRequests++;
+		message.reply(web::http::status_codes::ServiceUnavailable);
+		releaseRequest();
+		return;
+	}
+
+	//Body limit of native listeners, for bodies still unread inside cpprest: judged by declared length, before reading any
+	if (body == nullptr) {
+		bool chunked = message.headers().has(web::http::header_names::transfer_encoding);
+		if (chunked or message.headers().content_length() > listenerConfig.maxBodyLength) {
+			message.reply(chunked ? web::http::status_codes::LengthRequired : web::http::status_codes::RequestEntityTooLarge);
+			releaseRequest();
+			return;
+		}
+	}
+
+	//Client stopped waiting while request was queued: nobody would read the answer (nor does it count against client rate)
+	APIRequestContext context(receivedAt, requestTimeout(message));
+	if (body != nullptr)
+		context.setBody(*body);
+	if (context.cancelled()) {
+		expiredBeforeDispatch.fetch_add(1, std::memory_order_relaxed);
+		replyDeadlineExceeded(message);
+		releaseRequest();
+		return;
+	}
+
+	//Admission: shed before any work is done for request
+	if (!rateLimiter->tryAcquire(clientAddress)) {
+		web::http::http_response response(TOO_MANY_REQUESTS);
+		response.headers().add(web::http::header_names::retry_after, std::to_string(rateLimiter->retryAfter().count()));
+		message.reply(response);
+		releaseRequest();
+		return;
+	}
+	if (!concurrencyLimiter->tryAcquire()) {
+		web::http::http_response response(web::http::status_codes::ServiceUnavailable);
+		response.headers().add(web::http::header_names::retry_after, "1");
+		message.reply(response);
+		releaseRequest();
+		return;
+	}
+
+	//Route of request for concurrency limit: method handler (0 when there is none), so each one has its own latency baseline
+	auto handler = methodHandlers.find(message.method());
+	std::size_t route = (handler == methodHandlers.end()) ? 0 : std::distance(methodHandlers.begin(), handler) + 1;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	context.setCompletion([this, start, route] { completeRequest(start, route); });
+	try {
+		if (handler != methodHandlers.end())
+			handler->second(message, context);
+		else
+			message.reply(web::http::status_codes::MethodNotAllowed);
+	}
+	catch (...) {
+		finishRequest(context, start, route);
+		throw;
+	}
+	finishRequest(context, start, route);
+}
+
+void APIController::finishRequest(const APIRequestContext &context, std::chrono::steady_clock::time_point start, std::size_t route) {
+	if (context.skippedWork() > 0) {
+		cancelledInHandler.fetch_add(1, std::memory_order_relaxed);
+		skippedWork.fetch_add(context.skippedWork(), std::memory_order_relaxed);
+	}
+	if (!context.completionDeferred())
+		completeRequest(start, route);
+}
+
+void APIController::completeRequest(std::chrono::steady_clock::time_point start, std::size_t route) {
+	//Time until reply was given (compression included), so drain waits for it and concurrency limit sees all of it
+	std::uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	handledRequests.fetch_add(1, std::memory_order_relaxed);
+	handlerNanos.fetch_add(nanos, std::memory_order_relaxed);
+	concurrencyLimiter->release(nanos, route);
+	releaseRequest();
+}
+
+void APIController::releaseRequest() {
+	if (--inFlightRequests == 0 and draining) {
+		std::lock_guard<std::mutex> lock(drainMutex);
+		drainCondition.notify_all();
+	}
+}
+
+sigset_t APIController::blockShutdownSignals() {
+	sigset_t shutdownSignals;
+	sigemptyset(&shutdownSignals);
+	sigaddset(&shutdownSignals, SIGINT);
+	sigaddset(&shutdownSignals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &shutdownSignals, nullptr);
+	return shutdownSignals;
 }
 
 void APIController::addSupportToMethodsHTTP() {}
+
+void APIController::replyDeadlineExceeded(web::http::http_request message) {
+	message.reply(web::http::status_codes::GatewayTimeout, std::string("deadline exceeded"));
+}
+
+std::string APIController::listener_types::to_string(type t) {
+	switch (t) {
+		case type::CPPREST:				return "cpprest"; break;
+		case type::REUSEPORT_SHARDS:	return "reuseport-shards"; break;
+		case type::EPOLL:				return "epoll"; break;
+		case type::IO_URING:			return "io_uring";
+	}
+	return "cpprest";
+}
+
+APIController::listener_types::type APIController::listener_types::from_string(const std::string &name) {
+	for (type t : {type::CPPREST, type::REUSEPORT_SHARDS, type::EPOLL, type::IO_URING})
+		if (boost::algorithm::iequals(name, to_string(t)))
+			return t;
+	return type::CPPREST;
+}
+
+std::string APIController::scheduler_types::to_string(type t) {
+	switch (t) {
+		case type::DEFAULT:			return "default"; break;
+		case type::WORK_STEALING:	return "work-stealing";
+	}
+	return "default";
+}
@@ -2,26 +2,224 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <map>
+#include <iterator>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <condition_variable>
+#include <csignal>
 #include <cpprest/http_listener.h>
 #include <pplx/pplxtasks.h>
+#include <pplx/threadpool.h>
 #include <boost/asio.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include "APIScheduler.h"
+#include "APIRequestContext.h"
+#include "include/ReusePortListener.h"
+#include "include/EpollListener.h"
+#include "include/UringListener.h"
+#include "include/ClientRateLimiter.h"
+#include "include/ConcurrencyLimiter.h"
+#include "include/Logger.h"
 
 
 class APIController {
+	public:
+		class scheduler_types {
+			public:
+				enum class type { DEFAULT, WORK_STEALING };	//DEFAULT: whatever cpprest picks
+				static std::string to_string(type t);
+		};
+
+		class scheduler_config {
+			public:
+				scheduler_types::type type = scheduler_types::type::DEFAULT;
+				std::size_t workerCount = 0;	//0 = one per core
+				WorkStealingPool::affinity_modes::mode affinity = WorkStealingPool::affinity_modes::mode::NONE;
+		};
+
+		class listener_types {
+			public:
+				//REUSEPORT_SHARDS: N sockets on the same port (SO_REUSEPORT), kernel balances connections, each one served by
+				//a few event loops sharing its socket
+				//EPOLL: N edge-triggered event loops (one socket each, SO_REUSEPORT), replies given after handler returns
+				//(e.g. by compression workers) are written by the loop once given, without holding it
+				//IO_URING: as EPOLL, on io_uring rings (batched submissions, fixed files); falls back to EPOLL on older kernels
+				enum class type { CPPREST, REUSEPORT_SHARDS, EPOLL, IO_URING };
+				static std::string to_string(type t);
+				static type from_string(const std::string & name);	//Unknown names = CPPREST
+		};
+
+		class listener_config {
+			public:
+				listener_types::type type = listener_types::type::CPPREST;
+				std::size_t shardCount = 0;			//Shards (or event loops) per bind address, 0 = one per core
+				std::size_t threadsPerShard = 4;	//REUSEPORT_SHARDS only: event loops per shard (any number of connections each)
+				int backlog = 1024;
+				//Every type: requests with a larger body get 413 before it is read (through cpprest, by their Content-Length;
+				//chunked ones, of unknown length, get 411 as native listeners do not take them either)
+				std::size_t maxBodyLength = HttpCodec::DEFAULT_MAX_BODY_LENGTH;
+		};
+
+		//Checked by dispatch before any handler runs: requests over the rate of their client address are shed with 429,
+		//the ones over the concurrency limit (adapted to handler latency, see ConcurrencyLimiter) with 503
+		class admission_config {
+			public:
+				double clientRate = 0;				//Requests per second per client address, 0 = no rate limiting
+				double clientBurst = 0;				//0 = one second of rate
+				std::size_t clientSlots = 4096;		//Clients tracked at once
+				std::size_t initialLimit = 0;		//Requests inside handlers at once, 0 = no limit
+				std::size_t minimumLimit = 4;
+				std::size_t maximumLimit = 4096;
+				double latencyTolerance = 2.0;		//Limit shrinks when latency of a window exceeds baseline of its routes this many times
+				std::size_t windowSize = 200;		//Requests per adjustment of limit
+		};
+
+		class admission_stats {
+			public:
+				std::uint64_t rateLimited = 0;		//Shed with 429
+				std::uint64_t overloaded = 0;		//Shed with 503
+				std::size_t concurrencyLimit = 0;	//0 = no limit
+				std::size_t inFlight = 0;
+				std::uint64_t latencyBaselineNanos = 0;	//Per request, for mix of routes of last window
+		};
+
+		//Deadline of each request: timeout (ms) asked by client in header X-Request-Timeout, else the default; counted from when
+		//request was read, so time waiting for a worker is included. Requests already expired when their turn comes are answered
+		//504 without running handler; handlers see deadline and cancellation through their APIRequestContext
+		class deadline_config {
+			public:
+				std::chrono::milliseconds defaultTimeout{30000};	//0 = no deadline unless asked by client
+				std::chrono::milliseconds maximumTimeout{60000};	//Cap of asked timeouts, 0 = no cap
+		};
+
+		class deadline_stats {
+			public:
+				std::uint64_t expiredBeforeDispatch = 0;	//Answered 504 before their handler ran
+				std::uint64_t cancelledInHandler = 0;		//Handler gave up on some work (skipWork)
+				std::uint64_t skippedWork = 0;				//Units of work given up by handlers (e.g. batch items, retries)
+				double savedSeconds = 0;					//Estimate: expired requests times average handler time
+		};
+
+		//Where time went on last setEndpoint()/open() (host resolution is 0 when cached or not needed)
+		class startup_timings {
+			public:
+				std::chrono::microseconds hostResolution{0};
+				std::chrono::microseconds listenerSetup{0};
+				std::chrono::microseconds schedulerSetup{0};
+				std::chrono::microseconds listenerOpen{0};
+		};
+
 	protected:
-		web::http::experimental::listener::http_listener httpListener;
+		//One listener per bind address, all sharing the same handlers
+		std::vector<web::http::experimental::listener::http_listener> httpListeners;
+
+		void supportMethod(const web::http::method & method, const std::function<void(web::http::http_request, APIRequestContext &)> & handler);
 	
 	private:
-		std::string getHostIP();
+		std::map<web::http::method, std::function<void(web::http::http_request, APIRequestContext &)>> methodHandlers;
+
+		//Graceful shutdown state (requests are counted while inside a handler)
+		std::atomic<bool> draining;
+		std::atomic<std::size_t> inFlightRequests;
+		std::atomic<std::size_t> rejectedRequests;
+		std::mutex drainMutex;
+		std::condition_variable drainCondition;
+
+		scheduler_config schedulerConfig;
+		std::shared_ptr<APIScheduler> scheduler;
+
+		listener_config listenerConfig;
+		std::vector<std::unique_ptr<NativeListener>> nativeListeners;
+
+		startup_timings startupTimings;
+
+		static const web::http::status_code TOO_MANY_REQUESTS = 429;	//Not among status_codes of cpprest
+		admission_config admissionConfig;
+		std::unique_ptr<ClientRateLimiter> rateLimiter;
+		std::unique_ptr<ConcurrencyLimiter> concurrencyLimiter;
+
+		static constexpr const char *TIMEOUT_HEADER = "X-Request-Timeout";
+		deadline_config deadlineConfig;
+		std::atomic<std::uint64_t> expiredBeforeDispatch;
+		std::atomic<std::uint64_t> cancelledInHandler;
+		std::atomic<std::uint64_t> skippedWork;
+		std::atomic<std::uint64_t> handledRequests;		//With the next one, average handler time for savedSeconds
+		std::atomic<std::uint64_t> handlerNanos;
+
+		static std::string formatHost(const std::string & address);
 		virtual void addSupportToMethodsHTTP();
+		virtual void replyDeadlineExceeded(web::http::http_request message);	//504 of requests expired before dispatch
+		//body: bytes received by a native listener, handed to handlers as a view (nullptr: still inside message, as with cpprest)
+		void dispatch(web::http::http_request message, const std::string & clientAddress, std::chrono::steady_clock::time_point receivedAt, \
+			const std::string * body = nullptr);
+		std::chrono::milliseconds requestTimeout(const web::http::http_request & message) const;
+		void finishRequest(const APIRequestContext & context, std::chrono::steady_clock::time_point start, std::size_t route);	//Counts a dispatched request once handler returned
+		void completeRequest(std::chrono::steady_clock::time_point start, std::size_t route);	//Releases it once replied (see APIRequestContext::deferCompletion)
+		void releaseRequest();
+		void applySchedulerConfig();
+		std::vector<pplx::task<void>> openNativeListeners();
+		void serveNativeRequest(const std::string & basePath, const HttpCodec::request & request, const HttpCodec::responder & respond);
+		static HttpCodec::response nativeResponse(web::http::http_response reply);
 
 	public:
+		class shutdown_report {
+			public:
+				std::chrono::milliseconds drainTime;
+				std::size_t drainedRequests;	//Finished inside drain deadline
+				std::size_t droppedRequests;	//Still in flight when deadline expired
+				std::size_t rejectedRequests;	//Arrived while draining (replied with 503)
+		};
+
+		//Host of endpoint replaced by actual IP of host (any other host, e.g. 127.0.0.1, is used as given)
+		static constexpr const char *HOST_PLACEHOLDER = "host_IPV4";
+
 		APIController();
 		virtual ~APIController();
 		
 		void setEndpoint(const std::string & URI);
-		std::string getEndpoint() const;
+		//Host of URI ignored: one listener bound to each address (e.g. "0.0.0.0", "::", "10.0.0.5", HOST_PLACEHOLDER)
+		void setEndpoint(const std::string & URI, const std::vector<std::string> & bindAddresses);
+		std::string getEndpoint() const;	//First one
+		std::vector<std::string> getEndpoints() const;
 
-		pplx::task<void> open();
+		//Resolved once per process and cached, first non-loopback IPv4 address of host name (loopback/IPv6 as fallback)
+		static std::string getHostIP();
+
+		startup_timings getStartupTimings() const;
+
+		//To be called before open(): scheduler is created now (so its workers can be set before open) and made ambient by
+		//open() (I/O threads of cpprest can only be sized before its first use)
+		void setSchedulerConfig(const scheduler_config & config);
+		std::shared_ptr<APIScheduler> getScheduler() const;
+
+		//Applied by open(): listeners are created per bind address of endpoint (setEndpoint)
+		void setListenerConfig(const listener_config & config);
+		std::vector<std::uint64_t> getShardRequestCounts() const;	//Per shard or event loop
+
+		//To be called before open() (limiters start over)
+		void setAdmissionConfig(const admission_config & config);
+		admission_stats getAdmissionStats() const;
+		admission_config getAdmissionConfig() const;	//As last given to setAdmissionConfig (setClientLimits not included)
+		//Live change of client rate limiting (e.g. on config reload), buckets keep their tokens; burst 0 = one second of rate
+		void setClientLimits(double rate, double burst = 0);
+
+		//To be called before open()
+		void setDeadlineConfig(const deadline_config & config);
+		deadline_stats getDeadlineStats() const;
+
+		pplx::task<void> open();	//Completes when every listener (or shard) is up
 		pplx::task<void> close();
-};
\ No newline at end of file
+
+		//Blocks until SIGINT/SIGTERM, drains in-flight requests up to deadline and closes listener
+		shutdown_report run(std::chrono::milliseconds drainDeadline = std::chrono::seconds(5));
+		//Masks SIGINT/SIGTERM in calling thread (and threads it creates from then on), so run() takes them with sigwait;
+		//to be called first thing in main, before any thread exists (one left unmasked gets the signal and is killed by it)
+		static sigset_t blockShutdownSignals();
+};
@@ -0,0 +1,227 @@
+
+#include "APIMetrics.h"
+
+
+APIMetrics::series_data::series_data() : count(0), sumNanos(0), otherStatusCount(0) {
+	for (std::atomic<std::uint64_t> & bucket : buckets)
+		bucket.store(0, std::memory_order_relaxed);
+	for (std::size_t i = 0; i < STATUS_SLOTS; i++) {
+		statusCodes[i].store(0, std::memory_order_relaxed);
+		statusCounts[i].store(0, std::memory_order_relaxed);
+	}
+}
+
+APIMetrics::thread_block::thread_block() {
+	for (std::atomic<series_data *> & data : series)
+		data.store(nullptr, std::memory_order_relaxed);
+}
+
+APIMetrics::thread_block::~thread_block() {
+	for (std::atomic<series_data *> & data : series)
+		delete data.load();
+}
+
+std::atomic<std::uint64_t> APIMetrics::nextInstanceId(1);
+
+APIMetrics::APIMetrics() : instanceId(nextInstanceId++) {}
+
+APIMetrics::~APIMetrics() {}
+
+std::size_t APIMetrics::addSeries(const std::string &family, const std::string &labels) {
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (std::size_t i = 0; i < seriesLabels.size(); i++)
+		if (seriesLabels[i].family == family and seriesLabels[i].labels == labels)
+			return i;
+
+	if (seriesLabels.size() == MAX_SERIES)
+		return MAX_SERIES - 1;	//Out of room: shares last series instead of failing
+	seriesLabels.push_back(series_labels{family, labels});
+	return seriesLabels.size() - 1;
+}
+
+void APIMetrics::record(std::size_t series, std::uint64_t nanos, unsigned int status) {
+	thread_block *block = currentThreadBlock();
+	series_data *data = block->series[series].load(std::memory_order_relaxed);
+	if (data == nullptr) {
+		data = new series_data();
+		block->series[series].store(data, std::memory_order_release);
+	}
+
+	increment(data->buckets[bucketIndex(nanos)]);
+	increment(data->sumNanos, nanos);
+	increment(data->count);
+	if (status == 0)
+		return;
+
+	for (std::size_t i = 0; i < STATUS_SLOTS; i++) {
+		unsigned int code = data->statusCodes[i].load(std::memory_order_relaxed);
+		if (code == status) {
+			increment(data->statusCounts[i]);
+			return;
+		}
+		if (code == 0) {
+			//Count published before code, so a reader that sees the code never misses its first hit
+			increment(data->statusCounts[i]);
+			data->statusCodes[i].store(status, std::memory_order_release);
+			return;
+		}
+	}
+	increment(data->otherStatusCount);
+}
+
+APIMetrics::snapshot APIMetrics::read(std::size_t series) const {
+	snapshot merged;
+	std::vector<std::pair<unsigned int, std::uint64_t>> statuses;
+	std::uint64_t otherStatuses = 0;
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (const std::unique_ptr<thread_block> & block : threadBlocks) {
+		const series_data *data = block->series[series].load(std::memory_order_acquire);
+		if (data == nullptr)
+			continue;
+
+		merged.count += data->count.load(std::memory_order_relaxed);
+		merged.sumNanos += data->sumNanos.load(std::memory_order_relaxed);
+		for (std::size_t i = 0; i < BUCKETS; i++)
+			merged.buckets[i] += data->buckets[i].load(std::memory_order_relaxed);
+
+		for (std::size_t i = 0; i < STATUS_SLOTS; i++) {
+			unsigned int code = data->statusCodes[i].load(std::memory_order_acquire);
+			if (code == 0)
+				break;
+			std::uint64_t hits = data->statusCounts[i].load(std::memory_order_relaxed);
+
+			auto known = std::find_if(statuses.begin(), statuses.end(), [code](const auto & entry) { return entry.first == code; });
+			if (known != statuses.end())
+				known->second += hits;
+			else
+				statuses.emplace_back(code, hits);
+		}
+		otherStatuses += data->otherStatusCount.load(std::memory_order_relaxed);
+	}
+
+	std::sort(statuses.begin(), statuses.end());
+	if (otherStatuses > 0)
+		statuses.emplace_back(0, otherStatuses);
+	merged.statusCounts = statuses;
+	return merged;
+}
+
+std::string APIMetrics::toPrometheus() const {
+	std::vector<series_labels> labels;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		labels = seriesLabels;
+	}
+	std::vector<snapshot> snapshots;
+	for (std::size_t series = 0; series < labels.size(); series++)
+		snapshots.push_back(read(series));
+
+	//Samples of a metric family must be contiguous: one pass per family and per kind of metric
+	std::vector<std::string> families;
+	for (const series_labels & current : labels)
+		if (std::find(families.begin(), families.end(), current.family) == families.end())
+			families.push_back(current.family);
+
+	std::ostringstream text;
+	text << std::setprecision(9);
+	for (const std::string & family : families) {
+		text << "# TYPE " << family << "_seconds histogram\n";
+		for (std::size_t series = 0; series < labels.size(); series++) {
+			if (labels[series].family != family)
+				continue;
+			const snapshot &data = snapshots[series];
+
+			//Prometheus buckets at every power of 2 from ~1us to ~34s, cumulative (HDR buckets align with them)
+			std::uint64_t cumulative = 0;
+			std::size_t index = 0;
+			for (unsigned int exponent = 10; exponent <= 35; exponent++) {
+				for (; index < BUCKETS and bucketUpperBound(index) <= (1ULL << exponent); index++)
+					cumulative += data.buckets[index];
+				text << family << "_seconds_bucket{" << labels[series].labels << ",le=\"" << (double) (1ULL << exponent) / 1e9 << "\"} " << cumulative << "\n";
+			}
+			text << family << "_seconds_bucket{" << labels[series].labels << ",le=\"+Inf\"} " << data.count << "\n";
+			text << family << "_seconds_sum{" << labels[series].labels << "} " << data.sumNanos / 1e9 << "\n";
+			text << family << "_seconds_count{" << labels[series].labels << "} " << data.count << "\n";
+		}
+
+		text << "# TYPE " << family << "_quantile_seconds gauge\n";
+		for (std::size_t series = 0; series < labels.size(); series++) {
+			if (labels[series].family != family)
+				continue;
+			for (double quantile : {0.5, 0.9, 0.99, 0.999})
+				text << family << "_quantile_seconds{" << labels[series].labels << ",quantile=\"" << quantile << "\"} " \
+					<< snapshots[series].percentileNanos(quantile) / 1e9 << "\n";
+		}
+
+		bool headerWritten = false;
+		for (std::size_t series = 0; series < labels.size(); series++) {
+			if (labels[series].family != family)
+				continue;
+			for (const auto & status : snapshots[series].statusCounts) {
+				if (!headerWritten) {
+					text << "# TYPE " << family << "_total counter\n";
+					headerWritten = true;
+				}
+				text << family << "_total{" << labels[series].labels << ",status=\"" \
+					<< ((status.first == 0) ? std::string("other") : std::to_string(status.first)) << "\"} " << status.second << "\n";
+			}
+		}
+	}
+	return text.str();
+}
+
+std::size_t APIMetrics::bucketIndex(std::uint64_t nanos) {
+	if (nanos < SUB_BUCKETS)
+		return nanos;
+
+	std::size_t exponent = 63 - __builtin_clzll(nanos);
+	std::size_t subBucket = (nanos >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+	std::size_t index = (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + subBucket;
+	return std::min(index, BUCKETS - 1);
+}
+
+std::uint64_t APIMetrics::bucketUpperBound(std::size_t index) {
+	if (index < SUB_BUCKETS)
+		return index + 1;
+
+	std::size_t exponent = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+	std::uint64_t width = 1ULL << (exponent - SUB_BUCKET_BITS);
+	return ((SUB_BUCKETS + index % SUB_BUCKETS) << (exponent - SUB_BUCKET_BITS)) + width;
+}
+
+double APIMetrics::snapshot::percentileNanos(double p) const {
+	if (count == 0)
+		return 0;
+
+	std::uint64_t target = (std::uint64_t) (p * count), cumulative = 0;
+	for (std::size_t i = 0; i < buckets.size(); i++) {
+		cumulative += buckets[i];
+		if (cumulative > target)
+			return (double) bucketUpperBound(i);
+	}
+	return (double) bucketUpperBound(buckets.size() - 1);
+}
+
+APIMetrics::thread_block *APIMetrics::currentThreadBlock() {
+	//One-entry cache per thread, registry is only searched when thread records for another instance
+	thread_local std::uint64_t cachedOwner = 0;
+	thread_local thread_block *cachedBlock = nullptr;
+	if (cachedOwner == instanceId)
+		return cachedBlock;
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	thread_block *&block = threadBlockById[std::this_thread::get_id()];
+	if (block == nullptr) {
+		threadBlocks.emplace_back(new thread_block());
+		block = threadBlocks.back().get();
+	}
+	cachedOwner = instanceId;
+	cachedBlock = block;
+	return block;
+}
+
+void APIMetrics::increment(std::atomic<std::uint64_t> &counter, std::uint64_t value) {
+	//Single writer per counter: plain load/store, readers only need to see a value that was there
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
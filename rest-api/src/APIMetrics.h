@@ -0,0 +1,108 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <unordered_map>
+
+
+//Latency histograms and status code counters per series (e.g. one per route and method)
+//Each thread records into its own block (single writer, relaxed atomics, no lock nor RMW instruction),
+//blocks are merged only when metrics are read. Histograms are log-linear as in HDR histograms:
+//every power of 2 of nanoseconds split into 8 buckets (12.5% precision) up to ~2^40 ns
+class APIMetrics {
+	public:
+		static const std::size_t MAX_SERIES = 128;
+		static const std::size_t SUB_BUCKET_BITS = 3;
+		static const std::size_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+		static const std::size_t BUCKETS = (40 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+		static const std::size_t STATUS_SLOTS = 8;
+
+		class snapshot {
+			public:
+				std::uint64_t count = 0;
+				std::uint64_t sumNanos = 0;
+				std::vector<std::uint64_t> buckets = std::vector<std::uint64_t>(BUCKETS, 0);
+				std::vector<std::pair<unsigned int, std::uint64_t>> statusCounts;	//Code 0 = any code beyond STATUS_SLOTS distinct ones
+
+				double percentileNanos(double p) const;
+		};
+
+		APIMetrics();
+		~APIMetrics();
+
+		//Startup only (takes a lock): family is the metric name, labels in Prometheus syntax (route="/api",method="GET")
+		std::size_t addSeries(const std::string & family, const std::string & labels);
+
+		//Hot path, lock-free (status 0 = not a request, only latency is kept)
+		void record(std::size_t series, std::uint64_t nanos, unsigned int status = 0);
+
+		snapshot read(std::size_t series) const;
+		std::string toPrometheus() const;
+
+		static std::size_t bucketIndex(std::uint64_t nanos);
+		static std::uint64_t bucketUpperBound(std::size_t index);
+
+	private:
+		class series_data {
+			public:
+				std::atomic<std::uint64_t> count;
+				std::atomic<std::uint64_t> sumNanos;
+				std::atomic<std::uint64_t> buckets[BUCKETS];
+				std::atomic<unsigned int> statusCodes[STATUS_SLOTS];
+				std::atomic<std::uint64_t> statusCounts[STATUS_SLOTS];
+				std::atomic<std::uint64_t> otherStatusCount;
+
+				series_data();
+		};
+
+		class thread_block {
+			public:
+				std::atomic<series_data *> series[MAX_SERIES];
+
+				thread_block();
+				~thread_block();
+		};
+
+		class series_labels {
+			public:
+				std::string family;
+				std::string labels;
+		};
+
+		mutable std::mutex registryMutex;
+		std::vector<series_labels> seriesLabels;
+		std::vector<std::unique_ptr<thread_block>> threadBlocks;
+		std::unordered_map<std::thread::id, thread_block *> threadBlockById;
+
+		//Identifies instance in per-thread cache (an address could be reused by a later instance)
+		static std::atomic<std::uint64_t> nextInstanceId;
+		const std::uint64_t instanceId;
+
+		thread_block *currentThreadBlock();
+		static void increment(std::atomic<std::uint64_t> & counter, std::uint64_t value = 1);
+};
+
+
+//Measures lifetime of scope into a series
+class APIMetricsTimer {
+	private:
+		APIMetrics & metrics;
+		std::size_t series;
+		std::chrono::steady_clock::time_point start;
+
+	public:
+		APIMetricsTimer(APIMetrics & metrics, std::size_t series) : metrics(metrics), series(series), start(std::chrono::steady_clock::now()) {}
+		~APIMetricsTimer() {
+			metrics.record(series, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		}
+};
@@ -0,0 +1,110 @@
+
+#include "APIRequestContext.h"
+
+
+APIRequestContext::APIRequestContext(std::chrono::steady_clock::time_point received, std::chrono::milliseconds timeout) : \
+	received(received), deadline(received + timeout), limited(timeout.count() > 0), cancellation(false), skipped(0), \
+	parent(nullptr), bodySet(false), deferred(false) {}
+
+APIRequestContext::APIRequestContext(APIRequestContext &parent, std::string_view body) : received(parent.received), deadline(parent.deadline), \
+	limited(parent.limited), cancellation(false), skipped(0), parent(&parent), body(body), bodySet(true), deferred(false) {}
+
+void APIRequestContext::setBody(std::string_view bytes) {
+	body = bytes;
+	bodySet = true;
+}
+
+void APIRequestContext::keepBody(std::string &&bytes) {
+	ownedBody = std::move(bytes);
+	setBody(ownedBody);
+}
+
+bool APIRequestContext::hasBody() const {
+	return bodySet;
+}
+
+std::string_view APIRequestContext::getBody() const {
+	return body;
+}
+
+bool APIRequestContext::hasDeadline() const {
+	return limited;
+}
+
+std::chrono::steady_clock::time_point APIRequestContext::getDeadline() const {
+	return deadline;
+}
+
+std::chrono::steady_clock::time_point APIRequestContext::getReceived() const {
+	return received;
+}
+
+std::chrono::milliseconds APIRequestContext::remaining() const {
+	if (!limited)
+		return std::chrono::milliseconds(0);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	return (now < deadline) ? std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) : std::chrono::milliseconds(0);
+}
+
+bool APIRequestContext::expired() const {
+	return limited and std::chrono::steady_clock::now() >= deadline;
+}
+
+bool APIRequestContext::cancelled() {
+	if (cancellation.load(std::memory_order_relaxed))
+		return true;
+	if (!expired() and (parent == nullptr or !parent->cancelled()))
+		return false;
+	cancel();
+	return true;
+}
+
+void APIRequestContext::cancel() {
+	//Token source is cancelled only once (one created later starts cancelled)
+	if (cancellation.exchange(true))
+		return;
+	std::lock_guard<std::mutex> lock(sourceMutex);
+	if (source)
+		source->cancel();
+}
+
+pplx::cancellation_token APIRequestContext::token() const {
+	std::lock_guard<std::mutex> lock(sourceMutex);
+	if (!source) {
+		if (parent != nullptr) {
+			pplx::cancellation_token parentToken = parent->token();
+			source.emplace(pplx::cancellation_token_source::create_linked_source(parentToken));
+		}
+		else
+			source.emplace();
+		if (cancellation.load())
+			source->cancel();
+	}
+	return source->get_token();
+}
+
+void APIRequestContext::skipWork(std::uint64_t units) {
+	if (parent != nullptr)
+		parent->skipWork(units);
+	else
+		skipped.fetch_add(units, std::memory_order_relaxed);
+}
+
+std::uint64_t APIRequestContext::skippedWork() const {
+	return skipped.load(std::memory_order_relaxed);
+}
+
+std::function<void()> APIRequestContext::deferCompletion() {
+	if (parent != nullptr or !completion)
+		return nullptr;
+	deferred = true;
+	return completion;
+}
+
+bool APIRequestContext::completionDeferred() const {
+	return deferred;
+}
+
+void APIRequestContext::setCompletion(std::function<void()> completed) {
+	completion = std::move(completed);
+}
@@ -0,0 +1,66 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <functional>
+#include <pplx/pplxtasks.h>
+
+
+//Per-request state handed to every handler: deadline (when client stops waiting for the answer) and cancellation
+//Tasks created with token() are skipped once request is cancelled; handlers doing long or repeated work check
+//cancelled() between steps and report what they gave up on through skipWork() (counted by APIController)
+//Body of request is read through the context as a view of the bytes received, so handlers never copy it to parse it
+class APIRequestContext {
+	public:
+		//timeout counts from when request was received (before any queueing); 0 = no deadline
+		APIRequestContext(std::chrono::steady_clock::time_point received, std::chrono::milliseconds timeout);
+		//Sub-request (e.g. item of a batch) with given body: deadline of parent, cancelled along with it, work skipped counted on it
+		APIRequestContext(APIRequestContext & parent, std::string_view body);
+
+		//Bytes owned by listener (valid until request is answered), or read by handler once and kept here
+		void setBody(std::string_view bytes);
+		void keepBody(std::string && bytes);
+		bool hasBody() const;
+		std::string_view getBody() const;
+
+		bool hasDeadline() const;
+		std::chrono::steady_clock::time_point getDeadline() const;
+		std::chrono::steady_clock::time_point getReceived() const;
+		std::chrono::milliseconds remaining() const;	//0 when expired (and when there is no deadline)
+
+		bool expired() const;
+		bool cancelled();	//Expired or cancelled; expiry cancels token as well
+		void cancel();
+		pplx::cancellation_token token() const;	//Token source is created on first call (most requests never need one)
+
+		void skipWork(std::uint64_t units = 1);
+		std::uint64_t skippedWork() const;
+
+		//Request is complete (leaves in-flight count and concurrency limit) when its handler returns, unless handler gives
+		//the reply from another thread (e.g. compression worker): returned function is then called there, right after replying
+		//Empty for sub-requests (their parent is complete after them) and for requests not dispatched by APIController
+		std::function<void()> deferCompletion();
+		bool completionDeferred() const;
+		void setCompletion(std::function<void()> completed);	//By dispatcher
+
+	private:
+		std::chrono::steady_clock::time_point received;
+		std::chrono::steady_clock::time_point deadline;
+		bool limited;
+		mutable std::mutex sourceMutex;
+		mutable std::optional<pplx::cancellation_token_source> source;	//Linked to token of parent, for sub-requests
+		std::atomic<bool> cancellation;
+		std::atomic<std::uint64_t> skipped;
+		APIRequestContext *parent;
+		std::string_view body;
+		std::string ownedBody;
+		bool bodySet;
+		std::function<void()> completion;
+		bool deferred;
+};
@@ -0,0 +1,161 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+
+
+//Values captured by parameter segments of a route ("/api/resource-a/{id}" captures "id")
+//Views point into the requested path, so they are valid only while that path is alive
+class APIRouteParams {
+	private:
+		std::vector<std::pair<std::string_view, std::string_view>> params;
+
+	public:
+		void add(std::string_view name, std::string_view value) { params.emplace_back(name, value); }
+		void removeLast() { params.pop_back(); }
+		bool has(std::string_view name) const { return find(name) != params.end(); }
+		std::string_view get(std::string_view name) const {
+			auto param = find(name);
+			return (param != params.end()) ? param->second : std::string_view();
+		}
+		std::size_t size() const { return params.size(); }
+
+	private:
+		std::vector<std::pair<std::string_view, std::string_view>>::const_iterator find(std::string_view name) const {
+			return std::find_if(params.begin(), params.end(), [name](const auto & param) { return param.first == name; });
+		}
+};
+
+
+//Route table organized as a trie of path segments, each node holding one handler per HTTP method
+//Lookup walks the requested path once (static segments first, parameter segment as fallback),
+//so its cost grows with path length instead of with number of routes registered
+template <typename Handler>
+class APIRouter {
+	public:
+		class match_status {
+			public:
+				enum class status { FOUND, PATH_NOT_FOUND, METHOD_NOT_ALLOWED };
+		};
+
+		class match {
+			public:
+				typename match_status::status status = match_status::status::PATH_NOT_FOUND;
+				const Handler *handler = nullptr;
+				const std::string *pattern = nullptr;	//Route as registered, e.g. "/api/resource-a/{id}"
+				APIRouteParams params;
+		};
+
+	private:
+		class node {
+			public:
+				std::vector<std::pair<std::string, std::unique_ptr<node>>> children;	//Sorted by segment (binary searched)
+				std::unique_ptr<node> paramChild;
+				std::string paramName;
+				std::vector<std::pair<std::string, Handler>> handlers;					//Per method (a handful at most)
+				std::string pattern;
+		};
+
+		node root;
+
+		static bool nextSegment(std::string_view & path, std::string_view & segment) {
+			while (!path.empty() and path.front() == '/')
+				path.remove_prefix(1);
+			if (path.empty())
+				return false;
+
+			std::size_t end = path.find('/');
+			segment = path.substr(0, end);
+			path.remove_prefix((end == std::string_view::npos) ? path.size() : end);
+			return true;
+		}
+
+		static bool isParamSegment(std::string_view segment) {
+			return (segment.size() > 2 and segment.front() == '{' and segment.back() == '}');
+		}
+
+		static const node *staticChild(const node & parent, std::string_view segment) {
+			auto child = std::lower_bound(parent.children.begin(), parent.children.end(), segment,
+				[](const auto & entry, std::string_view value) { return std::string_view(entry.first) < value; });
+			return (child != parent.children.end() and child->first == segment) ? child->second.get() : nullptr;
+		}
+
+		static const node *walk(const node & current, std::string_view path, APIRouteParams & params) {
+			std::string_view segment;
+			if (!nextSegment(path, segment))
+				return current.pattern.empty() ? nullptr : &current;
+
+			if (const node *child = staticChild(current, segment))
+				if (const node *found = walk(*child, path, params))
+					return found;
+
+			if (current.paramChild) {
+				params.add(current.paramName, segment);
+				if (const node *found = walk(*current.paramChild, path, params))
+					return found;
+				params.removeLast();
+			}
+			return nullptr;
+		}
+
+	public:
+		//Pattern segments between braces are parameters: "/api/resource-a/{id}"
+		//Throws std::runtime_error when a parameter is named differently than one already at the same position
+		void add(const std::string & method, const std::string & pattern, Handler handler) {
+			node *current = &root;
+			std::string_view path(pattern), segment;
+
+			while (nextSegment(path, segment)) {
+				if (isParamSegment(segment)) {
+					std::string_view name = segment.substr(1, segment.size() - 2);
+					if (!current->paramChild) {
+						current->paramChild.reset(new node());
+						current->paramName = std::string(name);
+					}
+					else if (current->paramName != name)
+						throw std::runtime_error("route " + pattern + ": parameter {" + std::string(name) + "} conflicts with {" + current->paramName + "}");
+					current = current->paramChild.get();
+					continue;
+				}
+
+				auto child = std::lower_bound(current->children.begin(), current->children.end(), segment,
+					[](const auto & entry, std::string_view value) { return std::string_view(entry.first) < value; });
+				if (child == current->children.end() or child->first != segment)
+					child = current->children.emplace(child, std::string(segment), std::unique_ptr<node>(new node()));
+				current = child->second.get();
+			}
+
+			current->pattern = pattern;
+			for (auto & entry : current->handlers) {
+				if (entry.first == method) {
+					entry.second = std::move(handler);
+					return;
+				}
+			}
+			current->handlers.emplace_back(method, std::move(handler));
+		}
+
+		match find(std::string_view method, std::string_view path) const {
+			match result;
+			const node *found = walk(root, path, result.params);
+			if (found == nullptr)
+				return result;
+
+			result.pattern = &found->pattern;
+			result.status = match_status::status::METHOD_NOT_ALLOWED;
+			for (const auto & entry : found->handlers) {
+				if (entry.first == method) {
+					result.status = match_status::status::FOUND;
+					result.handler = &entry.second;
+					break;
+				}
+			}
+			return result;
+		}
+};
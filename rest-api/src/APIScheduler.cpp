@@ -0,0 +1,19 @@
+
+#include "APIScheduler.h"
+
+
+APIScheduler::APIScheduler(std::size_t workerCount, WorkStealingPool::affinity_modes::mode affinity) : pool(workerCount, affinity) {}
+
+APIScheduler::~APIScheduler() {}
+
+void APIScheduler::schedule(pplx::TaskProc_t procedure, void *parameter) {
+	pool.submit(procedure, parameter);
+}
+
+const WorkStealingPool &APIScheduler::getPool() const {
+	return pool;
+}
+
+void APIScheduler::setActiveWorkers(std::size_t count) {
+	pool.setActiveWorkers(count);
+}
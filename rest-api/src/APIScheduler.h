@@ -0,0 +1,22 @@
+
+#pragma once
+
+#include <pplx/pplxtasks.h>
+
+#include "include/WorkStealingPool.h"
+
+
+//pplx scheduler backed by WorkStealingPool: once set as ambient scheduler, pplx tasks and
+//continuations created by the service (and by cpprest on its behalf) run on these workers
+class APIScheduler : public pplx::scheduler_interface {
+	private:
+		WorkStealingPool pool;
+
+	public:
+		APIScheduler(std::size_t workerCount, WorkStealingPool::affinity_modes::mode affinity);
+		~APIScheduler();
+
+		void schedule(pplx::TaskProc_t procedure, void *parameter) override;
+		const WorkStealingPool & getPool() const;
+		void setActiveWorkers(std::size_t count);	//See WorkStealingPool::setActiveWorkers (up to workers it was created with)
+};
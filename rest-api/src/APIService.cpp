@@ -1,74 +1,845 @@
 
 #include "APIService.h"
 
+thread_local APIService::compression_stats *APIService::routeCompression = nullptr;
+thread_local APIRequestContext *APIService::routeContext = nullptr;
 
-APIService::APIService() {}
+APIService::APIService() : liveState(std::make_shared<live_state>()), configApplied(0), configRejected(0), maxBatchSize(64) {
+	for (const web::http::method & method : {web::http::methods::GET, web::http::methods::HEAD, web::http::methods::PUT, web::http::methods::POST, \
+			web::http::methods::DEL, web::http::methods::PATCH, web::http::methods::OPTIONS, web::http::methods::TRCE, web::http::methods::CONNECT})
+		unmatchedSeries[method] = metrics.addSeries("api_request_duration", "route=\"unmatched\",method=\"" + method + "\"");
+	unmatchedOtherSeries = metrics.addSeries("api_request_duration", "route=\"unmatched\",method=\"other\"");
+	assemblyResponseSeries = metrics.addSeries("api_stage_duration", "stage=\"assemblyResponse\"");
 
-APIService::~APIService() {}
+	setCompressionConfig(compression_config());
+	addRoutes();
+}
+
+APIService::~APIService() {
+	configWatcher.reset();	//No reload while the rest is destroyed
+}
 
 void APIService::addSupportToMethodsHTTP() {
-	httpListener.support(web::http::methods::GET, std::bind(&APIService::handleGET, this, std::placeholders::_1));
-	httpListener.support(web::http::methods::PUT, std::bind(&APIService::notHandleMethod, this, std::placeholders::_1, web::http::methods::PUT));
-	httpListener.support(web::http::methods::POST, std::bind(&APIService::notHandleMethod, this, std::placeholders::_1, web::http::methods::POST));
-	httpListener.support(web::http::methods::DEL, std::bind(&APIService::notHandleMethod, this, std::placeholders::_1, web::http::methods::DEL));
-	httpListener.support(web::http::methods::PATCH, std::bind(&APIService::notHandleMethod, this, std::placeholders::_1, web::http::methods::PATCH));
-	httpListener.support(web::http::methods::HEAD, std::bind(&APIService::notHandleMethod, this, std::placeholders::_1, web::http::methods::HEAD));
-	httpListener.support(web::http::methods::OPTIONS, std::bind(&APIService::notHandleMethod, this, std::placeholders::_1, web::http::methods::OPTIONS));
-	httpListener.support(web::http::methods::TRCE, std::bind(&APIService::notHandleMethod, this, std::placeholders::_1, web::http::methods::TRCE));
-	httpListener.support(web::http::methods::CONNECT, std::bind(&APIService::notHandleMethod, this, std::placeholders::_1, web::http::methods::CONNECT));
-}
-
-void APIService::handleGET(web::http::http_request message) {
-	std::string path = extractMessagePath(message);
-	Logger::getLogger()->log("GET for path <" + path + ">");
+	supportMethod(web::http::methods::GET, std::bind(&APIService::handleGET, this, std::placeholders::_1, std::placeholders::_2));
+	supportMethod(web::http::methods::PUT, std::bind(&APIService::handlePUT, this, std::placeholders::_1, std::placeholders::_2));
+	supportMethod(web::http::methods::POST, std::bind(&APIService::handlePOST, this, std::placeholders::_1, std::placeholders::_2));
+	supportMethod(web::http::methods::DEL, std::bind(&APIService::handleDELETE, this, std::placeholders::_1, std::placeholders::_2));
+	supportMethod(web::http::methods::PATCH, std::bind(&APIService::handlePATCH, this, std::placeholders::_1, std::placeholders::_2));
+	supportMethod(web::http::methods::HEAD, std::bind(&APIService::notHandleMethod, this, std::placeholders::_1, std::placeholders::_2, web::http::methods::HEAD));
+	supportMethod(web::http::methods::OPTIONS, std::bind(&APIService::notHandleMethod, this, std::placeholders::_1, std::placeholders::_2, web::http::methods::OPTIONS));
+	supportMethod(web::http::methods::TRCE, std::bind(&APIService::notHandleMethod, this, std::placeholders::_1, std::placeholders::_2, web::http::methods::TRCE));
+	supportMethod(web::http::methods::CONNECT, std::bind(&APIService::notHandleMethod, this, std::placeholders::_1, std::placeholders::_2, web::http::methods::CONNECT));
+}
 
-	if (path == "/api") {
-		message.reply(web::http::status_codes::OK, assemblyResponse(response_codes::code::SUCCESS, "API REST for <demonstration>"));
-	}
-	else if (path == "/api/resource-a") {
+void APIService::replyDeadlineExceeded(web::http::http_request message) {
+	message.reply(web::http::status_codes::GatewayTimeout, assemblyResponse(response_codes::code::ERROR, "deadline exceeded"), "application/json");
+}
+
+void APIService::addRoutes() {
+	addRoute(web::http::methods::GET, "/api", [this](web::http::http_request message, const APIRouteParams &, APIRequestContext &) {
+		return replyCached(message, "/api", web::http::status_codes::OK, [this] {
+			return assemblyResponse(response_codes::code::SUCCESS, "API REST for <demonstration>");
+		});
+	});
+
+	addRoute(web::http::methods::GET, "/api/resource-a/subresource", [this](web::http::http_request message, const APIRouteParams &, APIRequestContext &) {
 		
 		/* handle whatever is necessary... */
 		
-		if (true)
-			message.reply(web::http::status_codes::OK, assemblyResponse(response_codes::code::SUCCESS, "Yeah! Nicely done handling GET for resourceA!"));
-		else
-			message.reply(web::http::status_codes::OK, assemblyResponse(response_codes::code::ERROR, "Oops! Handling GET for resourceA was troubling..."));
+		return replyCached(message, "/api/resource-a/subresource", web::http::status_codes::OK, [this] {
+			return assemblyResponse(response_codes::code::SUCCESS, "Yeah! Nicely done handling GET for subresource!");
+		});
+	});
+
+	addRoute(web::http::methods::GET, "/api/metrics", [this](web::http::http_request message, const APIRouteParams &, APIRequestContext &) {
+		return replyBody(message, web::http::http_response(web::http::status_codes::OK), metricsText(), "text/plain; version=0.0.4");
+	});
+
+	addResourceRoutes();
+	addBatchRoute();
+}
+
+void APIService::addResourceRoutes() {
+	//Collection: data is an object with every item by id
+	addRoute(web::http::methods::GET, "/api/resource-a", [this](web::http::http_request message, const APIRouteParams &, APIRequestContext &) {
+		std::vector<std::pair<std::string, std::shared_ptr<const ResourceStore::entry>>> items = resourceStore.list();
+		return replyResource(message, web::http::status_codes::OK, assemblyResponse(response_codes::code::SUCCESS, std::string_view(), [&items](JsonWriter & writer) {
+			writer.beginObject();
+			for (const std::pair<std::string, std::shared_ptr<const ResourceStore::entry>> & item : items)
+				writer.key(item.first).raw(item.second->value);
+			writer.endObject();
+		}), "");
+	});
+
+	//New item with generated id (returned in data and Location)
+	addRoute(web::http::methods::POST, "/api/resource-a", [this](web::http::http_request message, const APIRouteParams &, APIRequestContext & context) {
+		thread_local JsonReader body;
+		if (!parseJsonBody(message, context, body))
+			return replyResource(message, web::http::status_codes::BadRequest, assemblyResponse(response_codes::code::ERROR, "body is not valid JSON"), "");
+
+		std::string value, id;
+		JsonReader::compact(body.root(), value);
+		ResourceStore::write_result written;
+		do {
+			id = resourceStore.generateKey();
+			if (!storeWrite([&] { return resourceStore.put(id, value, [](const ResourceStore::entry * current) { return current == nullptr; }); }, written))	//Id may be taken by a PUT
+				return replyResource(message, web::http::status_codes::InternalError, assemblyResponse(response_codes::code::ERROR, "write not persisted"), "");
+		} while (written.status != ResourceStore::write_status::status::CREATED);
+		if (!persisted(written.sequence))
+			return replyResource(message, web::http::status_codes::InternalError, assemblyResponse(response_codes::code::ERROR, "write not persisted"), "");
+
+		web::http::http_response response(web::http::status_codes::Created);
+		response.headers().add(web::http::header_names::etag, written.current->etag);
+		response.headers().add(web::http::header_names::location, "/api/resource-a/" + id);
+		return replyBody(message, response, assemblyResponse(response_codes::code::SUCCESS, std::string_view(), [&id](JsonWriter & writer) {
+			writer.beginObject().member("id", id).endObject();
+		}), "application/json");
+	});
+
+	addRoute(web::http::methods::GET, "/api/resource-a/{id}", [this](web::http::http_request message, const APIRouteParams & params, APIRequestContext &) {
+		std::shared_ptr<const ResourceStore::entry> item = resourceStore.get(std::string(params.get("id")));
+		if (!item)
+			return replyResource(message, web::http::status_codes::NotFound, assemblyResponse(response_codes::code::ERROR, "resource not found"), "");
+
+		auto ifNoneMatch = message.headers().find(web::http::header_names::if_none_match);
+		if (ifNoneMatch != message.headers().end() and etagListMatches(ifNoneMatch->second, item->etag)) {
+			web::http::http_response response(web::http::status_codes::NotModified);
+			response.headers().add(web::http::header_names::etag, item->etag);
+			message.reply(response);
+			return response.status_code();
+		}
+		return replyResource(message, web::http::status_codes::OK, assemblyResponse(response_codes::code::SUCCESS, std::string_view(), [&item](JsonWriter & writer) {
+			writer.raw(item->value);
+		}), item->etag);
+	});
+
+	//Creates or replaces item (If-None-Match: * makes it create-only, If-Match replace-only at given version)
+	addRoute(web::http::methods::PUT, "/api/resource-a/{id}", [this](web::http::http_request message, const APIRouteParams & params, APIRequestContext & context) {
+		thread_local JsonReader body;
+		if (!parseJsonBody(message, context, body))
+			return replyResource(message, web::http::status_codes::BadRequest, assemblyResponse(response_codes::code::ERROR, "body is not valid JSON"), "");
+
+		std::string value;
+		JsonReader::compact(body.root(), value);
+		ResourceStore::write_result written;
+		if (!storeWrite([&] { return resourceStore.put(std::string(params.get("id")), std::move(value), preconditionOf(message)); }, written))
+			return replyResource(message, web::http::status_codes::InternalError, assemblyResponse(response_codes::code::ERROR, "write not persisted"), "");
+		if (written.status == ResourceStore::write_status::status::PRECONDITION_FAILED)
+			return replyResource(message, web::http::status_codes::PreconditionFailed, assemblyResponse(response_codes::code::ERROR, "resource changed (ETag mismatch)"), \
+				written.current ? written.current->etag : "");
+
+		if (!persisted(written.sequence))
+			return replyResource(message, web::http::status_codes::InternalError, assemblyResponse(response_codes::code::ERROR, "write not persisted"), "");
+
+		web::http::status_code status = (written.status == ResourceStore::write_status::status::CREATED) ? web::http::status_codes::Created : web::http::status_codes::OK;
+		return replyResource(message, status, assemblyResponse(response_codes::code::SUCCESS, std::string_view(), [&written](JsonWriter & writer) {
+			writer.raw(written.current->value);
+		}), written.current->etag);
+	});
+
+	//JSON merge patch: read item, merge outside any lock, then store only if item is still at version read
+	addRoute(web::http::methods::PATCH, "/api/resource-a/{id}", [this](web::http::http_request message, const APIRouteParams & params, APIRequestContext & context) {
+		thread_local JsonReader patch, stored;
+		if (!parseJsonBody(message, context, patch))
+			return replyResource(message, web::http::status_codes::BadRequest, assemblyResponse(response_codes::code::ERROR, "body is not valid JSON"), "");
+
+		std::string id(params.get("id"));
+		ResourceStore::precondition requested = preconditionOf(message);
+		for (bool retry = false; true; retry = true) {
+			//Merging again for a client that stopped waiting is wasted work
+			if (retry and context.cancelled()) {
+				context.skipWork();
+				return replyResource(message, web::http::status_codes::GatewayTimeout, assemblyResponse(response_codes::code::ERROR, "deadline exceeded"), "");
+			}
+			std::shared_ptr<const ResourceStore::entry> item = resourceStore.get(id);
+			if (!item)
+				return replyResource(message, web::http::status_codes::NotFound, assemblyResponse(response_codes::code::ERROR, "resource not found"), "");
+			if (requested and !requested(item.get()))
+				return replyResource(message, web::http::status_codes::PreconditionFailed, assemblyResponse(response_codes::code::ERROR, "resource changed (ETag mismatch)"), item->etag);
+
+			//Stored values are valid compact JSON, merged straight from their text into the new one
+			std::uint64_t version = item->version;
+			std::string merged;
+			if (!stored.parse(item->value))
+				return replyResource(message, web::http::status_codes::InternalError, assemblyResponse(response_codes::code::ERROR, "stored value is not valid JSON"), "");
+			JsonReader::mergePatch(stored.root(), patch.root(), merged);
+			ResourceStore::write_result written;
+			if (!storeWrite([&] { return resourceStore.put(id, std::move(merged), \
+					[version](const ResourceStore::entry * current) { return current != nullptr and current->version == version; }); }, written))
+				return replyResource(message, web::http::status_codes::InternalError, assemblyResponse(response_codes::code::ERROR, "write not persisted"), "");
+			if (written.status == ResourceStore::write_status::status::UPDATED and !persisted(written.sequence))
+				return replyResource(message, web::http::status_codes::InternalError, assemblyResponse(response_codes::code::ERROR, "write not persisted"), "");
+			if (written.status == ResourceStore::write_status::status::UPDATED)
+				return replyResource(message, web::http::status_codes::OK, assemblyResponse(response_codes::code::SUCCESS, std::string_view(), [&written](JsonWriter & writer) {
+					writer.raw(written.current->value);
+				}), written.current->etag);
+			//Changed (or removed) meanwhile: conditional requests fail on next check, unconditional ones merge again
+		}
+	});
+
+	addRoute(web::http::methods::DEL, "/api/resource-a/{id}", [this](web::http::http_request message, const APIRouteParams & params, APIRequestContext &) {
+		ResourceStore::write_result removed;
+		if (!storeWrite([&] { return resourceStore.remove(std::string(params.get("id")), preconditionOf(message)); }, removed))
+			return replyResource(message, web::http::status_codes::InternalError, assemblyResponse(response_codes::code::ERROR, "write not persisted"), "");
+		switch (removed.status) {
+			case ResourceStore::write_status::status::DELETED:
+				if (!persisted(removed.sequence))
+					return replyResource(message, web::http::status_codes::InternalError, assemblyResponse(response_codes::code::ERROR, "write not persisted"), "");
+				return replyResource(message, web::http::status_codes::OK, assemblyResponse(response_codes::code::SUCCESS, std::string_view(), nullptr), "");
+			case ResourceStore::write_status::status::PRECONDITION_FAILED:
+				return replyResource(message, web::http::status_codes::PreconditionFailed, assemblyResponse(response_codes::code::ERROR, "resource changed (ETag mismatch)"), \
+					removed.current ? removed.current->etag : "");
+			default:
+				return replyResource(message, web::http::status_codes::NotFound, assemblyResponse(response_codes::code::ERROR, "resource not found"), "");
+		}
+	});
+}
+
+web::http::status_code APIService::replyResource(web::http::http_request message, web::http::status_code status, const std::string &body, const std::string &etag) {
+	web::http::http_response response(status);
+	if (!etag.empty())
+		response.headers().add(web::http::header_names::etag, etag);
+	return replyBody(message, response, body, "application/json");
+}
+
+bool APIService::storeWrite(const std::function<ResourceStore::write_result()> &write, ResourceStore::write_result &result) {
+	try {
+		result = write();
+		return true;
 	}
-	else if (path == "/api/resource-a/subresource") {
-		
-		/* handle whatever is necessary... */
-		
-		message.reply(web::http::status_codes::OK, assemblyResponse(response_codes::code::SUCCESS, "Yeah! Nicely done handling GET for subresource!"));
+	catch (const std::system_error &error) {
+		Logger::getLogger()->log<Logger::message_types::type::ERROR>("Write-ahead log: {}", error.what());
+		return false;
+	}
+}
+
+bool APIService::persisted(std::uint64_t sequence) {
+	if (!durability)
+		return true;
+	try {
+		durability->waitDurable(sequence);
+		return true;
+	}
+	catch (const std::system_error &error) {
+		Logger::getLogger()->log<Logger::message_types::type::ERROR>("Write-ahead log: {}", error.what());
+		return false;
+	}
+}
+
+bool APIService::parseJsonBody(web::http::http_request message, APIRequestContext &context, JsonReader &body) {
+	//Native listeners hand the bytes they received; through cpprest, body is read from its stream once and kept by context
+	if (!context.hasBody()) {
+		try {
+			context.keepBody(message.extract_string(true).get());
+		}
+		catch (const std::exception &) {
+			return false;
+		}
 	}
+	return body.parse(context.getBody());
+}
+
+ResourceStore::precondition APIService::preconditionOf(const web::http::http_request &message) {
+	auto ifMatch = message.headers().find(web::http::header_names::if_match);
+	auto ifNoneMatch = message.headers().find(web::http::header_names::if_none_match);
+	bool hasIfMatch = (ifMatch != message.headers().end()), hasIfNoneMatch = (ifNoneMatch != message.headers().end());
+	if (!hasIfMatch and !hasIfNoneMatch)
+		return nullptr;
+
+	std::string matchList = hasIfMatch ? ifMatch->second : "", noneMatchList = hasIfNoneMatch ? ifNoneMatch->second : "";
+	return [=](const ResourceStore::entry * current) {
+		if (hasIfMatch and (current == nullptr or !etagListMatches(matchList, current->etag)))
+			return false;
+		if (hasIfNoneMatch and current != nullptr and etagListMatches(noneMatchList, current->etag))
+			return false;
+		return true;
+	};
+}
+
+bool APIService::etagListMatches(const std::string &list, const std::string &etag) {
+	//Comma-separated entity tags or "*" (any current item); weak tags (W/"...") never match strong comparison
+	std::size_t position = 0;
+	while (position < list.size()) {
+		std::size_t end = list.find(',', position);
+		if (end == std::string::npos)
+			end = list.size();
+		std::size_t first = list.find_first_not_of(" \t", position), last = list.find_last_not_of(" \t", end - 1);
+		if (first < end and last != std::string::npos and last >= first) {
+			std::string_view tag(list.data() + first, last - first + 1);
+			if (tag == "*" or tag == etag or tag == HttpCompression::etagFor(etag, HttpCompression::encodings::encoding::GZIP) \
+				or tag == HttpCompression::etagFor(etag, HttpCompression::encodings::encoding::DEFLATE))
+				return true;
+		}
+		position = end + 1;
+	}
+	return false;
+}
+
+void APIService::addBatchRoute() {
+	addRoute(web::http::methods::POST, "/api/batch", [this](web::http::http_request message, const APIRouteParams &, APIRequestContext & context) {
+		thread_local JsonReader body;
+		if (!parseJsonBody(message, context, body) or !body.root().isArray())
+			return replyResource(message, web::http::status_codes::BadRequest, assemblyResponse(response_codes::code::ERROR, "body is not a JSON array"), "");
+		std::size_t itemCount = body.root().size();
+		if (itemCount > maxBatchSize)
+			return replyResource(message, web::http::status_codes::RequestEntityTooLarge, \
+				assemblyResponse(response_codes::code::ERROR, "batch larger than " + std::to_string(maxBatchSize) + " requests"), "");
+
+		//Malformed items are answered right away (400), the others are routed; bodies of items stay views of batch body
+		std::shared_ptr<batch_state> state = std::make_shared<batch_state>();
+		std::vector<bool> valid(itemCount);
+		std::size_t index = 0;
+		for (JsonReader::value item = body.root().first(); item.valid(); item = item.next(), index++) {
+			web::http::http_request request;
+			std::string_view itemBody;
+			valid[index] = buildBatchRequest(item, request, itemBody);
+			if (valid[index]) {
+				state->requests.push_back(request);
+				state->contexts.emplace_back(context, itemBody);
+			}
+		}
+
+		//One helper task less than items (this thread takes its share), at most one per core; helpers not started yet
+		//when batch is cancelled never run (items left are answered 504 by this thread)
+		std::size_t helpers = std::min<std::size_t>(state->requests.size(), std::max(1u, std::thread::hardware_concurrency())) - (state->requests.empty() ? 0 : 1);
+		for (std::size_t i = 0; i < helpers; i++)
+			pplx::create_task([this, state] { runBatchItems(state); }, context.token());
+		runBatchItems(state);
+		{
+			std::unique_lock<std::mutex> lock(state->completedMutex);
+			state->completedCondition.wait(lock, [&state] { return state->completed == state->requests.size(); });
+		}
+
+		//Results in order of items: {"status":200,"headers":{...},"body":...}
+		JsonWriter writer;
+		writer.beginArray();
+		for (std::size_t i = 0, routed = 0; i < itemCount; i++) {
+			if (!valid[i]) {
+				writer.beginObject().member("status", 400).key("body").raw(assemblyResponse(response_codes::code::ERROR, "invalid batch item")).endObject();
+				continue;
+			}
+			writeBatchResult(writer, state->requests[routed++].get_response().get());
+		}
+		writer.endArray();
+		return replyResource(message, web::http::status_codes::OK, assemblyResponse(response_codes::code::SUCCESS, std::string_view(), [&writer](JsonWriter & data) {
+			data.raw(writer.str());
+		}), "");
+	}, false);
+}
+
+void APIService::runBatchItems(const std::shared_ptr<batch_state> &state) {
+	for (std::size_t i; (i = state->next.fetch_add(1)) < state->requests.size();) {
+		try {
+			routeRequest(state->requests[i], state->contexts[i], true);
+		}
+		catch (...) {
+			//Item must complete anyway (reply fails if handler had replied before throwing)
+			try {
+				state->requests[i].reply(web::http::status_codes::InternalError);
+			}
+			catch (...) {}
+		}
+		if (state->completed.fetch_add(1) + 1 == state->requests.size()) {
+			std::lock_guard<std::mutex> lock(state->completedMutex);
+			state->completedCondition.notify_all();
+		}
+	}
+}
+
+bool APIService::buildBatchRequest(const JsonReader::value &item, web::http::http_request &request, std::string_view &body) {
+	//{"method":"GET","path":"/api/resource-a/1","body":{...},"headers":{"If-Match":"\"3\""}} (nested batches refused when routed)
+	JsonReader::value method = item.member("method"), path = item.member("path");
+	if (!method.isString() or !path.isString())
+		return false;
+	std::string target = path.string();
+	if (target.empty() or target.front() != '/')
+		return false;
+
+	request = web::http::http_request(method.string());
+	try {
+		request.set_request_uri(web::uri(target));
+	}
+	catch (const std::exception &) {
+		return false;
+	}
+	JsonReader::value headers = item.member("headers");
+	if (headers.valid()) {
+		if (!headers.isObject())
+			return false;
+		for (JsonReader::value name = headers.first(); name.valid(); name = name.next().next()) {
+			if (!name.next().isString())
+				return false;
+			if (!boost::algorithm::iequals(name.string(), web::http::header_names::accept_encoding))
+				request.headers().add(name.string(), name.next().string());
+		}
+	}
+	JsonReader::value content = item.member("body");
+	if (content.valid() and !content.isNull()) {
+		body = content.raw();
+		request.headers().set_content_type("application/json");
+	}
+	return true;
+}
+
+void APIService::writeBatchResult(JsonWriter &writer, web::http::http_response response) {
+	writer.beginObject().member("status", response.status_code());
+
+	writer.key("headers").beginObject();
+	for (const std::string & name : {web::http::header_names::etag, web::http::header_names::location})
+		if (response.headers().has(name))
+			writer.member(name, response.headers()[name]);
+	writer.endObject();
+
+	//Bodies of this service are JSON (written as is), anything else goes as a string
+	std::string body = response.extract_string(true).get();
+	std::string contentType = response.headers().content_type();
+	writer.key("body");
+	if (body.empty())
+		writer.null();
+	else if (contentType.compare(0, 16, "application/json") == 0)
+		writer.raw(body);
 	else
-		message.reply(web::http::status_codes::NotFound, assemblyResponse(response_codes::code::ERROR, "path not found"));
+		writer.value(body);
+	writer.endObject();
+}
+
+void APIService::addRoute(const web::http::method &method, const std::string &pattern, route_handler handler, bool batchable) {
+	std::string labels = "route=\"" + pattern + "\",method=\"" + method + "\"";
+	std::size_t series = metrics.addSeries("api_request_duration", labels);
+
+	compressionStats.emplace_back(new compression_stats());
+	compressionStats.back()->labels = labels;
+	compressionStats.back()->cpuSeries = metrics.addSeries("api_compression_cpu", labels);
+	router.add(method, pattern, route_entry{handler, series, compressionStats.back().get(), routeKeys.size(), batchable});
+	routeKeys.emplace_back(method, pattern);
+}
+
+std::size_t APIService::unmatchedSeriesOf(const web::http::method &method) const {
+	//Read-only on request path: methods are whatever clients send
+	auto series = unmatchedSeries.find(method);
+	return (series != unmatchedSeries.end()) ? series->second : unmatchedOtherSeries;
+}
+
+void APIService::routeRequest(web::http::http_request message, APIRequestContext &context, bool batchItem) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	SnapshotPointer<live_state>::reader live(liveState);	//Pinned for handler (and sub-requests routed by it on this thread)
+	std::string path = extractMessagePath(message);
+	APIRouter<route_entry>::match route = router.find(message.method(), path);
+
+	std::size_t series = unmatchedSeriesOf(message.method());
+	web::http::status_code status = web::http::status_codes::NotFound;
+	switch (route.status) {
+		case APIRouter<route_entry>::match_status::status::FOUND:
+			series = route.handler->metricsSeries;
+			//Checked again here: deadline may pass while waiting for a lock or, in a batch, for earlier items
+			if (context.cancelled()) {
+				context.skipWork();
+				status = web::http::status_codes::GatewayTimeout;
+				message.reply(status, assemblyResponse(response_codes::code::ERROR, "deadline exceeded"), "application/json");
+				break;
+			}
+			//Checked on route found (not on path given), so no spelling of path gets a batch inside a batch
+			if (batchItem and !route.handler->batchable) {
+				status = web::http::status_codes::BadRequest;
+				message.reply(status, assemblyResponse(response_codes::code::ERROR, "route not allowed in a batch"), "application/json");
+				break;
+			}
+			if (route.handler->index < live->routeDisabled.size() and live->routeDisabled[route.handler->index]) {
+				status = web::http::status_codes::ServiceUnavailable;
+				message.reply(status, assemblyResponse(response_codes::code::ERROR, "route disabled"), "application/json");
+				break;
+			}
+		{
+			//Restored after: sub-requests of a batch are routed from inside the handler of the batch
+			compression_stats *outerCompression = routeCompression;
+			APIRequestContext *outerContext = routeContext;
+			routeCompression = route.handler->compression;
+			routeContext = &context;
+			status = route.handler->handler(message, route.params, context);
+			routeCompression = outerCompression;
+			routeContext = outerContext;
+			break;
+		}
+		case APIRouter<route_entry>::match_status::status::METHOD_NOT_ALLOWED:
+			status = web::http::status_codes::MethodNotAllowed;
+			message.reply(status, assemblyResponse(response_codes::code::ERROR, message.method() + " not allowed for path"), "application/json");
+			break;
+		case APIRouter<route_entry>::match_status::status::PATH_NOT_FOUND:
+			message.reply(status, assemblyResponse(response_codes::code::ERROR, "path not found"), "application/json");
+	}
+
+	metrics.record(series, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), status);
+}
+
+void APIService::handleGET(web::http::http_request message, APIRequestContext &context) {
+	if (Logger::getLogger()->enabled<Logger::message_types::type::DEBUG>())
+		Logger::getLogger()->log<Logger::message_types::type::DEBUG>("GET for path <{}>", message.request_uri().path());
+	routeRequest(message, context);
+}
+
+void APIService::handlePUT(web::http::http_request message, APIRequestContext &context) {
+	if (Logger::getLogger()->enabled<Logger::message_types::type::DEBUG>())
+		Logger::getLogger()->log<Logger::message_types::type::DEBUG>("PUT for path <{}>", message.request_uri().path());
+	routeRequest(message, context);
 }
 
-void APIService::handleHEAD(web::http::http_request message) { /* Implement when necessary */}
-void APIService::handlePUT(web::http::http_request message) { /* Implement when necessary */}
-void APIService::handlePOST(web::http::http_request message) { /* Implement when necessary */}
-void APIService::handleDELETE(web::http::http_request message) { /* Implement when necessary */}
-void APIService::handlePATCH(web::http::http_request message) { /* Implement when necessary */}
-void APIService::handleOPTIONS(web::http::http_request message) { /* Implement when necessary */}
-void APIService::handleTRACE(web::http::http_request message) { /* Implement when necessary */}
-void APIService::handleCONNECT(web::http::http_request message) { /* Implement when necessary */}
+void APIService::handlePOST(web::http::http_request message, APIRequestContext &context) {
+	if (Logger::getLogger()->enabled<Logger::message_types::type::DEBUG>())
+		Logger::getLogger()->log<Logger::message_types::type::DEBUG>("POST for path <{}>", message.request_uri().path());
+	routeRequest(message, context);
+}
+
+void APIService::handleDELETE(web::http::http_request message, APIRequestContext &context) {
+	if (Logger::getLogger()->enabled<Logger::message_types::type::DEBUG>())
+		Logger::getLogger()->log<Logger::message_types::type::DEBUG>("DELETE for path <{}>", message.request_uri().path());
+	routeRequest(message, context);
+}
+
+void APIService::handlePATCH(web::http::http_request message, APIRequestContext &context) {
+	if (Logger::getLogger()->enabled<Logger::message_types::type::DEBUG>())
+		Logger::getLogger()->log<Logger::message_types::type::DEBUG>("PATCH for path <{}>", message.request_uri().path());
+	routeRequest(message, context);
+}
+
+void APIService::handleHEAD(web::http::http_request message, APIRequestContext &context) { /* Implement when necessary */}
+void APIService::handleOPTIONS(web::http::http_request message, APIRequestContext &context) { /* Implement when necessary */}
+void APIService::handleTRACE(web::http::http_request message, APIRequestContext &context) { /* Implement when necessary */}
+void APIService::handleCONNECT(web::http::http_request message, APIRequestContext &context) { /* Implement when necessary */}
 		
-void APIService::notHandleMethod(web::http::http_request message, web::http::method & method) {
-	message.reply(web::http::status_codes::NotImplemented, assemblyResponse(response_codes::code::ERROR, method + " not implemented"));
+void APIService::notHandleMethod(web::http::http_request message, APIRequestContext &context, web::http::method & method) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	message.reply(web::http::status_codes::NotImplemented, assemblyResponse(response_codes::code::ERROR, method + " not implemented"), "application/json");
+	metrics.record(unmatchedSeriesOf(method), std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), \
+		web::http::status_codes::NotImplemented);
 }
 
-web::json::value APIService::assemblyResponse(response_codes::code rStatus, std::string rMessageOrData) {
-	web::json::value response = web::json::value::object();
-	bool isStatusSuccess = (rStatus == response_codes::code::SUCCESS);
-	
+const std::string &APIService::assemblyResponse(response_codes::code rStatus, std::string_view rMessageOrData) {
 	//Designed for:
 	//  response = { "status":"error", "message":"details about error", "data":null }
 	//  response = { "status":"success", "message":null, "data":"requested info" }
-	response["status"] = web::json::value::string( response_codes::to_string(rStatus) );
-	response["message"] = isStatusSuccess ? web::json::value::null() : web::json::value::string(rMessageOrData);
-	response["data"] = isStatusSuccess ? web::json::value::string(rMessageOrData) : web::json::value::null();
-	
-	return response;
+	if (rStatus == response_codes::code::SUCCESS)
+		return assemblyResponse(rStatus, std::string_view(), [rMessageOrData](JsonWriter & writer) { writer.value(rMessageOrData); });
+	return assemblyResponse(rStatus, rMessageOrData, nullptr);
+}
+
+const std::string &APIService::assemblyResponse(response_codes::code rStatus, std::string_view rMessage, const data_writer &rData) {
+	APIMetricsTimer timer(metrics, assemblyResponseSeries);
+	thread_local JsonWriter writer;
+	writer.reset();
+
+	//Message is null on success
+	writer.beginObject().member("status", response_codes::to_string(rStatus)).key("message");
+	if (rStatus == response_codes::code::SUCCESS)
+		writer.null();
+	else
+		writer.value(rMessage);
+
+	writer.key("data");
+	if (rData)
+		rData(writer);
+	else
+		writer.null();
+	writer.endObject();
+
+	return writer.str();
+}
+
+web::http::status_code APIService::replyCached(web::http::http_request message, const std::string &key, web::http::status_code status, const ResponseCache::body_builder &builder) {
+	SnapshotPointer<live_state>::reader live(liveState);
+	std::shared_ptr<const ResponseCache::entry> cached = responseCache.get(key, builder, live->cacheTtl);
+
+	//Precompressed variant (if any) is picked as accepted by client, each one with its own ETag
+	HttpCompression::encodings::encoding encoding = HttpCompression::encodings::encoding::IDENTITY;
+	if (!cached->gzipBody.empty()) {
+		auto acceptEncoding = message.headers().find(web::http::header_names::accept_encoding);
+		if (acceptEncoding != message.headers().end())
+			encoding = HttpCompression::negotiate(acceptEncoding->second);
+	}
+	const std::string &body = cached->bodyFor(encoding);
+	std::string etag = cached->etagFor(encoding);
+
+	web::http::http_response response(status);
+	response.headers().add(web::http::header_names::etag, etag);
+	if (!cached->gzipBody.empty())
+		response.headers().add(web::http::header_names::vary, "Accept-Encoding");
+
+	//Client already holds this body (If-None-Match may list several tags, or "*"; tag of any encoding of it matches)
+	auto ifNoneMatch = message.headers().find(web::http::header_names::if_none_match);
+	if (status == web::http::status_codes::OK and ifNoneMatch != message.headers().end() and etagListMatches(ifNoneMatch->second, cached->etag))
+		response.set_status_code(web::http::status_codes::NotModified);
+	else {
+		if (&body != &cached->body) {
+			response.headers().add(web::http::header_names::content_encoding, HttpCompression::encodings::to_string(encoding));
+			countCompressed(routeCompression, cached->body.size(), body.size());
+		}
+		response.set_body(body, "application/json");
+	}
+
+	message.reply(response);
+	return response.status_code();
+}
+
+web::http::status_code APIService::replyBody(web::http::http_request message, web::http::http_response response, const std::string &body, const std::string &contentType) {
+	HttpCompression::encodings::encoding encoding = HttpCompression::encodings::encoding::IDENTITY;
+	if (compressionConfig.minimumSize > 0 and body.size() >= compressionConfig.minimumSize) {
+		response.headers().add(web::http::header_names::vary, "Accept-Encoding");
+		auto acceptEncoding = message.headers().find(web::http::header_names::accept_encoding);
+		if (acceptEncoding != message.headers().end())
+			encoding = HttpCompression::negotiate(acceptEncoding->second);
+	}
+	if (encoding == HttpCompression::encodings::encoding::IDENTITY) {
+		response.set_body(body, contentType);
+		message.reply(response);
+		return response.status_code();
+	}
+
+	//Body is copied: the ones of assemblyResponse belong to the writer of this thread, reused by its next request
+	std::unique_ptr<compression_task> task(new compression_task{this, message, response, body, contentType, encoding, routeCompression, nullptr});
+	if (routeContext != nullptr)
+		task->completion = routeContext->deferCompletion();
+	compressionPool->submit(&APIService::compressAndReply, task.release());
+	return response.status_code();
+}
+
+void APIService::compressAndReply(void *parameter) {
+	std::unique_ptr<compression_task> task(static_cast<compression_task *>(parameter));
+	std::uint64_t start = DateTimeUtils::threadCpuNanos();
+	std::string compressed;
+	try {
+		compressed = HttpCompression::compress(task->body, task->encoding, task->service->compressionConfig.level);
+	}
+	catch (const std::runtime_error &error) {
+		Logger::getLogger()->log<Logger::message_types::type::ERROR>("Compression: {}", error.what());
+	}
+	if (task->stats != nullptr)
+		task->service->metrics.record(task->stats->cpuSeries, DateTimeUtils::threadCpuNanos() - start);
+
+	//Sent as is when compression failed or did not make it smaller
+	if (compressed.empty() or compressed.size() >= task->body.size())
+		task->response.set_body(std::move(task->body), task->contentType);
+	else {
+		countCompressed(task->stats, task->body.size(), compressed.size());
+		task->response.headers().add(web::http::header_names::content_encoding, HttpCompression::encodings::to_string(task->encoding));
+		task->response.set_body(std::move(compressed), task->contentType);
+		//Coded representation is another one of same resource: strong ETag of its own
+		web::http::http_headers &headers = task->response.headers();
+		if (headers.has(web::http::header_names::etag))
+			headers[web::http::header_names::etag] = HttpCompression::etagFor(headers[web::http::header_names::etag], task->encoding);
+	}
+	try {
+		task->message.reply(task->response);
+	}
+	catch (const std::exception &error) {
+		Logger::getLogger()->log<Logger::message_types::type::ERROR>("Compression: reply not sent ({})", error.what());
+	}
+	if (task->completion)
+		task->completion();
+}
+
+void APIService::countCompressed(compression_stats *stats, std::size_t bytesIn, std::size_t bytesOut) {
+	if (stats == nullptr)
+		return;
+	stats->bytesIn.fetch_add(bytesIn, std::memory_order_relaxed);
+	stats->bytesOut.fetch_add(bytesOut, std::memory_order_relaxed);
+}
+
+void APIService::setMaxBatchSize(std::size_t size) {
+	maxBatchSize = size;
+}
+
+void APIService::setCompressionConfig(const compression_config &config) {
+	compressionPool.reset();	//Pending replies are sent first
+	compressionConfig = config;
+	//Created with a worker per core (at least), so reloads of config can raise workerCount up to that
+	std::size_t workerCount = std::max<std::size_t>(1, config.workerCount);
+	compressionPool.reset(new WorkStealingPool(std::max<std::size_t>(workerCount, std::thread::hardware_concurrency())));
+	compressionPool->setActiveWorkers(workerCount);
+	responseCache.setCompression(config.minimumSize, config.level);
+	responseCache.invalidateAll();
+}
+
+void APIService::setConfigFile(const std::string &path) {
+	std::lock_guard<std::mutex> lock(configMutex);
+	if (!startupSettings)
+		startupSettings = currentSettings();
+	applyConfig(ServiceConfig::load(path));
+	configApplied.fetch_add(1, std::memory_order_relaxed);
+	configWatcher.reset(new FileWatcher(path, [this, path] { reloadConfig(path); }));
+}
+
+void APIService::reloadConfig(const std::string &path) {
+	std::lock_guard<std::mutex> lock(configMutex);
+	try {
+		applyConfig(ServiceConfig::load(path));
+		configApplied.fetch_add(1, std::memory_order_relaxed);
+		Logger::getLogger()->log<Logger::message_types::type::INFO>("Config reloaded from <{}>", path);
+	}
+	catch (const std::exception &error) {	//system_error included
+		configRejected.fetch_add(1, std::memory_order_relaxed);
+		Logger::getLogger()->log<Logger::message_types::type::WARNING>("Config of <{}> not applied: {}", path, error.what());
+	}
+}
+
+void APIService::applyConfig(const ServiceConfig &fileConfig) {
+	//Keys absent from file go back to their startup values (a key removed from file is undone, not kept)
+	ServiceConfig config = startupSettings ? fileConfig.over(*startupSettings) : fileConfig;
+
+	//Next snapshot built (and checked) first: nothing is applied when config is invalid
+	std::shared_ptr<live_state> next = std::make_shared<live_state>(*liveState.load());
+	if (config.cacheTtl)
+		next->cacheTtl = *config.cacheTtl;
+	if (config.disabledRoutes) {
+		next->routeDisabled.assign(routeKeys.size(), 0);
+		for (const std::string & disabled : *config.disabledRoutes) {
+			std::size_t space = disabled.find(' ');
+			std::string method = (space == std::string::npos) ? std::string() : disabled.substr(0, space);
+			std::string pattern = (space == std::string::npos) ? disabled : disabled.substr(space + 1);
+
+			bool found = false;
+			for (std::size_t i = 0; i < routeKeys.size(); i++)
+				if (routeKeys[i].second == pattern and (method.empty() or routeKeys[i].first == method)) {
+					next->routeDisabled[i] = 1;
+					found = true;
+				}
+			if (!found)
+				throw std::runtime_error("unknown route " + disabled);
+		}
+	}
+
+	if (config.logLevel)
+		Logger::getLogger()->setLevel(*config.logLevel);
+	if (config.logMaxFileSize or config.logRetainedFiles) {
+		//Set only when changed: first call starts rotation thread
+		Logger::rotation_config current = Logger::getLogger()->getRotationConfig(), rotation = current;
+		rotation.maxFileSize = config.logMaxFileSize.value_or(rotation.maxFileSize);
+		rotation.retainedFiles = config.logRetainedFiles.value_or(rotation.retainedFiles);
+		if (rotation.maxFileSize != current.maxFileSize or rotation.retainedFiles != current.retainedFiles)
+			Logger::getLogger()->setRotationConfig(rotation);
+	}
+	if (config.clientRate)
+		setClientLimits(*config.clientRate, config.clientBurst.value_or(0));
+	if (config.compressionWorkers)
+		compressionPool->setActiveWorkers(std::max<std::size_t>(1, *config.compressionWorkers));
+	if (config.schedulerWorkers) {
+		if (getScheduler())
+			getScheduler()->setActiveWorkers(std::max<std::size_t>(1, *config.schedulerWorkers));
+		else
+			Logger::getLogger()->log<Logger::message_types::type::WARNING>("Config: schedulerWorkers needs the work stealing scheduler, ignored");
+	}
+	liveState.publish(std::move(next));
+}
+
+ServiceConfig APIService::currentSettings() {
+	ServiceConfig settings;
+	Logger *logger = Logger::getLogger();
+	settings.logLevel = logger->getLevel();
+	APIController::admission_config admission = getAdmissionConfig();
+	settings.clientRate = admission.clientRate;
+	settings.clientBurst = admission.clientBurst;
+	if (getScheduler())		//Left absent otherwise, so only a file asking for it gets the warning of applyConfig
+		settings.schedulerWorkers = getScheduler()->getPool().activeWorkers();
+	settings.compressionWorkers = compressionPool->activeWorkers();
+	settings.cacheTtl = liveState.load()->cacheTtl;
+	settings.disabledRoutes = std::vector<std::string>();	//Routes are disabled by config files only
+	Logger::rotation_config rotation = logger->getRotationConfig();
+	settings.logMaxFileSize = rotation.maxFileSize;
+	settings.logRetainedFiles = rotation.retainedFiles;
+	return settings;
+}
+
+void APIService::invalidateCachedResponse(const std::string &route) {
+	responseCache.invalidate(route);
+}
+
+const ResponseCache &APIService::getResponseCache() const {
+	return responseCache;
+}
+
+const APIMetrics &APIService::getMetrics() const {
+	return metrics;
+}
+
+StoreDurability::recovery_stats APIService::setDurabilityConfig(const StoreDurability::durability_config &config) {
+	durability.reset(new StoreDurability(resourceStore, config));
+	return durability->open();
+}
+
+const ResourceStore &APIService::getResourceStore() const {
+	return resourceStore;
+}
+
+std::string APIService::metricsText() const {
+	//Prometheus text format: histograms of APIMetrics plus counters kept by other classes
+	std::ostringstream text;
+	text << metrics.toPrometheus();
+
+	APIController::admission_stats admission = getAdmissionStats();
+	text << "# TYPE api_admission_shed_total counter\n";
+	text << "api_admission_shed_total{reason=\"rate-limit\"} " << admission.rateLimited << "\n";
+	text << "api_admission_shed_total{reason=\"concurrency-limit\"} " << admission.overloaded << "\n";
+	text << "# TYPE api_admission_concurrency_limit gauge\n";
+	text << "api_admission_concurrency_limit " << admission.concurrencyLimit << "\n";
+	text << "# TYPE api_admission_in_flight gauge\n";
+	text << "api_admission_in_flight " << admission.inFlight << "\n";
+	text << "# TYPE api_admission_latency_baseline_seconds gauge\n";
+	text << "api_admission_latency_baseline_seconds " << admission.latencyBaselineNanos / 1e9 << "\n";
+
+	APIController::deadline_stats deadline = getDeadlineStats();
+	text << "# TYPE api_deadline_expired_total counter\n";
+	text << "api_deadline_expired_total{stage=\"before-dispatch\"} " << deadline.expiredBeforeDispatch << "\n";
+	text << "api_deadline_expired_total{stage=\"in-handler\"} " << deadline.cancelledInHandler << "\n";
+	text << "# TYPE api_deadline_skipped_work_total counter\n";
+	text << "api_deadline_skipped_work_total " << deadline.skippedWork << "\n";
+	text << "# TYPE api_deadline_saved_seconds_total counter\n";
+	text << "api_deadline_saved_seconds_total " << deadline.savedSeconds << "\n";
+
+	text << "# TYPE api_config_reloads_total counter\n";
+	text << "api_config_reloads_total{result=\"applied\"} " << configApplied.load(std::memory_order_relaxed) << "\n";
+	text << "api_config_reloads_total{result=\"rejected\"} " << configRejected.load(std::memory_order_relaxed) << "\n";
+
+	text << "# TYPE api_response_cache_hits_total counter\n";
+	text << "api_response_cache_hits_total " << responseCache.hits() << "\n";
+	text << "# TYPE api_response_cache_misses_total counter\n";
+	text << "api_response_cache_misses_total " << responseCache.misses() << "\n";
+
+	text << "# TYPE api_response_cache_compression_cpu_seconds_total counter\n";
+	text << "api_response_cache_compression_cpu_seconds_total " << responseCache.compressionNanos() / 1e9 << "\n";
+
+	//Ratio is of bytes before and after compression, over all compressed responses of route (cached ones included)
+	text << "# TYPE api_compression_bytes_total counter\n";
+	for (const std::unique_ptr<compression_stats> & stats : compressionStats) {
+		text << "api_compression_bytes_total{" << stats->labels << ",stage=\"in\"} " << stats->bytesIn.load(std::memory_order_relaxed) << "\n";
+		text << "api_compression_bytes_total{" << stats->labels << ",stage=\"out\"} " << stats->bytesOut.load(std::memory_order_relaxed) << "\n";
+	}
+	text << "# TYPE api_compression_ratio gauge\n";
+	for (const std::unique_ptr<compression_stats> & stats : compressionStats) {
+		std::uint64_t bytesOut = stats->bytesOut.load(std::memory_order_relaxed);
+		if (bytesOut > 0)
+			text << "api_compression_ratio{" << stats->labels << "} " << (double) stats->bytesIn.load(std::memory_order_relaxed) / bytesOut << "\n";
+	}
+
+	if (durability) {
+		text << "# TYPE store_wal_records_total counter\n";
+		text << "store_wal_records_total " << durability->loggedWrites() << "\n";
+		text << "# TYPE store_wal_fsyncs_total counter\n";
+		text << "store_wal_fsyncs_total " << durability->fsyncs() << "\n";
+		text << "# TYPE store_snapshots_total counter\n";
+		text << "store_snapshots_total " << durability->snapshots() << "\n";
+	}
+
+	Logger::async_stats logStats = Logger::getLogger()->getAsyncStats();
+	text << "# TYPE logger_dropped_records_total counter\n";
+	text << "logger_dropped_records_total{reason=\"drop-newest\"} " << logStats.droppedNewest << "\n";
+	text << "logger_dropped_records_total{reason=\"drop-oldest\"} " << logStats.droppedOldest << "\n";
+
+	Logger::rotation_stats rotationStats = Logger::getLogger()->getRotationStats();
+	text << "# TYPE logger_rotations_total counter\n";
+	text << "logger_rotations_total " << rotationStats.rotations << "\n";
+	text << "# TYPE logger_rotation_failures_total counter\n";
+	text << "logger_rotation_failures_total " << rotationStats.failures << "\n";
+	text << "# TYPE logger_removed_files_total counter\n";
+	text << "logger_removed_files_total " << rotationStats.removedFiles << "\n";
+	return text.str();
 }
 
 std::string APIService::extractMessagePath(web::http::http_request message) {
@@ -3,14 +3,83 @@
 
 #include "APIController.h"
 #include "APIMethods.h"
+#include "APIRouter.h"
+#include "ResponseCache.h"
+#include "APIMetrics.h"
+#include "ResourceStore.h"
+#include "StoreDurability.h"
+#include "ServiceConfig.h"
 #include "include/Logger.h"
+#include "include/JsonWriter.h"
+#include "include/JsonReader.h"
+#include "include/HttpCompression.h"
+#include "include/WorkStealingPool.h"
+#include "include/DateTimeUtils.h"
+#include "include/SnapshotPointer.h"
+#include "include/FileWatcher.h"
 
+#include <deque>
 #include <cpprest/http_client.h>
 
 
 class APIService : public APIController, APIMethods {
+	public:
+		class compression_config {
+			public:
+				std::size_t minimumSize = 1024;		//0 = no compression
+				int level = 6;						//zlib level (1 fastest, 9 smallest)
+				std::size_t workerCount = 2;
+		};
+
 	private:
 		std::string extractMessagePath(web::http::http_request message);
+
+		//Route handlers return the status code they replied with (recorded in metrics); long or repeated work checks context
+		typedef std::function<web::http::status_code(web::http::http_request, const APIRouteParams &, APIRequestContext &)> route_handler;
+		class compression_stats;
+		class route_entry {
+			public:
+				route_handler handler;
+				std::size_t metricsSeries;
+				compression_stats *compression;
+				std::size_t index;		//Of route in routeKeys and live_state
+				bool batchable;			//Can be an item of a batch (false for batch itself: no nesting)
+		};
+		APIRouter<route_entry> router;
+		std::vector<std::pair<web::http::method, std::string>> routeKeys;	//Method and pattern of every route, by index
+		void addRoutes();
+		void addRoute(const web::http::method & method, const std::string & pattern, route_handler handler, bool batchable = true);
+		//504 without handler once context is cancelled, 503 when route is disabled, 400 for batch items of routes not batchable
+		void routeRequest(web::http::http_request message, APIRequestContext & context, bool batchItem = false);
+
+		//Settings read by requests and changed while running (setConfigFile): requests read them through a snapshot
+		//(SnapshotPointer, no lock) that a reload replaces as a whole, so a request sees either old or new settings, never a mix
+		class live_state {
+			public:
+				std::chrono::milliseconds cacheTtl{0};	//0 = cached bodies kept until invalidated
+				std::vector<char> routeDisabled;		//By index of route (empty = none disabled)
+		};
+		SnapshotPointer<live_state> liveState;
+
+		//Config file is read again whenever it changes; reloads that fail (file unreadable or config invalid) are logged
+		//and change nothing. Log level, rate limits and worker counts are applied to their owners, the rest is live_state
+		//Keys absent from file take the values settings had before file was first applied (startupSettings)
+		std::mutex configMutex;		//One reload at a time
+		std::atomic<std::uint64_t> configApplied;
+		std::atomic<std::uint64_t> configRejected;
+		std::unique_ptr<FileWatcher> configWatcher;
+		std::optional<ServiceConfig> startupSettings;
+		void reloadConfig(const std::string & path);
+		void applyConfig(const ServiceConfig & config);	//Throws std::runtime_error (nothing applied) when config names unknown routes
+		ServiceConfig currentSettings();	//Every setting a config file can change, as its owner has it now
+
+		//Latency per route and method, counts per status code (requests not routed share "unmatched" route)
+		APIMetrics metrics;
+		std::map<web::http::method, std::size_t> unmatchedSeries;	//Filled by constructor only
+		std::size_t unmatchedOtherSeries;	//Methods not in unmatchedSeries
+		std::size_t unmatchedSeriesOf(const web::http::method & method) const;
+		std::size_t assemblyResponseSeries;
+		std::string metricsText() const;
 		
 		class response_codes {
 			public:
@@ -18,24 +87,117 @@ class APIService : public APIController, APIMethods {
 				static std::string to_string(code t);
 		};
 
-		web::json::value assemblyResponse(response_codes::code rStatus, std::string rMessageOrData);
+		//Responses are streamed by a JsonWriter kept per thread, returned body is valid until next call on same thread
+		//Payload of data can be any JSON value, written by data_writer (null when writer is empty)
+		typedef std::function<void(JsonWriter &)> data_writer;
+		const std::string & assemblyResponse(response_codes::code rStatus, std::string_view rMessageOrData);
+		const std::string & assemblyResponse(response_codes::code rStatus, std::string_view rMessage, const data_writer & rData);
+
+		//Static routes reply with bodies serialized once (see ResponseCache)
+		ResponseCache responseCache;
+		web::http::status_code replyCached(web::http::http_request message, const std::string & key, web::http::status_code status, const ResponseCache::body_builder & builder);
+
+		//Items of /api/resource-a (JSON values), written with optimistic concurrency: ETag of every item is its
+		//version, and writes carrying If-Match/If-None-Match are applied only if item still is at the version given
+		ResourceStore resourceStore;
+		std::unique_ptr<StoreDurability> durability;	//Only when configured (setDurabilityConfig)
+		//Runs a write of store, false when it could not be logged (write not applied, log failed)
+		bool storeWrite(const std::function<ResourceStore::write_result()> & write, ResourceStore::write_result & result);
+		bool persisted(std::uint64_t sequence);		//Waits until write is durable (per durability mode), false if log failed
+		void addResourceRoutes();
+		web::http::status_code replyResource(web::http::http_request message, web::http::status_code status, const std::string & body, const std::string & etag);
+		//Body read as a view of bytes received (see APIRequestContext) and parsed in place; false when it is not valid JSON
+		static bool parseJsonBody(web::http::http_request message, APIRequestContext & context, JsonReader & body);
+		static ResourceStore::precondition preconditionOf(const web::http::http_request & message);	//nullptr without conditional headers
+		//ETags of compressed representations of item (see compressAndReply) match too: same item at same version
+		static bool etagListMatches(const std::string & list, const std::string & etag);
+
+		//POST /api/batch: array of sub-requests {method, path, body?, headers?} routed as if each one had come on its own,
+		//in parallel on pplx tasks (scheduler of controller); thread handling the batch works on it too, so it never waits
+		//for helper tasks to be scheduled, only for items already being handled by them
+		std::size_t maxBatchSize;
+		class batch_state {
+			public:
+				std::vector<web::http::http_request> requests;
+				std::deque<APIRequestContext> contexts;		//One per request, children of context of batch (outlive every item routed)
+				std::atomic<std::size_t> next{0};
+				std::atomic<std::size_t> completed{0};
+				std::mutex completedMutex;
+				std::condition_variable completedCondition;
+		};
+		void addBatchRoute();
+		void runBatchItems(const std::shared_ptr<batch_state> & state);
+		//Accept-Encoding of items is dropped: their bodies are embedded in the batch reply, so they must not be compressed
+		static bool buildBatchRequest(const JsonReader::value & item, web::http::http_request & request, std::string_view & body);
+		static void writeBatchResult(JsonWriter & writer, web::http::http_response response);
+
+		//Bodies of at least minimumSize bytes are compressed as accepted by client (gzip or deflate) on a pool of workers,
+		//which also reply, so handler threads only hand bodies over. Bodies of static routes are compressed once, when cached
+		compression_config compressionConfig;
+		class compression_stats {
+			public:
+				std::string labels;
+				std::size_t cpuSeries;	//CPU time per compressed body
+				std::atomic<std::uint64_t> bytesIn{0};
+				std::atomic<std::uint64_t> bytesOut{0};
+		};
+		std::vector<std::unique_ptr<compression_stats>> compressionStats;	//One per route
+		static thread_local compression_stats *routeCompression;		//Of route being handled by this thread
+		static thread_local APIRequestContext *routeContext;			//Of request being handled by this thread
+		class compression_task {
+			public:
+				APIService *service;
+				web::http::http_request message;
+				web::http::http_response response;
+				std::string body;
+				std::string contentType;
+				HttpCompression::encodings::encoding encoding;
+				compression_stats *stats;
+				std::function<void()> completion;	//Request stays in flight until worker replied
+		};
+		std::unique_ptr<WorkStealingPool> compressionPool;	//Last member: pending replies are sent before the rest is destroyed
+		web::http::status_code replyBody(web::http::http_request message, web::http::http_response response, const std::string & body, const std::string & contentType);
+		static void compressAndReply(void *parameter);
+		static void countCompressed(compression_stats *stats, std::size_t bytesIn, std::size_t bytesOut);
 
 		//From APIMethods (whose methods are or are not handled by service)
-		void handleGET(web::http::http_request message) override;		//Only method implemented in this demo
-		void handleHEAD(web::http::http_request message) override;		//NOT Implemented (handler: notHandleMethod)
-		void handlePUT(web::http::http_request message) override;		//NOT Implemented (handler: notHandleMethod)
-		void handlePOST(web::http::http_request message) override;		//NOT Implemented (handler: notHandleMethod)
-		void handleDELETE(web::http::http_request message) override;	//NOT Implemented (handler: notHandleMethod)
-		void handlePATCH(web::http::http_request message) override;		//NOT Implemented (handler: notHandleMethod)
-		void handleOPTIONS(web::http::http_request message) override;	//NOT Implemented (handler: notHandleMethod)
-		void handleTRACE(web::http::http_request message) override;		//NOT Implemented (handler: notHandleMethod)
-		void handleCONNECT(web::http::http_request message) override;	//NOT Implemented (handler: notHandleMethod)
-		void notHandleMethod(web::http::http_request message, web::http::method & method) override;
+		void handleGET(web::http::http_request message, APIRequestContext & context) override;
+		void handleHEAD(web::http::http_request message, APIRequestContext & context) override;		//NOT Implemented (handler: notHandleMethod)
+		void handlePUT(web::http::http_request message, APIRequestContext & context) override;
+		void handlePOST(web::http::http_request message, APIRequestContext & context) override;
+		void handleDELETE(web::http::http_request message, APIRequestContext & context) override;
+		void handlePATCH(web::http::http_request message, APIRequestContext & context) override;
+		void handleOPTIONS(web::http::http_request message, APIRequestContext & context) override;	//NOT Implemented (handler: notHandleMethod)
+		void handleTRACE(web::http::http_request message, APIRequestContext & context) override;		//NOT Implemented (handler: notHandleMethod)
+		void handleCONNECT(web::http::http_request message, APIRequestContext & context) override;	//NOT Implemented (handler: notHandleMethod)
+		void notHandleMethod(web::http::http_request message, APIRequestContext & context, web::http::method & method) override;
 
 		//From APIController (connection of methods' handlers to listener)
 		void addSupportToMethodsHTTP() override;
+		void replyDeadlineExceeded(web::http::http_request message) override;	//Same JSON envelope of 504 answered by routeRequest
 
 	public:
 		APIService();
 		~APIService();
+
+		//To be called before open() (replaces pool of workers and drops cached bodies)
+		void setCompressionConfig(const compression_config & config);
+
+		//Applies config file (see ServiceConfig) and applies it again whenever it changes, without restart
+		//To be called before open() and after the settings the file may change (scheduler, admission, compression): their
+		//values then are the ones keys absent from file go back to; throws as ServiceConfig::load and std::runtime_error
+		//when first read is not a valid config
+		void setConfigFile(const std::string & path);
+
+		void setMaxBatchSize(std::size_t size);	//Larger batches are refused with 413
+
+		//Recovers resources from directory of config and logs every write from then on; throws std::system_error or
+		//std::runtime_error (corrupted snapshot). To be called once, before open()
+		StoreDurability::recovery_stats setDurabilityConfig(const StoreDurability::durability_config & config);
+
+		//To be called when payload of a cached route changes
+		void invalidateCachedResponse(const std::string & route);
+		const ResponseCache & getResponseCache() const;
+		const APIMetrics & getMetrics() const;
+		const ResourceStore & getResourceStore() const;
 };
@@ -0,0 +1,139 @@
+
+#include "ResourceStore.h"
+
+
+ResourceStore::ResourceStore(std::size_t shardCount) : lastVersion(0), lastKey(0) {
+	for (std::size_t i = 0; i < std::max<std::size_t>(1, shardCount); i++)
+		shardList.emplace_back(new shard());
+}
+
+std::shared_ptr<const ResourceStore::entry> ResourceStore::get(const std::string &key) const {
+	const shard &keyShard = shardOf(key);
+	std::shared_lock<std::shared_mutex> lock(keyShard.entriesMutex);
+	auto found = keyShard.entries.find(key);
+	return (found != keyShard.entries.end()) ? found->second : nullptr;
+}
+
+std::vector<std::pair<std::string, std::shared_ptr<const ResourceStore::entry>>> ResourceStore::list() const {
+	std::vector<std::pair<std::string, std::shared_ptr<const entry>>> listed;
+	for (const std::unique_ptr<shard> &current : shardList) {
+		std::shared_lock<std::shared_mutex> lock(current->entriesMutex);
+		listed.insert(listed.end(), current->entries.begin(), current->entries.end());
+	}
+	return listed;
+}
+
+ResourceStore::write_result ResourceStore::put(const std::string &key, std::string value, const precondition &condition) {
+	//Entry is allocated before taking the lock, its version under it (versions of a key grow in the order writes are applied)
+	std::shared_ptr<entry> built = std::make_shared<entry>();
+	built->value = std::move(value);
+
+	shard &keyShard = shardOf(key);
+	std::unique_lock<std::shared_mutex> lock(keyShard.entriesMutex);
+	auto found = keyShard.entries.find(key);
+	bool exists = (found != keyShard.entries.end());
+	if (condition and !condition(exists ? found->second.get() : nullptr))
+		return write_result{write_status::status::PRECONDITION_FAILED, exists ? found->second : nullptr};
+
+	setVersion(*built, lastVersion.fetch_add(1, std::memory_order_relaxed) + 1);
+	std::uint64_t sequence = observer ? observer(key, built.get(), built->version) : 0;
+	if (exists) {
+		found->second = built;
+		return write_result{write_status::status::UPDATED, built, sequence};
+	}
+	keyShard.entries.emplace(key, built);
+	return write_result{write_status::status::CREATED, built, sequence};
+}
+
+ResourceStore::write_result ResourceStore::remove(const std::string &key, const precondition &condition) {
+	shard &keyShard = shardOf(key);
+	std::unique_lock<std::shared_mutex> lock(keyShard.entriesMutex);
+	auto found = keyShard.entries.find(key);
+	bool exists = (found != keyShard.entries.end());
+	if (condition and !condition(exists ? found->second.get() : nullptr))
+		return write_result{write_status::status::PRECONDITION_FAILED, exists ? found->second : nullptr};
+	if (!exists)
+		return write_result{write_status::status::NOT_FOUND, nullptr};
+
+	//Removal takes a version too, so it can be ordered against stored values on recovery
+	std::uint64_t sequence = observer ? observer(key, nullptr, lastVersion.fetch_add(1, std::memory_order_relaxed) + 1) : 0;
+	std::shared_ptr<const entry> removed = std::move(found->second);
+	keyShard.entries.erase(found);
+	return write_result{write_status::status::DELETED, removed, sequence};
+}
+
+std::string ResourceStore::generateKey() {
+	return std::to_string(lastKey.fetch_add(1, std::memory_order_relaxed) + 1);
+}
+
+void ResourceStore::setWriteObserver(write_observer writeObserver) {
+	observer = writeObserver;
+}
+
+void ResourceStore::restore(const std::string &key, const std::string *value, std::uint64_t version) {
+	raiseTo(lastVersion, version);
+	if (!key.empty() and key.find_first_not_of("0123456789") == std::string::npos and key.size() < 20)
+		raiseTo(lastKey, std::stoull(key));
+
+	shard &keyShard = shardOf(key);
+	std::unique_lock<std::shared_mutex> lock(keyShard.entriesMutex);
+	auto found = keyShard.entries.find(key);
+	if (found != keyShard.entries.end() and found->second->version >= version)
+		return;
+
+	if (value == nullptr) {
+		if (found != keyShard.entries.end())
+			keyShard.entries.erase(found);
+	}
+	else if (found != keyShard.entries.end())
+		found->second = makeEntry(*value, version);
+	else
+		keyShard.entries.emplace(key, makeEntry(*value, version));
+}
+
+std::size_t ResourceStore::size() const {
+	std::size_t total = 0;
+	for (const std::unique_ptr<shard> &current : shardList) {
+		std::shared_lock<std::shared_mutex> lock(current->entriesMutex);
+		total += current->entries.size();
+	}
+	return total;
+}
+
+std::size_t ResourceStore::shards() const {
+	return shardList.size();
+}
+
+ResourceStore::shard &ResourceStore::shardOf(const std::string &key) const {
+	//High bits pick the shard, so keys within a shard still spread over all buckets of its map
+	std::uint64_t hash = std::hash<std::string>()(key) * 0x9E3779B97F4A7C15ULL;
+	return *shardList[(hash >> 32) % shardList.size()];
+}
+
+std::shared_ptr<const ResourceStore::entry> ResourceStore::makeEntry(const std::string &value, std::uint64_t version) {
+	std::shared_ptr<entry> built = std::make_shared<entry>();
+	built->value = value;
+	setVersion(*built, version);
+	return built;
+}
+
+void ResourceStore::setVersion(entry &item, std::uint64_t version) {
+	item.version = version;
+	item.etag = "\"" + std::to_string(version) + "\"";	//Fits small string buffer, no allocation
+}
+
+void ResourceStore::raiseTo(std::atomic<std::uint64_t> &counter, std::uint64_t value) {
+	std::uint64_t current = counter.load(std::memory_order_relaxed);
+	while (current < value and !counter.compare_exchange_weak(current, value, std::memory_order_relaxed));
+}
+
+std::string ResourceStore::write_status::to_string(status s) {
+	switch (s) {
+		case status::CREATED:				return "created"; break;
+		case status::UPDATED:				return "updated"; break;
+		case status::DELETED:				return "deleted"; break;
+		case status::NOT_FOUND:				return "not-found"; break;
+		case status::PRECONDITION_FAILED:	return "precondition-failed";
+	}
+	return "not-found";
+}
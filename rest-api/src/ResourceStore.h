@@ -0,0 +1,88 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <shared_mutex>
+#include <unordered_map>
+
+
+//Concurrent in-memory key-value store behind resource routes of APIService
+//Keys are spread over shards (lock striping), each one guarded by its own shared_mutex: reads of different keys
+//do not contend and only writers hitting the same shard serialize. Entries are immutable once stored (a write
+//replaces the pointer), so readers keep using the entry they got without holding any lock
+//Every write gets a new version from a store-wide counter, used as strong ETag for optimistic concurrency
+class ResourceStore {
+	public:
+		class entry {
+			public:
+				std::string value;		//Serialized JSON
+				std::uint64_t version;
+				std::string etag;		//Quoted version ("\"42\"")
+		};
+
+		class write_status {
+			public:
+				enum class status { CREATED, UPDATED, DELETED, NOT_FOUND, PRECONDITION_FAILED };
+				static std::string to_string(status s);
+		};
+
+		class write_result {
+			public:
+				write_status::status status;
+				std::shared_ptr<const entry> current;	//Entry after write (on failure, the one that made it fail, if any)
+				std::uint64_t sequence = 0;				//Returned by write observer (e.g. log record to wait for)
+		};
+
+		//Checked under lock of key's shard, right before writing; current is nullptr when key does not exist
+		typedef std::function<bool(const entry * current)> precondition;
+
+		//Called under lock of key's shard right before a write is applied (written is nullptr for removals), so writes
+		//of each key reach it in the same order they are applied; a throwing observer cancels the write
+		typedef std::function<std::uint64_t(const std::string & key, const entry * written, std::uint64_t version)> write_observer;
+
+		explicit ResourceStore(std::size_t shardCount = 64);
+
+		std::shared_ptr<const entry> get(const std::string & key) const;	//nullptr when key does not exist
+		std::vector<std::pair<std::string, std::shared_ptr<const entry>>> list() const;	//Consistent per shard, not across shards
+
+		//Creates or replaces value of key
+		write_result put(const std::string & key, std::string value, const precondition & condition = nullptr);
+		//Removes key (NOT_FOUND when it does not exist)
+		write_result remove(const std::string & key, const precondition & condition = nullptr);
+
+		std::string generateKey();	//Unique key for resources created without one (POST)
+
+		void setWriteObserver(write_observer observer);	//Before store is used concurrently
+
+		//Recovery: stores value (removes key, when value is nullptr) at given version, unless key already holds
+		//a newer one; version and key counters move past restored ones. Safe to call concurrently for different keys
+		void restore(const std::string & key, const std::string * value, std::uint64_t version);
+
+		std::size_t size() const;
+		std::size_t shards() const;
+
+	private:
+		class alignas(64) shard {
+			public:
+				mutable std::shared_mutex entriesMutex;
+				std::unordered_map<std::string, std::shared_ptr<const entry>> entries;
+		};
+
+		std::vector<std::unique_ptr<shard>> shardList;
+		std::atomic<std::uint64_t> lastVersion;
+		std::atomic<std::uint64_t> lastKey;
+		write_observer observer;
+
+		shard & shardOf(const std::string & key) const;
+		static std::shared_ptr<const entry> makeEntry(const std::string & value, std::uint64_t version);
+		static void setVersion(entry & item, std::uint64_t version);
+		static void raiseTo(std::atomic<std::uint64_t> & counter, std::uint64_t value);
+};
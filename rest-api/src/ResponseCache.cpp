@@ -0,0 +1,156 @@
+
+#include "ResponseCache.h"
+
+
+ResponseCache::ResponseCache() : hitCount(0), missCount(0), compressionMinimumSize(0), compressionLevel(Z_DEFAULT_COMPRESSION), compressionTime(0) {}
+
+void ResponseCache::setCompression(std::size_t minimumSize, int level) {
+	compressionMinimumSize = minimumSize;
+	compressionLevel = level;
+}
+
+std::shared_ptr<const ResponseCache::entry> ResponseCache::get(const std::string &key, const body_builder &builder, std::chrono::milliseconds maxAge) {
+	auto fresh = [maxAge](const std::shared_ptr<const entry> & cached) {
+		return cached and (maxAge.count() == 0 or std::chrono::steady_clock::now() - cached->builtAt < maxAge);
+	};
+	{
+		std::shared_lock<std::shared_mutex> lock(entriesMutex);
+		auto cached = entries.find(key);
+		if (cached != entries.end() and fresh(cached->second.current)) {
+			hitCount.fetch_add(1, std::memory_order_relaxed);
+			return cached->second.current;
+		}
+	}
+
+	std::shared_ptr<build> ours;
+	std::shared_future<std::shared_ptr<const entry>> result;
+	{
+		std::unique_lock<std::shared_mutex> lock(entriesMutex);
+		slot &cached = entries[key];
+		if (fresh(cached.current)) {
+			hitCount.fetch_add(1, std::memory_order_relaxed);
+			return cached.current;
+		}
+		missCount.fetch_add(1, std::memory_order_relaxed);
+		if (cached.pending)
+			result = cached.pending->result;	//Someone else is building it
+		else {
+			ours = std::make_shared<build>();
+			ours->result = ours->promise.get_future().share();
+			cached.pending = ours;
+		}
+	}
+	if (!ours)
+		return result.get();
+
+	//Built outside the lock; stored only if no invalidate()/put() dropped this build meanwhile
+	std::shared_ptr<const entry> built;
+	try {
+		built = makeEntry(builder());
+	}
+	catch (...) {
+		{
+			std::unique_lock<std::shared_mutex> lock(entriesMutex);
+			auto cached = entries.find(key);
+			if (cached != entries.end() and cached->second.pending == ours)
+				cached->second.pending.reset();
+		}
+		ours->promise.set_exception(std::current_exception());
+		throw;
+	}
+	{
+		std::unique_lock<std::shared_mutex> lock(entriesMutex);
+		auto cached = entries.find(key);
+		if (cached != entries.end() and cached->second.pending == ours) {
+			cached->second.current = built;
+			cached->second.pending.reset();
+		}
+	}
+	ours->promise.set_value(built);
+	return built;
+}
+
+void ResponseCache::put(const std::string &key, std::string body) {
+	std::shared_ptr<const entry> built = makeEntry(std::move(body));
+
+	std::unique_lock<std::shared_mutex> lock(entriesMutex);
+	slot &cached = entries[key];
+	cached.current = built;
+	cached.pending.reset();
+}
+
+void ResponseCache::invalidate(const std::string &key) {
+	std::unique_lock<std::shared_mutex> lock(entriesMutex);
+	entries.erase(key);
+}
+
+void ResponseCache::invalidateAll() {
+	std::unique_lock<std::shared_mutex> lock(entriesMutex);
+	entries.clear();
+}
+
+std::uint64_t ResponseCache::hits() const {
+	return hitCount.load(std::memory_order_relaxed);
+}
+
+std::uint64_t ResponseCache::misses() const {
+	return missCount.load(std::memory_order_relaxed);
+}
+
+std::size_t ResponseCache::size() const {
+	std::shared_lock<std::shared_mutex> lock(entriesMutex);
+	return std::count_if(entries.begin(), entries.end(), [](const auto & cached) { return cached.second.current != nullptr; });
+}
+
+std::uint64_t ResponseCache::compressionNanos() const {
+	return compressionTime.load(std::memory_order_relaxed);
+}
+
+std::shared_ptr<const ResponseCache::entry> ResponseCache::makeEntry(std::string body) {
+	//ETag is FNV-1a (64 bits) of the body
+	std::uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c : body) {
+		hash ^= c;
+		hash *= 1099511628211ULL;
+	}
+
+	static const char hexDigits[] = "0123456789abcdef";
+	std::string etag(18, '"');
+	for (int i = 0; i < 16; i++)
+		etag[16 - i] = hexDigits[(hash >> (i * 4)) & 0xF];
+
+	std::shared_ptr<entry> built = std::make_shared<entry>();
+	built->body = std::move(body);
+	built->etag = std::move(etag);
+	built->builtAt = std::chrono::steady_clock::now();
+
+	std::size_t minimumSize = compressionMinimumSize.load(std::memory_order_relaxed);
+	if (minimumSize > 0 and built->body.size() >= minimumSize) {
+		std::uint64_t start = DateTimeUtils::threadCpuNanos();
+		try {
+			built->gzipBody = HttpCompression::compress(built->body, HttpCompression::encodings::encoding::GZIP, compressionLevel);
+			built->deflateBody = HttpCompression::compress(built->body, HttpCompression::encodings::encoding::DEFLATE, compressionLevel);
+		}
+		catch (const std::runtime_error &) {
+			built->gzipBody.clear();	//Served uncompressed
+			built->deflateBody.clear();
+		}
+		compressionTime.fetch_add(DateTimeUtils::threadCpuNanos() - start, std::memory_order_relaxed);
+	}
+	return built;
+}
+
+const std::string &ResponseCache::entry::bodyFor(HttpCompression::encodings::encoding encoding) const {
+	if (encoding == HttpCompression::encodings::encoding::GZIP and !gzipBody.empty())
+		return gzipBody;
+	if (encoding == HttpCompression::encodings::encoding::DEFLATE and !deflateBody.empty())
+		return deflateBody;
+	return body;
+}
+
+std::string ResponseCache::entry::etagFor(HttpCompression::encodings::encoding encoding) const {
+	//Every representation needs its own strong validator
+	if (&bodyFor(encoding) == &body)
+		return etag;
+	return HttpCompression::etagFor(etag, encoding);
+}
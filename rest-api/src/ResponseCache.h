@@ -0,0 +1,83 @@
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <algorithm>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "include/HttpCompression.h"
+#include "include/DateTimeUtils.h"
+
+
+//Cache of serialized response bodies for routes whose payload does not change between requests
+//Entries are immutable once built: invalidation replaces them, so readers can keep using an old one safely
+class ResponseCache {
+	public:
+		class entry {
+			public:
+				std::string body;
+				std::string etag;	//Strong validator, already quoted ("\"9f0c...\"")
+				std::chrono::steady_clock::time_point builtAt;
+
+				//Precompressed variants (empty when body is below minimum size of compression), each with its own ETag
+				std::string gzipBody;
+				std::string deflateBody;
+
+				const std::string & bodyFor(HttpCompression::encodings::encoding encoding) const;	//Falls back to body
+				std::string etagFor(HttpCompression::encodings::encoding encoding) const;
+		};
+
+		typedef std::function<std::string()> body_builder;
+
+		ResponseCache();
+
+		//Bodies of at least minimumSize bytes are also stored gzip and deflate compressed, so each coding costs CPU only
+		//once per entry (0 = never). Applies to entries built from now on
+		void setCompression(std::size_t minimumSize, int level);
+
+		//Returns cached entry for key, serializing it through builder on first use (or after invalidation), or when entry is
+		//older than maxAge (0 = no limit; expired entries count as misses). One build per key at a time: concurrent misses
+		//wait for it, and a build overtaken by invalidate() or put() is returned to its callers but not cached
+		std::shared_ptr<const entry> get(const std::string & key, const body_builder & builder, std::chrono::milliseconds maxAge = std::chrono::milliseconds(0));
+		void put(const std::string & key, std::string body);
+
+		//Hooks to be called whenever payload behind a key changes
+		void invalidate(const std::string & key);
+		void invalidateAll();
+
+		std::uint64_t hits() const;
+		std::uint64_t misses() const;
+		std::size_t size() const;
+		std::uint64_t compressionNanos() const;	//CPU time spent precompressing
+
+	private:
+		class build {
+			public:
+				std::promise<std::shared_ptr<const entry>> promise;
+				std::shared_future<std::shared_ptr<const entry>> result;
+		};
+
+		class slot {
+			public:
+				std::shared_ptr<const entry> current;
+				std::shared_ptr<build> pending;	//Build in progress, dropped by invalidation so its result is not stored
+		};
+
+		mutable std::shared_mutex entriesMutex;
+		std::unordered_map<std::string, slot> entries;
+		std::atomic<std::uint64_t> hitCount;
+		std::atomic<std::uint64_t> missCount;
+		std::atomic<std::size_t> compressionMinimumSize;
+		std::atomic<int> compressionLevel;
+		std::atomic<std::uint64_t> compressionTime;
+
+		std::shared_ptr<const entry> makeEntry(std::string body);
+};
@@ -0,0 +1,130 @@
+
+#include "ServiceConfig.h"
+
+
+ServiceConfig ServiceConfig::parse(std::string_view text) {
+	JsonReader reader;
+	if (!reader.parse(text))
+		throw std::runtime_error("invalid JSON at offset " + std::to_string(reader.getErrorOffset()));
+	if (!reader.root().isObject())
+		throw std::runtime_error("config is not a JSON object");
+
+	ServiceConfig config;
+	for (JsonReader::value key = reader.root().first(); key.valid(); key = key.next().next()) {
+		JsonReader::value v = key.next();
+		std::string name = key.string();
+
+		if (name == "logLevel")
+			config.logLevel = levelOf(v);
+		else if (name == "clientRate")
+			config.clientRate = numberOf(v, name);
+		else if (name == "clientBurst")
+			config.clientBurst = numberOf(v, name);
+		else if (name == "schedulerWorkers")
+			config.schedulerWorkers = countOf(v, name);
+		else if (name == "compressionWorkers")
+			config.compressionWorkers = countOf(v, name);
+		else if (name == "cacheTtl")
+			config.cacheTtl = std::chrono::milliseconds(countOf(v, name, std::numeric_limits<std::chrono::milliseconds::rep>::max()));
+		else if (name == "logMaxFileSize")
+			config.logMaxFileSize = countOf(v, name);
+		else if (name == "logRetainedFiles")
+			config.logRetainedFiles = countOf(v, name);
+		else if (name == "disabledRoutes") {
+			if (!v.isArray())
+				throw std::runtime_error("disabledRoutes is not an array");
+			std::vector<std::string> routes;
+			for (JsonReader::value route = v.first(); route.valid(); route = route.next()) {
+				if (!route.isString())
+					throw std::runtime_error("disabledRoutes has an entry that is not a string");
+				routes.push_back(route.string());
+			}
+			config.disabledRoutes = std::move(routes);
+		}
+		else
+			throw std::runtime_error("unknown key " + name);
+	}
+	return config;
+}
+
+ServiceConfig ServiceConfig::over(const ServiceConfig &defaults) const {
+	ServiceConfig merged = *this;
+	if (!merged.logLevel)
+		merged.logLevel = defaults.logLevel;
+	if (!merged.clientRate)
+		merged.clientRate = defaults.clientRate;
+	if (!merged.clientBurst)
+		merged.clientBurst = defaults.clientBurst;
+	if (!merged.schedulerWorkers)
+		merged.schedulerWorkers = defaults.schedulerWorkers;
+	if (!merged.compressionWorkers)
+		merged.compressionWorkers = defaults.compressionWorkers;
+	if (!merged.cacheTtl)
+		merged.cacheTtl = defaults.cacheTtl;
+	if (!merged.disabledRoutes)
+		merged.disabledRoutes = defaults.disabledRoutes;
+	if (!merged.logMaxFileSize)
+		merged.logMaxFileSize = defaults.logMaxFileSize;
+	if (!merged.logRetainedFiles)
+		merged.logRetainedFiles = defaults.logRetainedFiles;
+	return merged;
+}
+
+ServiceConfig ServiceConfig::load(const std::string &path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+	std::ostringstream text;
+	text << file.rdbuf();
+	if (file.bad())
+		throw std::system_error(errno, std::generic_category(), "cannot read " + path);
+	return parse(text.str());
+}
+
+double ServiceConfig::numberOf(const JsonReader::value &v, std::string_view key) {
+	if (!v.valid() or v.type() != JsonReader::token_types::type::NUMBER)
+		throw std::runtime_error(std::string(key) + " is not a number");
+	double number = std::strtod(std::string(v.raw()).c_str(), nullptr);
+	if (!std::isfinite(number))
+		throw std::runtime_error(std::string(key) + " is out of range");
+	if (number < 0)
+		throw std::runtime_error(std::string(key) + " is negative");
+	return number;
+}
+
+std::size_t ServiceConfig::countOf(const JsonReader::value &v, std::string_view key, std::size_t maximum) {
+	//Range checked before the cast (undefined for doubles it cannot represent)
+	double number = numberOf(v, key);
+	if (number >= std::ldexp(1.0, std::numeric_limits<std::size_t>::digits) or (std::size_t) number > maximum)
+		throw std::runtime_error(std::string(key) + " is out of range");
+	if (number != std::floor(number))
+		throw std::runtime_error(std::string(key) + " is not an integer");
+	return (std::size_t) number;
+}
+
+Logger::message_types::type ServiceConfig::levelOf(const JsonReader::value &v) {
+	if (!v.isString())
+		throw std::runtime_error("logLevel is not a string");
+	std::string name = v.string();
+	for (char & c : name)
+		c = std::tolower((unsigned char) c);
+
+	Logger::message_types::type level;
+	if (name == "error")
+		level = Logger::message_types::type::ERROR;
+	else if (name == "warning" or name == "warn")
+		level = Logger::message_types::type::WARNING;
+	else if (name == "info")
+		level = Logger::message_types::type::INFO;
+	else if (name == "debug")
+		level = Logger::message_types::type::DEBUG;
+	else
+		throw std::runtime_error("unknown logLevel " + v.string());
+
+	//Accepted anyway (non-templated calls still log at it), but templated calls of that level are not in this build
+	if (Logger::message_types::verbosity(level) > LOGGER_COMPILED_LEVEL)
+		Logger::getLogger()->log<Logger::message_types::type::WARNING>( \
+			"Config: logLevel {} is above the level this build keeps (LOGGER_COMPILED_LEVEL {}), most of its records are compiled away; build with make DEBUG=1", \
+			name, LOGGER_COMPILED_LEVEL);
+	return level;
+}
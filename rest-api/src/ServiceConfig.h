@@ -0,0 +1,51 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <optional>
+#include <fstream>
+#include <sstream>
+#include <cerrno>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+#include <cctype>
+#include <stdexcept>
+#include <system_error>
+
+#include "include/JsonReader.h"
+#include "include/Logger.h"
+
+
+//Settings of a running service read from a JSON file (see APIService::setConfigFile), e.g.
+//  {"logLevel": "info", "clientRate": 100, "clientBurst": 200, "schedulerWorkers": 4, "compressionWorkers": 2,
+//   "cacheTtl": 5000, "disabledRoutes": ["DELETE /api/resource-a/{id}", "/api/batch"], "logMaxFileSize": 104857600, "logRetainedFiles": 14}
+//Every key is optional: settings absent from file go back to their values from before file was first applied
+class ServiceConfig {
+	public:
+		std::optional<Logger::message_types::type> logLevel;	//"error", "warning", "info" or "debug"
+		std::optional<double> clientRate;						//Requests per second per client address, 0 = no rate limiting
+		std::optional<double> clientBurst;						//0 = one second of rate
+		std::optional<std::size_t> schedulerWorkers;			//Up to workers of scheduler at open() (work stealing only)
+		std::optional<std::size_t> compressionWorkers;			//Up to one per core
+		std::optional<std::chrono::milliseconds> cacheTtl;		//Age after which cached bodies are rebuilt, 0 = until invalidated
+		std::optional<std::vector<std::string>> disabledRoutes;	//"METHOD /pattern" (one method) or "/pattern" (all of them)
+		std::optional<std::size_t> logMaxFileSize;				//Bytes, 0 = log rotated only when date changes
+		std::optional<std::size_t> logRetainedFiles;			//Rotated log files kept, 0 = all of them
+
+		//Throws std::runtime_error when text is not a valid config (invalid JSON, unknown key, value of wrong type)
+		static ServiceConfig parse(std::string_view text);
+		//Throws std::system_error when file cannot be read, std::runtime_error as parse
+		static ServiceConfig load(const std::string & path);
+
+		//Settings of this config, with the ones it lacks taken from defaults
+		ServiceConfig over(const ServiceConfig & defaults) const;
+
+	private:
+		static double numberOf(const JsonReader::value & v, std::string_view key);
+		static std::size_t countOf(const JsonReader::value & v, std::string_view key, std::size_t maximum = std::numeric_limits<std::size_t>::max());
+		static Logger::message_types::type levelOf(const JsonReader::value & v);
+};
@@ -0,0 +1,298 @@
+
+#include "StoreDurability.h"
+
+
+StoreDurability::StoreDurability(ResourceStore &store, const durability_config &config) : \
+	store(store), config(config), log(config.directory, config.mode, config.asyncFlushInterval), running(false), snapshotCount(0) {}
+
+StoreDurability::~StoreDurability() {
+	close();
+}
+
+StoreDurability::recovery_stats StoreDurability::open() {
+	recovery_stats stats;
+	if (config.mode == durability_modes::mode::NONE)
+		return stats;
+
+	WriteAheadLog::createDirectory(config.directory);
+	std::size_t threadCount = (config.recoveryThreads > 0) ? config.recoveryThreads : std::max(1u, std::thread::hardware_concurrency());
+
+	//Read: snapshot and every log segment are loaded and checked (CRC) in parallel, job 0 being the snapshot
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::uint64_t> segments = WriteAheadLog::listSegments(config.directory);
+	std::vector<std::vector<record>> snapshotRecords(1), segmentRecords(segments.size());
+	std::vector<WriteAheadLog::replay_stats> segmentStats(segments.size());
+	std::atomic<std::size_t> nextJob(0);
+	std::exception_ptr failure;
+	std::mutex failureMutex;
+
+	std::vector<std::thread> readers;
+	for (std::size_t t = 0; t < std::min(threadCount, segments.size() + 1); t++) {
+		readers.emplace_back([&] {
+			for (std::size_t job; (job = nextJob.fetch_add(1)) <= segments.size();) {
+				try {
+					if (job == 0) {
+						snapshotRecords[0] = readSnapshot(snapshotPath());
+						continue;
+					}
+					std::vector<record> &decoded = segmentRecords[job - 1];
+					segmentStats[job - 1] = WriteAheadLog::replaySegment(config.directory, segments[job - 1], [&decoded](std::string_view payload) {
+						decoded.emplace_back();
+						if (!decodeRecord(payload, decoded.back()))
+							decoded.pop_back();
+					});
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(failureMutex);
+					failure = std::current_exception();
+				}
+			}
+		});
+	}
+	for (std::thread &reader : readers)
+		reader.join();
+	if (failure)
+		std::rethrow_exception(failure);
+	stats.readTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+	//Apply: snapshot first (any order, keys are unique), then log with each key's records kept in log order
+	start = std::chrono::steady_clock::now();
+	applyInParallel(threadCount, snapshotRecords, false);
+	applyInParallel(threadCount, segmentRecords, true);
+	stats.applyTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+
+	stats.snapshotEntries = snapshotRecords[0].size();
+	stats.walSegments = segments.size();
+	for (std::size_t i = 0; i < segments.size(); i++) {
+		stats.walRecords += segmentRecords[i].size();
+		stats.discardedBytes += segmentStats[i].discardedBytes;
+	}
+	Logger::getLogger()->log<Logger::message_types::type::INFO>( \
+		"Recovery ({}): {} snapshot entries, {} log records in {} segments ({} bytes discarded), read {} ms, apply {} ms", \
+		durability_modes::to_string(config.mode), stats.snapshotEntries, stats.walRecords, stats.walSegments, stats.discardedBytes, \
+		stats.readTime.count(), stats.applyTime.count());
+
+	log.open();
+	store.setWriteObserver([this](const std::string &key, const ResourceStore::entry *written, std::uint64_t version) {
+		thread_local std::string payload;
+		payload.clear();
+		encodeRecord(payload, key, written, version);
+		return log.append(payload);
+	});
+
+	running = true;
+	if (config.snapshotInterval.count() > 0)
+		snapshotter = std::thread(&StoreDurability::snapshotLoop, this);
+	return stats;
+}
+
+void StoreDurability::close() {
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		if (!running)
+			return;
+		running = false;
+	}
+	stopCondition.notify_all();
+	if (snapshotter.joinable())
+		snapshotter.join();
+
+	//Store is expected to be idle by now (listeners closed)
+	store.setWriteObserver(nullptr);
+	log.close();
+}
+
+void StoreDurability::waitDurable(std::uint64_t sequence) {
+	log.waitDurable(sequence);
+}
+
+void StoreDurability::snapshot() {
+	if (config.mode == durability_modes::mode::NONE)
+		return;
+	std::lock_guard<std::mutex> lock(snapshotMutex);
+
+	//Writes applied before rotation are in older segments and already visible to list(); later ones may or may
+	//not be in snapshot, which is fine since replaying them again is skipped by version
+	std::uint64_t firstKept = log.rotate();
+	writeSnapshot(snapshotPath(), store.list());
+	WriteAheadLog::syncDirectory(config.directory);
+	log.removeSegmentsBefore(firstKept);
+	snapshotCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+StoreDurability::durability_modes::mode StoreDurability::getMode() const {
+	return config.mode;
+}
+
+std::uint64_t StoreDurability::snapshots() const {
+	return snapshotCount.load(std::memory_order_relaxed);
+}
+
+std::uint64_t StoreDurability::loggedWrites() const {
+	return log.appendedRecords();
+}
+
+std::uint64_t StoreDurability::fsyncs() const {
+	return log.fsyncs();
+}
+
+void StoreDurability::snapshotLoop() {
+	std::unique_lock<std::mutex> lock(stateMutex);
+	while (!stopCondition.wait_for(lock, config.snapshotInterval, [this] { return !running; })) {
+		lock.unlock();
+		try {
+			snapshot();
+		}
+		catch (const std::exception &error) {
+			Logger::getLogger()->log<Logger::message_types::type::ERROR>("Snapshot failed: {}", error.what());
+		}
+		lock.lock();
+	}
+}
+
+void StoreDurability::applyInParallel(std::size_t threadCount, const std::vector<std::vector<record>> &batches, bool partitionByKey) {
+	std::vector<std::thread> appliers;
+	for (std::size_t t = 0; t < threadCount; t++) {
+		appliers.emplace_back([&, t] {
+			std::size_t index = 0;
+			for (const std::vector<record> &batch : batches)
+				for (const record &current : batch) {
+					std::size_t owner = partitionByKey ? std::hash<std::string>()(current.key) : index++;
+					if (owner % threadCount == t)
+						store.restore(current.key, current.removed ? nullptr : &current.value, current.version);
+				}
+		});
+	}
+	for (std::thread &applier : appliers)
+		applier.join();
+}
+
+std::string StoreDurability::snapshotPath() const {
+	return config.directory + "/snapshot.bin";
+}
+
+void StoreDurability::encodeRecord(std::string &output, const std::string &key, const ResourceStore::entry *written, std::uint64_t version) {
+	std::uint32_t keyLength = static_cast<std::uint32_t>(key.size());
+	output += (written == nullptr) ? '\1' : '\0';
+	output.append(reinterpret_cast<const char *>(&version), sizeof(version));
+	output.append(reinterpret_cast<const char *>(&keyLength), sizeof(keyLength));
+	output += key;
+	if (written != nullptr)
+		output += written->value;
+}
+
+bool StoreDurability::decodeRecord(std::string_view payload, record &decoded) {
+	std::uint32_t keyLength;
+	if (payload.size() < 13)
+		return false;
+	std::memcpy(&decoded.version, payload.data() + 1, sizeof(decoded.version));
+	std::memcpy(&keyLength, payload.data() + 9, sizeof(keyLength));
+	if (payload.size() - 13 < keyLength)
+		return false;
+
+	decoded.removed = (payload[0] != '\0');
+	decoded.key.assign(payload.data() + 13, keyLength);
+	decoded.value.assign(payload.data() + 13 + keyLength, payload.size() - 13 - keyLength);
+	return true;
+}
+
+void StoreDurability::writeSnapshot(const std::string &path, const std::vector<std::pair<std::string, std::shared_ptr<const ResourceStore::entry>>> &entries) {
+	std::size_t size = SNAPSHOT_MAGIC_LENGTH + 8 + 4;
+	for (const std::pair<std::string, std::shared_ptr<const ResourceStore::entry>> &item : entries)
+		size += 16 + item.first.size() + item.second->value.size();
+
+	//Written into a mapping of a temporary file, which replaces the snapshot only once it is complete and synced
+	std::string temporary = path + ".tmp";
+	int file = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (file < 0)
+		throw std::system_error(errno, std::generic_category(), "cannot create " + temporary);
+	if (ftruncate(file, size) != 0) {
+		int truncateError = errno;
+		::close(file);
+		throw std::system_error(truncateError, std::generic_category(), "cannot size " + temporary);
+	}
+	void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (mapping == MAP_FAILED) {
+		int mapError = errno;
+		::close(file);
+		throw std::system_error(mapError, std::generic_category(), "cannot map " + temporary);
+	}
+
+	char *out = static_cast<char *>(mapping);
+	std::uint64_t count = entries.size();
+	std::memcpy(out, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LENGTH);
+	std::memcpy(out + 8, &count, sizeof(count));
+	out += 16;
+	for (const std::pair<std::string, std::shared_ptr<const ResourceStore::entry>> &item : entries) {
+		std::uint32_t lengths[2] = {static_cast<std::uint32_t>(item.first.size()), static_cast<std::uint32_t>(item.second->value.size())};
+		std::memcpy(out, &item.second->version, 8);
+		std::memcpy(out + 8, lengths, sizeof(lengths));
+		std::memcpy(out + 16, item.first.data(), lengths[0]);
+		std::memcpy(out + 16 + lengths[0], item.second->value.data(), lengths[1]);
+		out += 16 + lengths[0] + lengths[1];
+	}
+	std::uint32_t crc = WriteAheadLog::crc32(mapping, size - 4);
+	std::memcpy(out, &crc, sizeof(crc));
+
+	int syncError = (msync(mapping, size, MS_SYNC) != 0 or fsync(file) != 0) ? errno : 0;
+	munmap(mapping, size);
+	::close(file);
+	if (syncError != 0)
+		throw std::system_error(syncError, std::generic_category(), "cannot sync " + temporary);
+	if (rename(temporary.c_str(), path.c_str()) != 0)
+		throw std::system_error(errno, std::generic_category(), "cannot replace " + path);
+}
+
+std::vector<StoreDurability::record> StoreDurability::readSnapshot(const std::string &path) {
+	std::vector<record> entries;
+	int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0) {
+		if (errno == ENOENT)
+			return entries;	//No snapshot taken yet
+		throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+	}
+	struct stat status;
+	if (fstat(file, &status) != 0 or status.st_size < 20) {
+		::close(file);
+		throw std::runtime_error("corrupted snapshot " + path + " (truncated)");
+	}
+	std::size_t size = status.st_size;
+	void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (mapping == MAP_FAILED)
+		throw std::system_error(errno, std::generic_category(), "cannot map " + path);
+
+	const char *data = static_cast<const char *>(mapping);
+	std::uint32_t crc;
+	std::uint64_t count;
+	std::memcpy(&crc, data + size - 4, sizeof(crc));
+	std::memcpy(&count, data + 8, sizeof(count));
+	bool valid = (std::memcmp(data, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_LENGTH) == 0 and WriteAheadLog::crc32(data, size - 4) == crc);
+
+	std::size_t position = 16;
+	for (std::uint64_t i = 0; valid and i < count; i++) {
+		std::uint32_t lengths[2];
+		if (size - 4 - position < 16) {
+			valid = false;
+			break;
+		}
+		entries.emplace_back();
+		record &item = entries.back();
+		std::memcpy(&item.version, data + position, 8);
+		std::memcpy(lengths, data + position + 8, sizeof(lengths));
+		position += 16;
+		if (size - 4 - position < (std::size_t) lengths[0] + lengths[1]) {
+			valid = false;
+			break;
+		}
+		item.key.assign(data + position, lengths[0]);
+		item.value.assign(data + position + lengths[0], lengths[1]);
+		item.removed = false;
+		position += lengths[0] + lengths[1];
+	}
+	munmap(mapping, size);
+
+	if (!valid)
+		throw std::runtime_error("corrupted snapshot " + path);
+	return entries;
+}
@@ -0,0 +1,103 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <exception>
+#include <condition_variable>
+#include <sys/mman.h>
+
+#include "ResourceStore.h"
+#include "include/WriteAheadLog.h"
+#include "include/Logger.h"
+
+
+//Durability of a ResourceStore: every write is appended to a write-ahead log (under the lock of its key, see
+//ResourceStore::write_observer) and, from time to time, the whole store is written to a snapshot so older log
+//segments can be dropped. On open, snapshot and log tail are read back into the store
+//Files inside directory: snapshot.bin plus wal-<id>.log segments (see WriteAheadLog)
+class StoreDurability {
+	public:
+		typedef WriteAheadLog::durability_modes durability_modes;
+
+		class durability_config {
+			public:
+				durability_modes::mode mode = durability_modes::mode::NONE;
+				std::string directory = "data";
+				std::chrono::seconds snapshotInterval{60};		//0 = only on demand (snapshot())
+				std::chrono::milliseconds asyncFlushInterval{10};
+				std::size_t recoveryThreads = 0;				//0 = one per core
+		};
+
+		class recovery_stats {
+			public:
+				std::uint64_t snapshotEntries = 0;
+				std::size_t walSegments = 0;
+				std::uint64_t walRecords = 0;
+				std::uint64_t discardedBytes = 0;	//Torn log tails
+				std::chrono::milliseconds readTime{0};
+				std::chrono::milliseconds applyTime{0};
+		};
+
+		StoreDurability(ResourceStore & store, const durability_config & config);
+		~StoreDurability();	//Closes
+
+		//Recovers store from directory and starts logging its writes; throws std::system_error (I/O) or
+		//std::runtime_error (corrupted snapshot). Nothing is done when mode is NONE
+		recovery_stats open();
+		void close();	//Stops snapshot thread, log is flushed
+
+		//To be called with write_result::sequence of a store write before acknowledging it
+		void waitDurable(std::uint64_t sequence);
+
+		void snapshot();	//Writes snapshot now and drops log segments it covers
+
+		durability_modes::mode getMode() const;
+		std::uint64_t snapshots() const;
+		std::uint64_t loggedWrites() const;
+		std::uint64_t fsyncs() const;
+
+	private:
+		class record {
+			public:
+				std::string key;
+				std::string value;
+				std::uint64_t version;
+				bool removed;
+		};
+
+		ResourceStore & store;
+		durability_config config;
+		WriteAheadLog log;
+
+		std::mutex snapshotMutex;			//One snapshot at a time
+		std::mutex stateMutex;
+		std::condition_variable stopCondition;
+		bool running;
+		std::thread snapshotter;
+		std::atomic<std::uint64_t> snapshotCount;
+
+		void snapshotLoop();
+		void applyInParallel(std::size_t threadCount, const std::vector<std::vector<record>> & batches, bool partitionByKey);
+		std::string snapshotPath() const;
+
+		//Log record: [removed: 1 byte][version: 8 bytes][key length: 4 bytes][key][value]
+		static void encodeRecord(std::string & output, const std::string & key, const ResourceStore::entry * written, std::uint64_t version);
+		static bool decodeRecord(std::string_view payload, record & decoded);
+
+		static constexpr const char *SNAPSHOT_MAGIC = "RSNAP001";
+		static const std::size_t SNAPSHOT_MAGIC_LENGTH = 8;
+
+		//Snapshot: [magic: 8 bytes][entries: 8 bytes] then per entry [version: 8][key length: 4][value length: 4][key][value],
+		//ending with CRC-32 of everything before it (4 bytes)
+		static void writeSnapshot(const std::string & path, const std::vector<std::pair<std::string, std::shared_ptr<const ResourceStore::entry>>> & entries);
+		static std::vector<record> readSnapshot(const std::string & path);
+};
@@ -0,0 +1,144 @@
+
+#include "BinaryLogFormat.h"
+
+
+std::size_t BinaryLogFormat::encodeTemplate(char *buffer, std::size_t size, std::uint32_t templateId, std::string_view pattern) {
+	std::size_t length = std::min(pattern.size(), size - HEADER_SIZE);
+	std::memcpy(buffer + HEADER_SIZE, pattern.data(), length);
+	writeHeader(buffer, header{(std::uint32_t) (HEADER_SIZE + length), record_kinds::kind::TEMPLATE, 0, 0, 0, templateId});
+	return HEADER_SIZE + length;
+}
+
+void BinaryLogFormat::writeHeader(char *buffer, const header &h) {
+	std::memcpy(buffer, &h.size, 4);
+	buffer[4] = (char) h.kind;
+	buffer[5] = (char) h.level;
+	std::memcpy(buffer + 6, &h.argumentCount, 2);
+	std::memcpy(buffer + 8, &h.timestamp, 8);
+	std::memcpy(buffer + 16, &h.templateId, 4);
+}
+
+bool BinaryLogFormat::readHeader(const char *data, std::size_t size, header &h) {
+	if (size < HEADER_SIZE)
+		return false;
+	std::memcpy(&h.size, data, 4);
+	h.kind = (record_kinds::kind) data[4];
+	h.level = (std::uint8_t) data[5];
+	std::memcpy(&h.argumentCount, data + 6, 2);
+	std::memcpy(&h.timestamp, data + 8, 8);
+	std::memcpy(&h.templateId, data + 16, 4);
+	return (h.size >= HEADER_SIZE and h.size <= size and h.kind <= record_kinds::kind::TEMPLATE);
+}
+
+std::size_t BinaryLogFormat::validLength(const char *data, std::size_t size) {
+	std::size_t length = 0;
+	header h;
+	while (readHeader(data + length, size - length, h))
+		length += h.size;
+	return length;
+}
+
+bool BinaryLogFormat::readFile(const char *path, std::string &content) {
+	gzFile file = gzopen(path, "rb");	//Reads plain files as they are
+	if (file == nullptr)
+		return false;
+	char buffer[1 << 16];
+	int length;
+	while ((length = gzread(file, buffer, sizeof(buffer))) > 0)
+		content.append(buffer, length);
+	bool failed = (length < 0);
+	gzclose(file);
+	return !failed;
+}
+
+std::size_t BinaryLogFormat::render(const header &h, const char *payload, std::string_view pattern, char *buffer, std::size_t size) {
+	//Each argument formatted by LogFormat on its own, so numbers come out exactly as in text mode
+	const char *payloadEnd = payload + (h.size - HEADER_SIZE);
+	std::size_t length = 0;
+	for (std::uint16_t i = 0; i < h.argumentCount and payload < payloadEnd; i++) {
+		std::size_t placeholder = pattern.find("{}");
+		if (placeholder == std::string_view::npos)
+			break;
+		length += LogFormat::format(buffer + length, size - length, pattern.substr(0, placeholder));
+		pattern.remove_prefix(placeholder + 2);
+
+		argument_types::type type = (argument_types::type) *payload++;
+		std::size_t fixedSize = (type == argument_types::type::BOOL or type == argument_types::type::CHAR) ? 1 : 8;
+		if (type == argument_types::type::STRING) {
+			std::uint32_t textLength = 0;
+			if (payloadEnd - payload >= 4)
+				std::memcpy(&textLength, payload, 4);
+			payload += 4;
+			textLength = std::min<std::size_t>(textLength, std::max<std::ptrdiff_t>(0, payloadEnd - payload));
+			length += LogFormat::format(buffer + length, size - length, std::string_view(payload, textLength));
+			payload += textLength;
+			continue;
+		}
+		if ((std::size_t) (payloadEnd - payload) < fixedSize)
+			break;
+
+		std::int64_t integer;
+		std::uint64_t unsignedInteger;
+		double floating;
+		switch (type) {
+			case argument_types::type::INT:
+				std::memcpy(&integer, payload, 8);
+				length += LogFormat::format(buffer + length, size - length, "{}", integer);
+				break;
+			case argument_types::type::UINT:
+				std::memcpy(&unsignedInteger, payload, 8);
+				length += LogFormat::format(buffer + length, size - length, "{}", unsignedInteger);
+				break;
+			case argument_types::type::DOUBLE:
+				std::memcpy(&floating, payload, 8);
+				length += LogFormat::format(buffer + length, size - length, "{}", floating);
+				break;
+			case argument_types::type::FLOAT:
+				std::memcpy(&floating, payload, 8);
+				length += LogFormat::format(buffer + length, size - length, "{}", (float) floating);
+				break;
+			case argument_types::type::BOOL:
+				length += LogFormat::format(buffer + length, size - length, "{}", *payload != 0);
+				break;
+			case argument_types::type::CHAR:
+				length += LogFormat::format(buffer + length, size - length, "{}", *payload);
+				break;
+			case argument_types::type::STRING:
+				break;
+		}
+		payload += fixedSize;
+	}
+	return length + LogFormat::format(buffer + length, size - length, pattern);
+}
+
+void BinaryLogFormat::encodeString(char *&out, char *end, std::uint16_t &count, std::string_view text) {
+	if ((std::size_t) (end - out) < 5)
+		return;
+	std::uint32_t length = std::min<std::size_t>(text.size(), end - out - 5);
+	*out++ = (char) argument_types::type::STRING;
+	std::memcpy(out, &length, 4);
+	std::memcpy(out + 4, text.data(), length);
+	out += 4 + length;
+	count++;
+}
+
+std::string BinaryLogFormat::record_kinds::to_string(kind k) {
+	switch (k) {
+		case kind::MESSAGE:		return "message"; break;
+		case kind::TEMPLATE:	return "template";
+	}
+	return "message";
+}
+
+std::string BinaryLogFormat::argument_types::to_string(type t) {
+	switch (t) {
+		case type::INT:		return "int"; break;
+		case type::UINT:	return "uint"; break;
+		case type::DOUBLE:	return "double"; break;
+		case type::FLOAT:	return "float"; break;
+		case type::BOOL:	return "bool"; break;
+		case type::CHAR:	return "char"; break;
+		case type::STRING:	return "string";
+	}
+	return "string";
+}
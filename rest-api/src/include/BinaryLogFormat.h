@@ -0,0 +1,104 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include <zlib.h>
+
+#include "LogFormat.h"
+
+
+//Binary encoding of log records: producers copy arguments as they are (no text formatting), logdecode renders them later
+//File: MAGIC, then records. Record: fixed header (HEADER_SIZE bytes, numbers in host byte order) followed by its payload
+//  [size: u32, whole record][kind: u8][level: u8][argument count: u16][timestamp: u64, ns since epoch][template id: u32]
+//Payload of MESSAGE: arguments, each one a type byte plus its bytes (8 for numbers, 1 for bool/char, u32 length + bytes for
+//strings); payload of TEMPLATE: pattern ("{}" placeholders as in LogFormat) that later MESSAGE records refer to by id
+class BinaryLogFormat {
+	public:
+		class record_kinds {
+			public:
+				enum class kind : std::uint8_t { MESSAGE, TEMPLATE };
+				static std::string to_string(kind k);
+		};
+
+		class argument_types {
+			public:
+				enum class type : std::uint8_t { INT, UINT, DOUBLE, FLOAT, BOOL, CHAR, STRING };
+				static std::string to_string(type t);
+		};
+
+		class header {
+			public:
+				std::uint32_t size;
+				record_kinds::kind kind;
+				std::uint8_t level;
+				std::uint16_t argumentCount;
+				std::uint64_t timestamp;
+				std::uint32_t templateId;
+		};
+
+		static const std::size_t MAGIC_SIZE = 8;
+		static constexpr const char *MAGIC = "RESTBLG1";
+		static const std::size_t HEADER_SIZE = 20;
+
+		//Record of a message into buffer, returns its size (arguments that do not fit are left out, strings truncated)
+		template <typename... Args>
+		static std::size_t encode(char *buffer, std::size_t size, std::uint8_t level, std::uint32_t templateId, std::uint64_t timestamp, const Args &... args) {
+			char *out = buffer + HEADER_SIZE;
+			std::uint16_t count = 0;
+			(encodeArgument(out, buffer + size, count, args), ...);
+			writeHeader(buffer, header{(std::uint32_t) (out - buffer), record_kinds::kind::MESSAGE, level, count, timestamp, templateId});
+			return out - buffer;
+		}
+		static std::size_t encodeTemplate(char *buffer, std::size_t size, std::uint32_t templateId, std::string_view pattern);
+
+		//False when data does not start with a complete record (end of file, or the zeroed tail of a file left mapped)
+		static bool readHeader(const char *data, std::size_t size, header & h);
+		//Bytes of records complete from start of data (which starts past MAGIC)
+		static std::size_t validLength(const char *data, std::size_t size);
+		//Message of record rendered into buffer as LogFormat would have formatted it, returns its length (truncated at size)
+		static std::size_t render(const header & h, const char *payload, std::string_view pattern, char *buffer, std::size_t size);
+
+		//Whole file appended to content, gzip compressed (rotated logs, preserved rings) or plain; false when not readable
+		static bool readFile(const char *path, std::string & content);
+
+	private:
+		static void writeHeader(char *buffer, const header & h);
+
+		template <typename T>
+		static void encodeArgument(char *& out, char *end, std::uint16_t & count, const T & argument) {
+			if constexpr (std::is_same<T, bool>::value)
+				encodeFixed(out, end, count, argument_types::type::BOOL, (std::uint8_t) argument);
+			else if constexpr (std::is_same<T, char>::value)
+				encodeFixed(out, end, count, argument_types::type::CHAR, argument);
+			else if constexpr (std::is_integral<T>::value and std::is_signed<T>::value)
+				encodeFixed(out, end, count, argument_types::type::INT, (std::int64_t) argument);
+			else if constexpr (std::is_integral<T>::value)
+				encodeFixed(out, end, count, argument_types::type::UINT, (std::uint64_t) argument);
+			else if constexpr (std::is_same<T, float>::value)
+				encodeFixed(out, end, count, argument_types::type::FLOAT, (double) argument);	//Rendered back as float
+			else if constexpr (std::is_floating_point<T>::value)
+				encodeFixed(out, end, count, argument_types::type::DOUBLE, (double) argument);
+			else if constexpr (std::is_enum<T>::value)
+				encodeArgument(out, end, count, static_cast<typename std::underlying_type<T>::type>(argument));
+			else
+				encodeString(out, end, count, std::string_view(argument));
+		}
+
+		template <typename T>
+		static void encodeFixed(char *& out, char *end, std::uint16_t & count, argument_types::type type, T value) {
+			if ((std::size_t) (end - out) < 1 + sizeof(T))
+				return;
+			*out++ = (char) type;
+			std::memcpy(out, &value, sizeof(T));
+			out += sizeof(T);
+			count++;
+		}
+
+		static void encodeString(char *& out, char *end, std::uint16_t & count, std::string_view text);
+};
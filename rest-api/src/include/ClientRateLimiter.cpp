@@ -0,0 +1,105 @@
+
+#include "ClientRateLimiter.h"
+
+
+ClientRateLimiter::ClientRateLimiter(double rate, double burst, std::size_t slotCount) : \
+	limits(packLimits(rate, burst)), epoch(std::chrono::steady_clock::now()), limitedCount(0) {
+	std::size_t size = 1;
+	while (size < slotCount)
+		size <<= 1;
+	slots.reset(new slot[size]);
+	slotMask = size - 1;
+}
+
+bool ClientRateLimiter::tryAcquire(std::string_view client) {
+	std::uint64_t limit = limits.load(std::memory_order_relaxed);
+	if ((limit >> TOKEN_BITS) == 0)
+		return true;
+
+	std::uint64_t key = std::hash<std::string_view>()(client);
+	key = (key != 0) ? key : 1;
+	std::uint64_t now = nowMillis();
+	slot &bucket = slotOf(key, now, limit);
+
+	std::uint64_t state = bucket.state.load(std::memory_order_relaxed);
+	while (true) {
+		std::uint64_t current = refill(state, now, limit);
+		if ((current & TOKEN_MASK) < 1000) {
+			limitedCount.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		if (bucket.state.compare_exchange_weak(state, current - 1000, std::memory_order_relaxed))
+			return true;
+	}
+}
+
+void ClientRateLimiter::setLimits(double rate, double burst) {
+	limits.store(packLimits(rate, burst), std::memory_order_relaxed);
+}
+
+bool ClientRateLimiter::enabled() const {
+	return (limits.load(std::memory_order_relaxed) >> TOKEN_BITS) != 0;
+}
+
+double ClientRateLimiter::getRate() const {
+	return (limits.load(std::memory_order_relaxed) >> TOKEN_BITS) / 1000.0;
+}
+
+std::uint64_t ClientRateLimiter::limited() const {
+	return limitedCount.load(std::memory_order_relaxed);
+}
+
+std::chrono::seconds ClientRateLimiter::retryAfter() const {
+	double rate = getRate();
+	return std::chrono::seconds((rate >= 1 or rate <= 0) ? 1 : (long long) (1 / rate + 0.999));
+}
+
+ClientRateLimiter::slot &ClientRateLimiter::slotOf(std::uint64_t key, std::uint64_t now, std::uint64_t limit) {
+	std::size_t home = key & slotMask;
+	for (std::size_t probe = 0; probe < PROBES; probe++) {
+		slot &candidate = slots[(home + probe) & slotMask];
+		std::uint64_t owner = candidate.key.load(std::memory_order_relaxed);
+		while (true) {
+			if (owner == key)
+				return candidate;
+			//Free, or owner's bucket is full again (it would start over as a new client anyway)
+			bool claimable = (owner == 0) or ((refill(candidate.state.load(std::memory_order_relaxed), now, limit) & TOKEN_MASK) >= (limit & TOKEN_MASK));
+			if (!claimable)
+				break;
+			if (candidate.key.compare_exchange_weak(owner, key, std::memory_order_relaxed))
+				return candidate;
+		}
+	}
+	return slots[home];
+}
+
+std::uint64_t ClientRateLimiter::refill(std::uint64_t state, std::uint64_t now, std::uint64_t limit) {
+	//State 0 = slot never used (nowMillis starts at 1), a full bucket
+	std::uint64_t burstMillis = limit & TOKEN_MASK;
+	if (state == 0)
+		return (now << TOKEN_BITS) | burstMillis;
+
+	std::uint64_t tokens = state & TOKEN_MASK;
+	std::uint64_t elapsed = (now - (state >> TOKEN_BITS)) & TIME_MASK;
+
+	//Thousandths of token earned per ms equal the rate per second; time only moves on when something was earned,
+	//so clients polling faster than one thousandth of token still accumulate
+	double earned = elapsed * ((limit >> TOKEN_BITS) / 1000.0);
+	if (earned < 1)
+		return state;
+	if (tokens + earned >= burstMillis)
+		return (now << TOKEN_BITS) | burstMillis;
+	return (now << TOKEN_BITS) | (tokens + (std::uint64_t) earned);
+}
+
+std::uint64_t ClientRateLimiter::packLimits(double rate, double burst) {
+	rate = std::max(0.0, rate);
+	double tokens = (burst > 0) ? burst : std::max(1.0, rate);
+	std::uint64_t rateMillis = std::min<double>(RATE_MASK, rate * 1000), burstMillis = std::min<double>(TOKEN_MASK, tokens * 1000);
+	return (rateMillis << TOKEN_BITS) | burstMillis;
+}
+
+std::uint64_t ClientRateLimiter::nowMillis() const {
+	std::uint64_t elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - epoch).count();
+	return ((elapsed + 1) & TIME_MASK) ? ((elapsed + 1) & TIME_MASK) : 1;
+}
@@ -0,0 +1,60 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+
+//Token bucket per client (e.g. remote address), lock-free: buckets live in a fixed open-addressed table of slots,
+//each one a key hash plus a packed state word updated by compare-and-swap
+//A client whose bucket is full again is indistinguishable from a new one, so its slot can be taken over by another client;
+//when every probed slot is busy, client shares the bucket of its home slot (stricter, never looser)
+class ClientRateLimiter {
+	public:
+		//rate = tokens (requests) per second per client, 0 = unlimited; burst = bucket size, 0 = one second of rate
+		ClientRateLimiter(double rate = 0, double burst = 0, std::size_t slotCount = 4096);
+
+		bool tryAcquire(std::string_view client);	//Takes one token, false when client is over its rate
+
+		//Changes rate and burst while in use (both at once: they share one atomic word); buckets keep their tokens,
+		//capped to the new burst on next refill
+		void setLimits(double rate, double burst = 0);
+
+		bool enabled() const;
+		double getRate() const;
+		std::uint64_t limited() const;				//Requests refused so far
+		std::chrono::seconds retryAfter() const;	//Time for one token (at least 1 s)
+
+	private:
+		//State: [refill time: 34 bits, ms since epoch (wraps after ~198 days)][tokens: 30 bits, in thousandths]
+		//Limits: [rate: 34 bits, thousandths of token per second (up to ~17M requests/s)][burst: 30 bits, in thousandths]
+		static const unsigned TOKEN_BITS = 30;
+		static const std::uint64_t TOKEN_MASK = (1ULL << TOKEN_BITS) - 1;
+		static const std::uint64_t TIME_MASK = (1ULL << (64 - TOKEN_BITS)) - 1;
+		static const std::uint64_t RATE_MASK = TIME_MASK;
+		static const std::size_t PROBES = 8;
+
+		class slot {
+			public:
+				std::atomic<std::uint64_t> key{0};		//Hash of client, 0 = free
+				std::atomic<std::uint64_t> state{0};
+		};
+
+		std::atomic<std::uint64_t> limits;
+		std::unique_ptr<slot[]> slots;
+		std::size_t slotMask;
+		std::chrono::steady_clock::time_point epoch;
+		std::atomic<std::uint64_t> limitedCount;
+
+		slot & slotOf(std::uint64_t key, std::uint64_t now, std::uint64_t limit);
+		//State after adding tokens earned since its time, at rate and up to burst of limit
+		static std::uint64_t refill(std::uint64_t state, std::uint64_t now, std::uint64_t limit);
+		static std::uint64_t packLimits(double rate, double burst);
+		std::uint64_t nowMillis() const;
+};
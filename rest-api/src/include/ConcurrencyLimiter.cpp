@@ -0,0 +1,98 @@
+
+#include "ConcurrencyLimiter.h"
+
+
+ConcurrencyLimiter::ConcurrencyLimiter(std::size_t initialLimit, std::size_t minimumLimit, std::size_t maximumLimit, double tolerance, std::size_t windowSize) : \
+	minimumLimit(std::max<std::size_t>(1, minimumLimit)), maximumLimit(std::max(maximumLimit, minimumLimit)), tolerance(std::max(1.0, tolerance)), \
+	windowSize(std::max<std::size_t>(1, windowSize)), active(0), shedCount(0), windowCount(0), windowPeak(0), baseline(0) {
+	currentLimit = (initialLimit == 0) ? 0 : std::min(std::max(initialLimit, this->minimumLimit), this->maximumLimit);
+}
+
+bool ConcurrencyLimiter::tryAcquire() {
+	std::size_t running = active.fetch_add(1, std::memory_order_relaxed) + 1;
+	std::size_t allowed = currentLimit.load(std::memory_order_relaxed);
+	if (allowed != 0 and running > allowed) {
+		active.fetch_sub(1, std::memory_order_relaxed);
+		shedCount.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	raiseTo(windowPeak, running);
+	return true;
+}
+
+void ConcurrencyLimiter::release(std::uint64_t latencyNanos, std::size_t route) {
+	active.fetch_sub(1, std::memory_order_relaxed);
+	if (currentLimit.load(std::memory_order_relaxed) == 0)
+		return;
+
+	route_window &window = routes[std::min(route, MAX_ROUTES - 1)];
+	window.sum.fetch_add(latencyNanos, std::memory_order_relaxed);
+	window.count.fetch_add(1, std::memory_order_relaxed);
+	if (windowCount.fetch_add(1, std::memory_order_relaxed) + 1 >= windowSize)
+		adjust();
+}
+
+void ConcurrencyLimiter::adjust() {
+	std::unique_lock<std::mutex> lock(adjustMutex, std::try_to_lock);
+	if (!lock.owns_lock())
+		return;
+	if (windowCount.load(std::memory_order_relaxed) < windowSize)
+		return;	//Closed by another thread meanwhile
+	windowCount.store(0, std::memory_order_relaxed);
+	std::size_t peak = windowPeak.exchange(0, std::memory_order_relaxed);
+
+	//Baseline of each route drifts up 1% per window so it follows lasting changes (e.g. bigger payloads), lower averages
+	//reset it; average of a window (not a single fast sample) keeps it from sinking on outliers. No drift while the limit
+	//is being pushed (above minimum): latency growing then is the queue the limit is there to catch
+	std::size_t limit = currentLimit.load(std::memory_order_relaxed);
+	bool drift = peak * 2 < limit or limit <= minimumLimit;
+	std::uint64_t count = 0;
+	double sum = 0, expected = 0;
+	for (route_window &window : routes) {
+		std::uint64_t routeCount = window.count.exchange(0, std::memory_order_relaxed);
+		std::uint64_t routeSum = window.sum.exchange(0, std::memory_order_relaxed);
+		if (routeCount == 0)
+			continue;
+		std::uint64_t average = std::max<std::uint64_t>(1, routeSum / routeCount);
+		std::uint64_t lowest = window.baseline.load(std::memory_order_relaxed);
+		lowest = (lowest == 0) ? average : std::min<std::uint64_t>(drift ? lowest + lowest / 100 + 1 : lowest, average);
+		window.baseline.store(lowest, std::memory_order_relaxed);
+		count += routeCount;
+		sum += routeSum;
+		expected += (double) lowest * routeCount;
+	}
+	if (count == 0)
+		return;
+	baseline.store((std::uint64_t) (expected / count), std::memory_order_relaxed);
+
+	if (sum > expected * tolerance)
+		limit = std::max(minimumLimit, (std::size_t) (limit * 0.9));
+	else if (peak * 2 >= limit)
+		limit = std::min(maximumLimit, limit + std::max<std::size_t>(1, (std::size_t) std::sqrt((double) limit)));
+	currentLimit.store(limit, std::memory_order_relaxed);
+}
+
+bool ConcurrencyLimiter::enabled() const {
+	return currentLimit.load(std::memory_order_relaxed) != 0;
+}
+
+std::size_t ConcurrencyLimiter::limit() const {
+	return currentLimit.load(std::memory_order_relaxed);
+}
+
+std::size_t ConcurrencyLimiter::inFlight() const {
+	return active.load(std::memory_order_relaxed);
+}
+
+std::uint64_t ConcurrencyLimiter::shed() const {
+	return shedCount.load(std::memory_order_relaxed);
+}
+
+std::uint64_t ConcurrencyLimiter::baselineNanos() const {
+	return baseline.load(std::memory_order_relaxed);
+}
+
+void ConcurrencyLimiter::raiseTo(std::atomic<std::size_t> &value, std::size_t candidate) {
+	std::size_t current = value.load(std::memory_order_relaxed);
+	while (current < candidate and !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed));
+}
@@ -0,0 +1,62 @@
+
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+
+//Limit of requests inside handlers at once, adapted to their latency (AIMD on a latency gradient):
+//every window of samples, latency of each route (e.g. method) is compared with its own baseline (lowest average of a
+//window seen for it, drifting slowly up while the limit is not pushed), weighted by its requests, so a mix of fast and
+//slow routes is compared with what that mix costs; above tolerance the limit is cut by 10% (queueing), otherwise it
+//grows by sqrt(limit) while used
+//Acquire/release are lock-free; only the thread closing a window takes a lock (try_lock, others never wait)
+class ConcurrencyLimiter {
+	public:
+		static const std::size_t MAX_ROUTES = 8;
+
+		//initialLimit 0 = unlimited (requests are only counted)
+		ConcurrencyLimiter(std::size_t initialLimit = 0, std::size_t minimumLimit = 1, std::size_t maximumLimit = 4096, \
+			double tolerance = 2.0, std::size_t windowSize = 100);
+
+		bool tryAcquire();							//False when limit is reached (request shall be shed)
+		void release(std::uint64_t latencyNanos, std::size_t route = 0);	//Once per successful tryAcquire (routes past last share it)
+
+		bool enabled() const;
+		std::size_t limit() const;
+		std::size_t inFlight() const;
+		std::uint64_t shed() const;
+		std::uint64_t baselineNanos() const;	//Baseline of last window, weighted by requests of each route
+
+	private:
+		class alignas(64) route_window {
+			public:
+				std::atomic<std::uint64_t> count{0};
+				std::atomic<std::uint64_t> sum{0};
+				std::atomic<std::uint64_t> baseline{0};		//Written only by adjust()
+		};
+
+		std::atomic<std::size_t> currentLimit;
+		std::size_t minimumLimit;
+		std::size_t maximumLimit;
+		double tolerance;
+		std::size_t windowSize;
+
+		std::atomic<std::size_t> active;
+		std::atomic<std::uint64_t> shedCount;
+
+		//Current window (approximate: samples racing with its reset may land in either window)
+		std::atomic<std::uint64_t> windowCount;
+		std::array<route_window, MAX_ROUTES> routes;
+		std::atomic<std::size_t> windowPeak;		//Most requests in flight during window
+		std::atomic<std::uint64_t> baseline;
+		std::mutex adjustMutex;
+
+		void adjust();
+		static void raiseTo(std::atomic<std::size_t> & value, std::size_t candidate);
+};
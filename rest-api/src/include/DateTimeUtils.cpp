@@ -3,26 +3,78 @@
 
 
 std::string DateTimeUtils::currentDateTime() {
-	return currentDate() + " " + currentTime();
+	//Single clock reading, so date and time never straddle a second (or day) boundary
+	boost::posix_time::ptime currLocTime = boost::posix_time::second_clock::local_time();
+	return formatDate(currLocTime) + " " + formatTime(currLocTime);
 }
 
 std::string DateTimeUtils::currentDate() {
-	boost::posix_time::ptime currLocTime = boost::posix_time::second_clock::local_time();
+	return formatDate(boost::posix_time::second_clock::local_time());
+}
+
+std::string DateTimeUtils::currentTime() {
+	char buffer[TIME_LENGTH];
+	return std::string(buffer, formatTimeInto(buffer));
+}
+
+std::size_t DateTimeUtils::formatTimeInto(char *buffer) {
+	std::memcpy(buffer, cachedTimeOfSecond(std::time(nullptr)), TIME_LENGTH);
+	return TIME_LENGTH;
+}
+
+std::size_t DateTimeUtils::formatTimeMillisInto(char *buffer) {
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	std::memcpy(buffer, cachedTimeOfSecond(now.tv_sec), TIME_LENGTH);
+
+	long millis = now.tv_nsec / 1000000;
+	buffer[8] = '.';
+	buffer[9] = (char) ('0' + millis / 100);
+	buffer[10] = (char) ('0' + (millis / 10) % 10);
+	buffer[11] = (char) ('0' + millis % 10);
+	return TIME_MILLIS_LENGTH;
+}
+
+std::uint64_t DateTimeUtils::threadCpuNanos() {
+	struct timespec now;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+const char *DateTimeUtils::cachedTimeOfSecond(std::time_t second) {
+	thread_local std::time_t cachedSecond = -1;
+	thread_local char cachedText[TIME_LENGTH];
+
+	if (second != cachedSecond) {
+		struct tm localTime;
+		localtime_r(&second, &localTime);
 
+		cachedText[0] = (char) ('0' + localTime.tm_hour / 10);
+		cachedText[1] = (char) ('0' + localTime.tm_hour % 10);
+		cachedText[2] = '.';
+		cachedText[3] = (char) ('0' + localTime.tm_min / 10);
+		cachedText[4] = (char) ('0' + localTime.tm_min % 10);
+		cachedText[5] = '.';
+		cachedText[6] = (char) ('0' + localTime.tm_sec / 10);
+		cachedText[7] = (char) ('0' + localTime.tm_sec % 10);
+		cachedSecond = second;
+	}
+	return cachedText;
+}
+
+std::string DateTimeUtils::formatDate(const boost::posix_time::ptime &time) {
 	std::ostringstream dateStream;
-	dateStream << currLocTime.date().year() << "." << currLocTime.date().month() << "." << currLocTime.date().day();
+	dateStream << time.date().year() << "." << time.date().month() << "." << time.date().day();
 
 	return dateStream.str();
 }
 
-std::string DateTimeUtils::currentTime() {
-	boost::posix_time::ptime currLocTime = boost::posix_time::second_clock::local_time();
-	
+std::string DateTimeUtils::formatTime(const boost::posix_time::ptime &time) {
 	std::ostringstream timeStream;
 	timeStream << std::setfill('0') \
-		<< std::setw(2) << currLocTime.time_of_day().hours() << "." \
-		<< std::setw(2) << currLocTime.time_of_day().minutes() << "." \
-		<< std::setw(2) << currLocTime.time_of_day().seconds();
+		<< std::setw(2) << time.time_of_day().hours() << "." \
+		<< std::setw(2) << time.time_of_day().minutes() << "." \
+		<< std::setw(2) << time.time_of_day().seconds();
 
 	return timeStream.str();
-}
\ No newline at end of file
+}
@@ -2,13 +2,32 @@
 #pragma once
 
 #include <string>
+#include <ctime>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <boost/date_time.hpp>
 
 
 class DateTimeUtils {
 	public:
+		static const std::size_t TIME_LENGTH = 8;			//"HH.MM.SS"
+		static const std::size_t TIME_MILLIS_LENGTH = 12;	//"HH.MM.SS.mmm"
+
 		static std::string currentTime();
 		static std::string currentDate();
 		static std::string currentDateTime();
-};
\ No newline at end of file
+
+		//Allocation-free versions of currentTime (no terminator written, returns number of chars written)
+		//Text of each second is formatted only once per thread and then copied from cache
+		static std::size_t formatTimeInto(char *buffer);
+		static std::size_t formatTimeMillisInto(char *buffer);
+
+		static std::uint64_t threadCpuNanos();	//CPU time consumed by calling thread
+
+	private:
+		static std::string formatDate(const boost::posix_time::ptime & time);
+		static std::string formatTime(const boost::posix_time::ptime & time);
+		static const char *cachedTimeOfSecond(std::time_t second);
+};
@@ -0,0 +1,301 @@
+
+#include "EpollListener.h"
+
+
+EpollListener::EpollListener(const std::string &host, unsigned short port, std::size_t loopCount, request_handler handler, int backlog) : \
+	EpollListener(host, port, loopCount, handler, backlog, false, std::chrono::seconds(0)) {}
+
+EpollListener::EpollListener(const std::string &host, unsigned short port, std::size_t loopCount, request_handler handler, int backlog, \
+	bool sharedSocket, std::chrono::seconds idleTimeout) : \
+	host(host), port(port), handler(handler), backlog(backlog), sharedSocket(sharedSocket), idleTimeout(idleTimeout), running(false) {
+
+	for (std::size_t i = 0; i < std::max<std::size_t>(1, loopCount); i++)
+		eventLoops.emplace_back(new event_loop());
+}
+
+EpollListener::~EpollListener() {
+	close();
+}
+
+void EpollListener::open() {
+	try {
+		for (std::unique_ptr<event_loop> & loop : eventLoops)
+			openLoop(*loop);
+	}
+	catch (std::exception &) {
+		for (std::unique_ptr<event_loop> & loop : eventLoops)
+			closeLoop(*loop);
+		throw;
+	}
+
+	running = true;
+	for (std::unique_ptr<event_loop> & loop : eventLoops)
+		threads.emplace_back(&EpollListener::runLoop, this, std::ref(*loop));
+}
+
+void EpollListener::close() {
+	if (!running.exchange(false))
+		return;
+
+	std::uint64_t wake = 1;
+	for (std::unique_ptr<event_loop> & loop : eventLoops)
+		if (write(loop->wakeDescriptor, &wake, sizeof(wake)) < 0) { }
+	for (std::thread & thread : threads)
+		thread.join();
+	threads.clear();
+
+	for (std::unique_ptr<event_loop> & loop : eventLoops)
+		closeLoop(*loop);
+}
+
+std::size_t EpollListener::loops() const {
+	return eventLoops.size();
+}
+
+std::uint64_t EpollListener::acceptedConnections() const {
+	std::uint64_t total = 0;
+	for (const std::unique_ptr<event_loop> & loop : eventLoops)
+		total += loop->accepted.load(std::memory_order_relaxed);
+	return total;
+}
+
+std::vector<std::uint64_t> EpollListener::servedRequests() const {
+	std::vector<std::uint64_t> served;
+	for (const std::unique_ptr<event_loop> & loop : eventLoops)
+		served.push_back(loop->served.load(std::memory_order_relaxed));
+	return served;
+}
+
+void EpollListener::openLoop(event_loop &loop) {
+	//Shared socket: loops after first one get their own descriptor of it (each loop closes its own)
+	if (sharedSocket and &loop != eventLoops.front().get()) {
+		loop.listenDescriptor = fcntl(eventLoops.front()->listenDescriptor, F_DUPFD_CLOEXEC, 0);
+		if (loop.listenDescriptor < 0)
+			throw std::system_error(errno, std::generic_category(), "cannot share listening socket");
+	}
+	else
+		loop.listenDescriptor = listenSocket(host, port, backlog, SOCK_NONBLOCK);
+	loop.epollDescriptor = epoll_create1(EPOLL_CLOEXEC);
+	loop.wakeDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (loop.epollDescriptor < 0 or loop.wakeDescriptor < 0)
+		throw std::system_error(errno, std::generic_category(), "cannot create event loop");
+	loop.mailbox = std::make_shared<reply_mailbox>(loop.wakeDescriptor);
+
+	//Listening and wake descriptors are told apart from connections (pointers) by reserved values 0 and 1
+	//Shared socket is level-triggered and exclusive: a new connection wakes one loop, which accepts only it
+	epoll_event event = {};
+	event.events = sharedSocket ? (EPOLLIN | EPOLLEXCLUSIVE) : (EPOLLIN | EPOLLET);
+	event.data.u64 = 0;
+	epoll_ctl(loop.epollDescriptor, EPOLL_CTL_ADD, loop.listenDescriptor, &event);
+	event.events = EPOLLIN;
+	event.data.u64 = 1;
+	epoll_ctl(loop.epollDescriptor, EPOLL_CTL_ADD, loop.wakeDescriptor, &event);
+}
+
+void EpollListener::runLoop(event_loop &loop) {
+	epoll_event events[MAX_EVENTS];
+	std::chrono::steady_clock::time_point lastSweep = std::chrono::steady_clock::now();
+	while (running) {
+		int ready = epoll_wait(loop.epollDescriptor, events, MAX_EVENTS, (idleTimeout.count() > 0) ? 1000 : -1);
+		if (ready < 0 and errno != EINTR)
+			return;
+
+		for (int i = 0; i < ready; i++) {
+			if (events[i].data.u64 == 0) {
+				acceptConnections(loop);
+				continue;
+			}
+			if (events[i].data.u64 == 1) {
+				//Woken by close() or by replies posted to mailbox (counter read first: posts after it wake loop again)
+				std::uint64_t wakes;
+				if (read(loop.wakeDescriptor, &wakes, sizeof(wakes)) < 0) { }
+				if (!running)
+					return;
+				deliverReplies(loop);
+				continue;
+			}
+
+			connection &client = *static_cast<connection *>(events[i].data.ptr);
+			if (client.closed)
+				continue;	//Closed earlier in this batch (e.g. by a reply delivered on wake)
+			if (events[i].events & EPOLLERR) {
+				closeConnection(loop, client);
+				continue;
+			}
+			if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))
+				client.peerClosed = !readInput(client) or client.peerClosed;
+			serveConnection(loop, client);
+		}
+
+		//Only once batch is handled: events of it may point at connections idle until their input is read
+		if (idleTimeout.count() > 0 and std::chrono::steady_clock::now() - lastSweep >= std::chrono::seconds(1)) {
+			closeIdleConnections(loop);
+			lastSweep = std::chrono::steady_clock::now();
+		}
+		loop.closedConnections.clear();
+	}
+}
+
+void EpollListener::serveConnection(event_loop &loop, connection &client) {
+	//Answer and flush alternately: requests held back by pending output go on once it is sent (EPOLLOUT)
+	bool alive = true, heldBack = false;
+	do {
+		heldBack = processInput(loop, client);
+		alive = flushOutput(client);
+	} while (alive and heldBack and client.output.empty());
+
+	//Connection waiting for a reply is kept (even if peer closed) until it is written
+	if (!alive or (client.output.empty() and client.awaitedReply == 0 and (client.peerClosed or client.closeAfterOutput)))
+		closeConnection(loop, client);
+}
+
+void EpollListener::acceptConnections(event_loop &loop) {
+	//Edge-triggered: accept until queue is empty, otherwise no new event comes for the ones left
+	//(shared socket is level-triggered: one connection per wake, the rest go to whichever loop is woken next)
+	for (bool more = true; more; more = !sharedSocket) {
+		sockaddr_storage peer = {};
+		socklen_t peerLength = sizeof(peer);
+		int descriptor = accept4(loop.listenDescriptor, reinterpret_cast<sockaddr *>(&peer), &peerLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (descriptor < 0) {
+			if (errno == EINTR or errno == ECONNABORTED)
+				continue;
+			return;	//EAGAIN (queue empty) or out of descriptors (retried on next connection)
+		}
+
+		int enable = 1;
+		setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+		std::unique_ptr<connection> &client = loop.connections[descriptor];
+		client.reset(new connection());
+		client->descriptor = descriptor;
+		client->remoteAddress = peerAddress(peer);
+		client->lastInput = std::chrono::steady_clock::now();
+
+		epoll_event event = {};
+		event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		event.data.ptr = client.get();
+		epoll_ctl(loop.epollDescriptor, EPOLL_CTL_ADD, descriptor, &event);
+		loop.accepted.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+bool EpollListener::readInput(connection &client) {
+	//Edge-triggered: read until EAGAIN; false once peer closed (what came before is still answered) or failed
+	char chunk[16 * 1024];
+	while (true) {
+		ssize_t received = recv(client.descriptor, chunk, sizeof(chunk), 0);
+		if (received > 0) {
+			client.input.append(chunk, received);
+			client.lastInput = std::chrono::steady_clock::now();
+			continue;
+		}
+		if (received < 0 and errno == EINTR)
+			continue;
+		return received < 0 and (errno == EAGAIN or errno == EWOULDBLOCK);
+	}
+}
+
+bool EpollListener::processInput(event_loop &loop, connection &client) {
+	HttpCodec::request parsed;
+	parsed.remoteAddress = client.remoteAddress;
+	parsed.receivedAt = std::chrono::steady_clock::now();	//Input was read just before (pipelined requests queue from here)
+	std::size_t position = 0, consumed = 0;
+	bool heldBack = false;
+	while (!client.closeAfterOutput and client.awaitedReply == 0) {
+		if (client.output.size() - client.outputSent >= MAX_PENDING_OUTPUT) {
+			heldBack = true;
+			break;
+		}
+		HttpCodec::parse_status::status status = HttpCodec::parse(client.input.data() + position, client.input.size() - position, parsed, consumed, maxBodyLength);
+		if (status == HttpCodec::parse_status::status::INCOMPLETE)
+			break;
+
+		HttpCodec::response reply;
+		bool withBody = true;
+		if (status != HttpCodec::parse_status::status::COMPLETE) {
+			reply.status = HttpCodec::errorStatus(status);
+			client.closeAfterOutput = true;
+		}
+		else {
+			position += consumed;
+			client.closeAfterOutput = !parsed.keepAlive;
+			std::uint64_t request = ++loop.nextRequest;
+			bool replied = handle(handler, parsed, reply, loop.mailbox, client.descriptor, request);
+			loop.served.fetch_add(1, std::memory_order_relaxed);
+			withBody = (parsed.method != "HEAD");
+			if (!replied) {
+				client.awaitedReply = request;
+				client.awaitedWithBody = withBody;
+				break;
+			}
+		}
+		HttpCodec::serialize(reply, !client.closeAfterOutput, client.output, withBody);
+	}
+	client.input.erase(0, position);
+	return heldBack;
+}
+
+void EpollListener::deliverReplies(event_loop &loop) {
+	for (reply_mailbox::delivery & item : loop.mailbox->take()) {
+		auto found = loop.connections.find(static_cast<int>(item.connection));
+		if (found == loop.connections.end() or found->second->awaitedReply != item.request)
+			continue;	//Connection closed meanwhile (descriptor may belong to another one by now)
+
+		connection &client = *found->second;
+		client.awaitedReply = 0;
+		HttpCodec::serialize(item.reply, !client.closeAfterOutput, client.output, client.awaitedWithBody);
+		serveConnection(loop, client);	//Requests pipelined behind it go on
+	}
+}
+
+bool EpollListener::flushOutput(connection &client) {
+	while (client.outputSent < client.output.size()) {
+		ssize_t sent = send(client.descriptor, client.output.data() + client.outputSent, client.output.size() - client.outputSent, MSG_NOSIGNAL);
+		if (sent > 0) {
+			client.outputSent += sent;
+			continue;
+		}
+		if (sent < 0 and errno == EINTR)
+			continue;
+		return sent < 0 and (errno == EAGAIN or errno == EWOULDBLOCK);	//Rest goes on next EPOLLOUT, false if connection broke
+	}
+	client.output.clear();
+	client.outputSent = 0;
+	return true;
+}
+
+void EpollListener::closeConnection(event_loop &loop, connection &client) {
+	//Descriptor number may be reused by an accept of this batch, so connection leaves map now but is freed only after batch
+	int descriptor = client.descriptor;
+	::close(descriptor);	//Also removes it from epoll set
+	client.closed = true;
+	auto found = loop.connections.find(descriptor);
+	loop.closedConnections.push_back(std::move(found->second));
+	loop.connections.erase(found);
+}
+
+void EpollListener::closeIdleConnections(event_loop &loop) {
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	std::vector<connection *> idle;
+	for (std::pair<const int, std::unique_ptr<connection>> & client : loop.connections)
+		if (client.second->output.empty() and client.second->awaitedReply == 0 and now - client.second->lastInput >= idleTimeout)
+			idle.push_back(client.second.get());
+	for (connection *client : idle)
+		closeConnection(loop, *client);
+}
+
+void EpollListener::closeLoop(event_loop &loop) {
+	if (loop.mailbox)
+		loop.mailbox->close();
+	loop.mailbox.reset();
+	for (std::pair<const int, std::unique_ptr<connection>> & client : loop.connections)
+		::close(client.first);
+	loop.connections.clear();
+	loop.closedConnections.clear();
+
+	for (int *descriptor : {&loop.listenDescriptor, &loop.wakeDescriptor, &loop.epollDescriptor})
+		if (*descriptor >= 0) {
+			::close(*descriptor);
+			*descriptor = -1;
+		}
+}
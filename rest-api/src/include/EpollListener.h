@@ -0,0 +1,107 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cerrno>
+#include <algorithm>
+#include <unordered_map>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "NativeListener.h"
+
+
+//HTTP/1.1 server on non-blocking sockets and edge-triggered epoll, one event loop per thread
+//Every loop owns its listening socket (SO_REUSEPORT on the same port, kernel balances accepts) and its connections,
+//so loops share nothing. Handlers are called inline in the loop and must not block (a slow one stalls the whole loop):
+//work that takes long replies later from another thread (the connection waits for it, the loop goes on with others).
+//Keep-alive and pipelining are supported; a connection stops being read while too much output is pending
+class EpollListener : public NativeListener {
+	public:
+		typedef HttpCodec::request_handler request_handler;
+
+		static const std::size_t MAX_PENDING_OUTPUT = 1024 * 1024;
+		static const int MAX_EVENTS = 256;
+
+		EpollListener(const std::string & host, unsigned short port, std::size_t loopCount, request_handler handler, int backlog = 1024);
+		~EpollListener();	//Closes listener
+
+		void open() override;	//Throws std::system_error when a socket can not be bound
+		void close() override;	//Stops loops and closes every connection (pending output is discarded)
+
+		std::size_t loops() const;
+		std::uint64_t acceptedConnections() const override;
+		std::vector<std::uint64_t> servedRequests() const override;
+
+	protected:
+		//sharedSocket: every loop waits on one listening socket (each connection wakes a single loop, which accepts it),
+		//instead of one socket per loop; idleTimeout: connections with nothing to send closed after that long without
+		//input (0 = kept until peer closes them)
+		EpollListener(const std::string & host, unsigned short port, std::size_t loopCount, request_handler handler, int backlog, \
+			bool sharedSocket, std::chrono::seconds idleTimeout);
+
+	private:
+		class connection {
+			public:
+				int descriptor;
+				std::string remoteAddress;
+				std::string input;
+				std::string output;
+				std::size_t outputSent = 0;
+				bool closeAfterOutput = false;
+				bool peerClosed = false;
+				std::uint64_t awaitedReply = 0;		//Request whose reply comes later (0 = none), next ones wait for it
+				bool awaitedWithBody = true;
+				std::chrono::steady_clock::time_point lastInput;
+				bool closed = false;				//Descriptor closed, object kept until events of current batch are handled
+		};
+
+		class alignas(64) event_loop {
+			public:
+				int epollDescriptor = -1;
+				int listenDescriptor = -1;
+				int wakeDescriptor = -1;
+				std::unordered_map<int, std::unique_ptr<connection>> connections;
+				std::vector<std::unique_ptr<connection>> closedConnections;	//Freed after each batch (events may still point at them)
+				std::shared_ptr<reply_mailbox> mailbox;
+				std::uint64_t nextRequest = 0;
+				std::atomic<std::uint64_t> accepted{0};
+				std::atomic<std::uint64_t> served{0};
+		};
+
+		std::string host;
+		unsigned short port;
+		request_handler handler;
+		int backlog;
+		bool sharedSocket;
+		std::chrono::seconds idleTimeout;
+
+		std::atomic<bool> running;
+		std::vector<std::unique_ptr<event_loop>> eventLoops;
+		std::vector<std::thread> threads;
+
+		void openLoop(event_loop & loop);
+		void runLoop(event_loop & loop);
+		void acceptConnections(event_loop & loop);
+		bool readInput(connection & client);
+		void serveConnection(event_loop & loop, connection & client);	//Answers what was read, flushes, closes when done
+		bool processInput(event_loop & loop, connection & client);	//True when it stopped because of pending output
+		void deliverReplies(event_loop & loop);
+		bool flushOutput(connection & client);
+		void closeConnection(event_loop & loop, connection & client);
+		void closeIdleConnections(event_loop & loop);
+		static void closeLoop(event_loop & loop);
+};
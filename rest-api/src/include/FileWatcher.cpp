@@ -0,0 +1,74 @@
+
+#include "FileWatcher.h"
+
+
+FileWatcher::FileWatcher(const std::string & path, change_handler handler, std::chrono::milliseconds settleTime) : \
+	handler(std::move(handler)), settleTime(settleTime), inotifyDescriptor(-1), stopDescriptor(-1) {
+
+	std::size_t slash = path.rfind('/');
+	directory = (slash == std::string::npos) ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+	name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+
+	inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyDescriptor < 0)
+		throw std::system_error(errno, std::generic_category(), "inotify_init1");
+	if (inotify_add_watch(inotifyDescriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		int error = errno;
+		close(inotifyDescriptor);
+		throw std::system_error(error, std::generic_category(), "inotify_add_watch " + directory);
+	}
+	stopDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (stopDescriptor < 0) {
+		int error = errno;
+		close(inotifyDescriptor);
+		throw std::system_error(error, std::generic_category(), "eventfd");
+	}
+
+	watcher = std::thread(&FileWatcher::watchLoop, this);
+}
+
+FileWatcher::~FileWatcher() {
+	std::uint64_t one = 1;
+	if (write(stopDescriptor, &one, sizeof(one)) < 0) {}
+	watcher.join();
+	close(stopDescriptor);
+	close(inotifyDescriptor);
+}
+
+void FileWatcher::watchLoop() {
+	pollfd descriptors[2] = {{inotifyDescriptor, POLLIN, 0}, {stopDescriptor, POLLIN, 0}};
+	bool changed = false;
+
+	while (true) {
+		//Waits forever for first event, then settleTime for each following one
+		int ready = poll(descriptors, 2, changed ? (int) settleTime.count() : -1);
+		if (ready < 0 and errno == EINTR)
+			continue;
+		if (ready < 0 or (descriptors[1].revents & POLLIN))
+			return;
+
+		if (ready == 0) {	//Quiet for settleTime
+			changed = false;
+			handler();
+			continue;
+		}
+		if (descriptors[0].revents & POLLIN)
+			changed = readEvents() or changed;
+	}
+}
+
+bool FileWatcher::readEvents() {
+	alignas(inotify_event) char buffer[4096];
+	bool concerned = false;
+
+	ssize_t length;
+	while ((length = read(inotifyDescriptor, buffer, sizeof(buffer))) > 0) {
+		for (char *position = buffer; position < buffer + length; ) {
+			const inotify_event *event = reinterpret_cast<const inotify_event *>(position);
+			if (event->len > 0 and name == event->name)
+				concerned = true;
+			position += sizeof(inotify_event) + event->len;
+		}
+	}
+	return concerned;
+}
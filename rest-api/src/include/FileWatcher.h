@@ -0,0 +1,41 @@
+
+#pragma once
+
+#include <string>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <system_error>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+
+
+//Calls handler (on a thread of its own) whenever a file is written or replaced, watching its directory with inotify, so
+//files replaced by rename (as most editors and deploy tools do) keep being watched. Events arriving close together
+//(e.g. several writes of one save) are coalesced into one call, made once they stopped for settleTime
+class FileWatcher {
+	public:
+		typedef std::function<void()> change_handler;
+
+		//Throws std::system_error when directory cannot be watched
+		FileWatcher(const std::string & path, change_handler handler, std::chrono::milliseconds settleTime = std::chrono::milliseconds(100));
+		~FileWatcher();	//Stops thread (a call in progress is finished first)
+
+		FileWatcher(const FileWatcher &) = delete;
+		FileWatcher & operator=(const FileWatcher &) = delete;
+
+	private:
+		std::string directory;
+		std::string name;
+		change_handler handler;
+		std::chrono::milliseconds settleTime;
+		int inotifyDescriptor;
+		int stopDescriptor;		//eventfd written by destructor
+		std::thread watcher;
+
+		void watchLoop();
+		bool readEvents();		//True when one of them concerns the file
+};
@@ -0,0 +1,123 @@
+
+#include "HttpCodec.h"
+
+
+const std::string *HttpCodec::request::header(const char *name) const {
+	for (const std::pair<std::string, std::string> & entry : headers)
+		if (strcasecmp(entry.first.c_str(), name) == 0)
+			return &entry.second;
+	return nullptr;
+}
+
+HttpCodec::parse_status::status HttpCodec::parse(const char *data, std::size_t length, request &parsed, std::size_t &consumed, std::size_t maxBodyLength) {
+	const char *headerEnd = static_cast<const char *>(memmem(data, length, "\r\n\r\n", 4));
+	if (headerEnd == nullptr)
+		return (length > MAX_HEADER_LENGTH) ? parse_status::status::INVALID : parse_status::status::INCOMPLETE;
+
+	//Request line: METHOD SP target SP HTTP/1.x
+	const char *lineEnd = static_cast<const char *>(memmem(data, headerEnd + 2 - data, "\r\n", 2));
+	const char *methodEnd = static_cast<const char *>(memchr(data, ' ', lineEnd - data));
+	const char *targetEnd = (methodEnd == nullptr) ? nullptr : static_cast<const char *>(memchr(methodEnd + 1, ' ', lineEnd - methodEnd - 1));
+	if (targetEnd == nullptr or methodEnd == data or targetEnd == methodEnd + 1 or lineEnd - targetEnd != 9 or strncmp(targetEnd + 1, "HTTP/1.", 7) != 0)
+		return parse_status::status::INVALID;
+
+	parsed.method.assign(data, methodEnd);
+	parsed.target.assign(methodEnd + 1, targetEnd);
+	parsed.keepAlive = (targetEnd[8] == '1');	//HTTP/1.1 keeps connection by default, HTTP/1.0 does not
+	parsed.headers.clear();
+	parsed.body.clear();
+
+	std::size_t contentLength = 0;
+	for (const char *line = lineEnd + 2; line < headerEnd; line = lineEnd + 2) {
+		lineEnd = static_cast<const char *>(memmem(line, headerEnd + 2 - line, "\r\n", 2));
+		const char *colon = static_cast<const char *>(memchr(line, ':', lineEnd - line));
+		if (colon == nullptr or colon == line)
+			return parse_status::status::INVALID;
+
+		const char *value = colon + 1, *valueEnd = lineEnd;
+		while (value < valueEnd and (*value == ' ' or *value == '\t'))
+			value++;
+		while (valueEnd > value and (valueEnd[-1] == ' ' or valueEnd[-1] == '\t'))
+			valueEnd--;
+		parsed.headers.emplace_back(std::string(line, colon), std::string(value, valueEnd));
+
+		const std::pair<std::string, std::string> &entry = parsed.headers.back();
+		if (strcasecmp(entry.first.c_str(), "Content-Length") == 0) {
+			char *end = nullptr;
+			contentLength = std::strtoull(entry.second.c_str(), &end, 10);
+			if (entry.second.empty() or *end != '\0')
+				return parse_status::status::INVALID;
+			if (contentLength > maxBodyLength)
+				return parse_status::status::TOO_LARGE;
+		}
+		else if (strcasecmp(entry.first.c_str(), "Transfer-Encoding") == 0)
+			return parse_status::status::INVALID;
+		else if (strcasecmp(entry.first.c_str(), "Connection") == 0)
+			parsed.keepAlive = (strcasecmp(entry.second.c_str(), "close") != 0) and (parsed.keepAlive or strcasecmp(entry.second.c_str(), "keep-alive") == 0);
+	}
+
+	std::size_t headerLength = headerEnd + 4 - data;
+	if (length - headerLength < contentLength)
+		return parse_status::status::INCOMPLETE;
+
+	parsed.body.assign(headerEnd + 4, contentLength);
+	consumed = headerLength + contentLength;
+	return parse_status::status::COMPLETE;
+}
+
+void HttpCodec::serialize(const response &reply, bool keepAlive, std::string &output, bool withBody) {
+	output += "HTTP/1.1 ";
+	output += std::to_string(reply.status);
+	output += ' ';
+	output += reply.reason.empty() ? reasonPhrase(reply.status) : reply.reason;
+	output += "\r\n";
+
+	for (const std::pair<std::string, std::string> & entry : reply.headers) {
+		if (strcasecmp(entry.first.c_str(), "Content-Length") == 0 or strcasecmp(entry.first.c_str(), "Connection") == 0)
+			continue;
+		output += entry.first;
+		output += ": ";
+		output += entry.second;
+		output += "\r\n";
+	}
+
+	output += "Content-Length: ";
+	output += std::to_string(reply.body.size());
+	output += keepAlive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+	if (withBody)
+		output += reply.body;
+}
+
+unsigned short HttpCodec::errorStatus(parse_status::status s) {
+	return (s == parse_status::status::TOO_LARGE) ? 413 : 400;
+}
+
+const char *HttpCodec::reasonPhrase(unsigned short status) {
+	switch (status) {
+		case 200:	return "OK"; break;
+		case 201:	return "Created"; break;
+		case 204:	return "No Content"; break;
+		case 304:	return "Not Modified"; break;
+		case 400:	return "Bad Request"; break;
+		case 404:	return "Not Found"; break;
+		case 405:	return "Method Not Allowed"; break;
+		case 412:	return "Precondition Failed"; break;
+		case 413:	return "Payload Too Large"; break;
+		case 429:	return "Too Many Requests"; break;
+		case 500:	return "Internal Server Error"; break;
+		case 501:	return "Not Implemented"; break;
+		case 503:	return "Service Unavailable"; break;
+		case 504:	return "Gateway Timeout";
+	}
+	return "Unknown";
+}
+
+std::string HttpCodec::parse_status::to_string(status s) {
+	switch (s) {
+		case status::COMPLETE:		return "complete"; break;
+		case status::INCOMPLETE:	return "incomplete"; break;
+		case status::INVALID:		return "invalid"; break;
+		case status::TOO_LARGE:		return "too large";
+	}
+	return "invalid";
+}
@@ -0,0 +1,67 @@
+
+#pragma once
+
+#include <string>
+#include <chrono>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <functional>
+#include <cstring>
+#include <cstdlib>
+#include <strings.h>
+
+
+//Minimal HTTP/1.x wire format, used by listeners that own their sockets (no cpprest involved)
+//Requests must carry their body with Content-Length (chunked bodies are rejected), responses always do
+class HttpCodec {
+	public:
+		static const std::size_t MAX_HEADER_LENGTH = 16 * 1024;
+		static const std::size_t DEFAULT_MAX_BODY_LENGTH = 16 * 1024 * 1024;
+
+		class parse_status {
+			public:
+				enum class status { COMPLETE, INCOMPLETE, INVALID, TOO_LARGE };	//TOO_LARGE: body over limit of parse
+				static std::string to_string(status s);
+		};
+
+		class request {
+			public:
+				std::string method;
+				std::string target;		//Origin form: /path?query
+				std::vector<std::pair<std::string, std::string>> headers;
+				std::string body;
+				bool keepAlive = true;
+				std::string remoteAddress;	//IP of peer, set by listener (not by parse)
+				std::chrono::steady_clock::time_point receivedAt;	//When its bytes were read, set by listener
+
+				const std::string *header(const char *name) const;	//Case-insensitive, nullptr if absent
+		};
+
+		class response {
+			public:
+				unsigned short status = 200;
+				std::string reason;		//Default phrase of status when empty
+				std::vector<std::pair<std::string, std::string>> headers;	//Content-Length and Connection are written by serialize()
+				std::string body;
+		};
+
+		//Contract of listeners using this codec: handler calls responder once, before returning or later from any thread
+		//(request, body included, is only valid until handler returns); pipelined requests behind it wait for its reply
+		typedef std::function<void(response &&)> responder;
+		typedef std::function<void(const request &, responder)> request_handler;
+
+		//Parses one request from beginning of data; on COMPLETE, consumed tells how many bytes it took (next one may follow)
+		//Content-Length over maxBodyLength is TOO_LARGE as soon as header is read (body is not waited for)
+		static parse_status::status parse(const char *data, std::size_t length, request & parsed, std::size_t & consumed, \
+			std::size_t maxBodyLength = DEFAULT_MAX_BODY_LENGTH);
+
+		//Appends response to output (pipelined responses are just appended one after the other)
+		//Without body (answer to HEAD) its Content-Length is still the one of body, as GET would send it
+		static void serialize(const response & reply, bool keepAlive, std::string & output, bool withBody = true);
+
+		//Status answering a parse that failed (400 or 413), connection is to be closed after it
+		static unsigned short errorStatus(parse_status::status s);
+
+		static const char *reasonPhrase(unsigned short status);
+};
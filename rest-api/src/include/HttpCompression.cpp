@@ -0,0 +1,109 @@
+
+#include "HttpCompression.h"
+
+
+HttpCompression::encodings::encoding HttpCompression::negotiate(std::string_view acceptEncoding) {
+	//No header (or empty one) means client did not ask for any coding
+	if (trim(acceptEncoding).empty())
+		return encodings::encoding::IDENTITY;
+
+	//Codings not listed take the q-value of "*" (or are not acceptable)
+	double wildcard = std::max(0.0, qualityOf(acceptEncoding, "*"));
+	double gzip = qualityOf(acceptEncoding, "gzip"), deflate = qualityOf(acceptEncoding, "deflate");
+	if (gzip < 0)
+		gzip = qualityOf(acceptEncoding, "x-gzip");
+	gzip = (gzip < 0) ? wildcard : gzip;
+	deflate = (deflate < 0) ? wildcard : deflate;
+	if (gzip > 0 and gzip >= deflate)
+		return encodings::encoding::GZIP;
+	if (deflate > 0)
+		return encodings::encoding::DEFLATE;
+	return encodings::encoding::IDENTITY;
+}
+
+std::string HttpCompression::compress(std::string_view body, encodings::encoding encoding, int level) {
+	if (encoding == encodings::encoding::IDENTITY)
+		return std::string(body);
+
+	thread_local stream_holder holders[2];
+	stream_holder &holder = holders[(encoding == encodings::encoding::GZIP) ? 0 : 1];
+	if (holder.initialized and holder.level != level) {
+		deflateEnd(&holder.stream);
+		holder.initialized = false;
+	}
+	if (!holder.initialized) {
+		//Window bits 15 + 16 writes gzip header/trailer, plain 15 the zlib format HTTP calls "deflate"
+		holder.stream = z_stream{};
+		if (deflateInit2(&holder.stream, level, Z_DEFLATED, (encoding == encodings::encoding::GZIP) ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			throw std::runtime_error("cannot initialize zlib");
+		holder.level = level;
+		holder.initialized = true;
+	}
+	else
+		deflateReset(&holder.stream);
+
+	//Single deflate call: output sized by deflateBound never runs out
+	z_stream &stream = holder.stream;
+	std::string compressed(deflateBound(&stream, body.size()), '\0');
+	stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(body.data()));
+	stream.avail_in = body.size();
+	stream.next_out = reinterpret_cast<Bytef *>(&compressed[0]);
+	stream.avail_out = compressed.size();
+	int result = deflate(&stream, Z_FINISH);
+	compressed.resize(stream.total_out);
+	if (result != Z_STREAM_END)
+		throw std::runtime_error("zlib compression failed");
+	return compressed;
+}
+
+double HttpCompression::qualityOf(std::string_view acceptEncoding, std::string_view coding) {
+	//List of "coding[;q=value]", -1 when coding is not listed
+	double quality = -1;
+	std::size_t position = 0;
+	while (position <= acceptEncoding.size()) {
+		std::size_t end = std::min(acceptEncoding.find(',', position), acceptEncoding.size());
+		std::string_view item = acceptEncoding.substr(position, end - position);
+		position = end + 1;
+
+		std::size_t separator = item.find(';');
+		std::string_view name = trim(item.substr(0, separator));
+		double value = 1;
+		if (separator != std::string_view::npos) {
+			std::string_view parameter = trim(item.substr(separator + 1));
+			if (parameter.size() > 2 and (parameter[0] == 'q' or parameter[0] == 'Q') and parameter[1] == '=')
+				value = std::strtod(std::string(parameter.substr(2)).c_str(), nullptr);
+		}
+
+		if (name.size() == coding.size() and std::equal(name.begin(), name.end(), coding.begin(), \
+				[](char a, char b) { return std::tolower((unsigned char) a) == std::tolower((unsigned char) b); }))
+			quality = value;
+	}
+	return quality;
+}
+
+std::string_view HttpCompression::trim(std::string_view text) {
+	std::size_t first = text.find_first_not_of(" \t");
+	if (first == std::string_view::npos)
+		return std::string_view();
+	return text.substr(first, text.find_last_not_of(" \t") - first + 1);
+}
+
+HttpCompression::stream_holder::~stream_holder() {
+	if (initialized)
+		deflateEnd(&stream);
+}
+
+std::string HttpCompression::etagFor(const std::string &etag, encodings::encoding encoding) {
+	if (encoding == encodings::encoding::IDENTITY or etag.size() < 2 or etag.back() != '"')
+		return etag;
+	return etag.substr(0, etag.size() - 1) + "-" + encodings::to_string(encoding) + "\"";
+}
+
+std::string HttpCompression::encodings::to_string(encoding e) {
+	switch (e) {
+		case encoding::IDENTITY:	return ""; break;
+		case encoding::GZIP:		return "gzip"; break;
+		case encoding::DEFLATE:		return "deflate";
+	}
+	return "";
+}
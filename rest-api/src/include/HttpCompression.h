@@ -0,0 +1,43 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cctype>
+#include <cstdlib>
+#include <algorithm>
+#include <stdexcept>
+#include <zlib.h>
+
+
+//HTTP content codings over zlib: negotiation against Accept-Encoding and one-shot compression of bodies
+class HttpCompression {
+	public:
+		class encodings {
+			public:
+				enum class encoding { IDENTITY, GZIP, DEFLATE };
+				static std::string to_string(encoding e);	//Content-Encoding token (empty for identity)
+		};
+
+		//Preferred coding accepted by client: highest q-value, gzip before deflate on ties, identity when none is acceptable
+		static encodings::encoding negotiate(std::string_view acceptEncoding);
+
+		//Level 1 (fastest) to 9 (smallest); throws std::runtime_error if zlib fails
+		static std::string compress(std::string_view body, encodings::encoding encoding, int level = Z_DEFAULT_COMPRESSION);
+
+		//Strong ETag of a coded representation: coding appended inside the quotes ("9f0c" -> "9f0c-gzip"), as is for identity
+		static std::string etagFor(const std::string & etag, encodings::encoding encoding);
+
+	private:
+		//zlib stream kept per thread and coding, reset between bodies (deflateInit allocates and clears ~256 KiB each time)
+		class stream_holder {
+			public:
+				z_stream stream{};
+				int level = 0;
+				bool initialized = false;
+				~stream_holder();
+		};
+
+		static double qualityOf(std::string_view acceptEncoding, std::string_view coding);
+		static std::string_view trim(std::string_view text);
+};
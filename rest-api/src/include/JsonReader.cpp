@@ -0,0 +1,547 @@
+
+#include "JsonReader.h"
+
+
+JsonReader::JsonReader() : errorOffset(0), compactDocument(true), repeatedKeys(false), parsed(false) {}
+
+bool JsonReader::parse(std::string_view document) {
+	this->document = document;
+	tokens.clear();
+	errorOffset = 0;
+	compactDocument = true;
+	repeatedKeys = false;
+	parsed = false;
+	if (document.size() >= UINT32_MAX)
+		return fail(0);
+
+	std::size_t position = 0;
+	skipWhitespace(position);
+	if (!parseValue(position, 0))
+		return false;
+	skipWhitespace(position);
+	if (position != document.size())
+		return fail(position);
+	parsed = true;
+	return true;
+}
+
+JsonReader::value JsonReader::root() const {
+	return parsed ? value(this, 0, tokens.size()) : value();
+}
+
+std::string_view JsonReader::getDocument() const {
+	return document;
+}
+
+std::size_t JsonReader::getErrorOffset() const {
+	return errorOffset;
+}
+
+bool JsonReader::isCompact() const {
+	return compactDocument;
+}
+
+bool JsonReader::parseValue(std::size_t &position, std::size_t depth) {
+	if (position >= document.size())
+		return fail(position);
+
+	//Index kept instead of a reference: children may grow (and move) tokens
+	std::uint32_t index = tokens.size();
+	std::size_t start = position;
+	tokens.push_back(token{token_types::type::NULL_VALUE, false, (std::uint32_t) start, 0, 0});
+
+	char c = document[position];
+	switch (c) {
+		case '{':
+		case '[': {
+			if (depth >= MAX_DEPTH)
+				return fail(position);
+			bool isObject = (c == '{');
+			char close = isObject ? '}' : ']';
+			tokens[index].type = isObject ? token_types::type::OBJECT : token_types::type::ARRAY;
+			position++;
+			skipWhitespace(position);
+			if (position < document.size() and document[position] == close) {
+				position++;
+				break;
+			}
+			//Two bits per name seen in object (by a hash of it): names are compared for real only when both were set already
+			std::uint64_t keyBits[2] = {0, 0};
+			bool checkNames = false;
+			while (true) {
+				if (isObject) {
+					//Key is a string token of its own, right before the token of its value
+					if (position >= document.size() or document[position] != '"')
+						return fail(position);
+					std::uint32_t key = tokens.size();
+					std::size_t keyStart = position;
+					bool escaped = false;
+					if (!parseString(position, escaped))
+						return false;
+					tokens.push_back(token{token_types::type::STRING, escaped, (std::uint32_t) keyStart + 1, (std::uint32_t) (position - keyStart - 2), key + 1});
+					std::uint32_t hash = 2166136261u;
+					for (std::size_t i = keyStart + 1; i < position - 1; i++)
+						hash = (hash ^ (unsigned char) document[i]) * 16777619u;
+					std::uint64_t lowBit = std::uint64_t(1) << (hash & 63), highBit = std::uint64_t(1) << ((hash >> 6) & 63);
+					checkNames = checkNames or escaped or ((keyBits[0] & lowBit) != 0 and (keyBits[1] & highBit) != 0);	//Escaped names may spell a name seen differently
+					keyBits[0] |= lowBit;
+					keyBits[1] |= highBit;
+					skipWhitespace(position);
+					if (position >= document.size() or document[position] != ':')
+						return fail(position);
+					position++;
+					skipWhitespace(position);
+				}
+				if (!parseValue(position, depth + 1))
+					return false;
+				skipWhitespace(position);
+				if (position >= document.size())
+					return fail(position);
+				if (document[position] == ',') {
+					position++;
+					skipWhitespace(position);
+					continue;
+				}
+				if (document[position] != close)
+					return fail(position);
+				position++;
+				break;
+			}
+			if (checkNames and !repeatedKeys) {
+				tokens[index].end = tokens.size();	//Members are iterated up to it
+				const std::vector<std::pair<std::string_view, std::uint32_t>> &names = sortedNames(value(this, index, tokens.size()));
+				for (std::size_t i = 0; i + 1 < names.size() and !repeatedKeys; i++)
+					repeatedKeys = (names[i].first == names[i + 1].first);
+			}
+			break;
+		}
+		case '"': {
+			bool escaped = false;
+			if (!parseString(position, escaped))
+				return false;
+			tokens[index] = token{token_types::type::STRING, escaped, (std::uint32_t) start + 1, (std::uint32_t) (position - start - 2), index + 1};
+			return true;
+		}
+		case 't':
+			tokens[index].type = token_types::type::TRUE;
+			if (!parseLiteral(position, "true", 4))
+				return false;
+			break;
+		case 'f':
+			tokens[index].type = token_types::type::FALSE;
+			if (!parseLiteral(position, "false", 5))
+				return false;
+			break;
+		case 'n':
+			if (!parseLiteral(position, "null", 4))
+				return false;
+			break;
+		default:
+			tokens[index].type = token_types::type::NUMBER;
+			if (!parseNumber(position))
+				return false;
+	}
+	tokens[index].length = position - start;
+	tokens[index].end = tokens.size();
+	return true;
+}
+
+bool JsonReader::parseString(std::size_t &position, bool &escaped) {
+	//Plain runs are skipped in bulk up to next quote, backslash or control character (the latter is invalid unescaped)
+	const char *data = document.data();
+	std::size_t length = document.size();
+	position++;
+	while (true) {
+		std::size_t next = JsonWriter::findEscape(data, position, length);
+		if (next == length)
+			return fail(next);
+		if (data[next] == '"') {
+			position = next + 1;
+			return true;
+		}
+		if (data[next] != '\\' or next + 1 >= length)
+			return fail(next);
+
+		escaped = true;
+		switch (data[next + 1]) {
+			case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+				position = next + 2;
+				break;
+			case 'u':
+				if (next + 6 > length)
+					return fail(next);
+				for (std::size_t i = next + 2; i < next + 6; i++)
+					if (hexValue(data[i]) < 0)
+						return fail(i);
+				position = next + 6;
+				break;
+			default:
+				return fail(next);
+		}
+	}
+}
+
+bool JsonReader::parseNumber(std::size_t &position) {
+	//-?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+	std::size_t length = document.size();
+	auto isDigit = [this, length](std::size_t p) { return p < length and document[p] >= '0' and document[p] <= '9'; };
+
+	if (document[position] == '-')
+		position++;
+	if (!isDigit(position))
+		return fail(position);
+	if (document[position++] != '0')
+		while (isDigit(position))
+			position++;
+
+	if (position < length and document[position] == '.') {
+		position++;
+		if (!isDigit(position))
+			return fail(position);
+		while (isDigit(position))
+			position++;
+	}
+	if (position < length and (document[position] == 'e' or document[position] == 'E')) {
+		position++;
+		if (position < length and (document[position] == '+' or document[position] == '-'))
+			position++;
+		if (!isDigit(position))
+			return fail(position);
+		while (isDigit(position))
+			position++;
+	}
+	return true;
+}
+
+bool JsonReader::parseLiteral(std::size_t &position, const char *literal, std::size_t length) {
+	if (document.compare(position, length, literal) != 0)
+		return fail(position);
+	position += length;
+	return true;
+}
+
+void JsonReader::skipWhitespace(std::size_t &position) {
+	std::size_t start = position;
+	while (position < document.size() and isWhitespace(document[position]))
+		position++;
+	if (position != start)
+		compactDocument = false;
+}
+
+bool JsonReader::fail(std::size_t position) {
+	errorOffset = position;
+	return false;
+}
+
+void JsonReader::compact(const value &v, std::string &output) {
+	if (!v.valid())
+		return;
+	//Any value of a compact document is compact already (unless some name is repeated)
+	std::string_view text = v.raw();
+	if ((v.reader->compactDocument and !v.reader->repeatedKeys) or (!v.isObject() and !v.isArray())) {
+		output.append(text);
+		return;
+	}
+
+	output.reserve(output.size() + text.size());	//Only grows on outermost call
+	bool isObject = v.isObject(), first = true;
+	std::vector<std::uint32_t> skipped;
+	if (isObject)
+		overriddenKeys(v, skipped);
+	output += isObject ? '{' : '[';
+	for (value child = v.first(); child.valid(); child = child.next()) {
+		if (isObject and overridden(child, skipped)) {
+			child = child.next();
+			continue;
+		}
+		if (!first)
+			output += ',';
+		first = false;
+		if (isObject) {
+			output.append(child.raw());
+			output += ':';
+			child = child.next();
+		}
+		compact(child, output);
+	}
+	output += isObject ? '}' : ']';
+}
+
+void JsonReader::mergePatch(const value &target, const value &patch, std::string &output) {
+	if (!patch.isObject()) {
+		compact(patch, output);
+		return;
+	}
+
+	//Names of both sides sorted once and walked together (member() per key would be quadratic), last key of each name
+	//taken (repeated names: last wins) and paired with key of same name on other side (0 = none, root is never a key)
+	bool targetIsObject = target.isObject();
+	std::vector<std::pair<std::string_view, std::uint32_t>> targetNames, patchNames;
+	std::deque<std::string> unescaped;
+	if (targetIsObject)
+		sortNames(target, targetNames, unescaped);
+	sortNames(patch, patchNames, unescaped);
+
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> targetMembers, patchMembers;
+	for (std::size_t t = 0, p = 0; t < targetNames.size() or p < patchNames.size();) {
+		std::size_t targetLast = t, patchLast = p;
+		while (targetLast + 1 < targetNames.size() and targetNames[targetLast + 1].first == targetNames[t].first)
+			targetLast++;
+		while (patchLast + 1 < patchNames.size() and patchNames[patchLast + 1].first == patchNames[p].first)
+			patchLast++;
+
+		int order = (t == targetNames.size()) ? 1 : (p == patchNames.size()) ? -1 : targetNames[t].first.compare(patchNames[p].first);
+		if (order <= 0)
+			targetMembers.emplace_back(targetNames[targetLast].second, (order == 0) ? patchNames[patchLast].second : 0);
+		if (order >= 0)
+			patchMembers.emplace_back(patchNames[patchLast].second, (order == 0) ? targetNames[targetLast].second : 0);
+		t = (order <= 0) ? targetLast + 1 : t;
+		p = (order >= 0) ? patchLast + 1 : p;
+	}
+	std::sort(targetMembers.begin(), targetMembers.end());
+	std::sort(patchMembers.begin(), patchMembers.end());
+
+	//Members of target in their order (replaced, merged or removed by patch), then the ones patch adds
+	std::uint32_t targetLimit = targetIsObject ? target.reader->tokens[target.index].end : 0;
+	std::uint32_t patchLimit = patch.reader->tokens[patch.index].end;
+	output += '{';
+	bool first = true;
+	for (const std::pair<std::uint32_t, std::uint32_t> & member : targetMembers) {
+		value key(target.reader, member.first, targetLimit);
+		value change = (member.second != 0) ? value(patch.reader, member.second, patchLimit).next() : value();
+		if (change.isNull())
+			continue;
+		if (!first)
+			output += ',';
+		first = false;
+		output.append(key.raw());
+		output += ':';
+		if (change.valid())
+			mergePatch(key.next(), change, output);
+		else
+			compact(key.next(), output);
+	}
+	for (const std::pair<std::uint32_t, std::uint32_t> & member : patchMembers) {
+		value key(patch.reader, member.first, patchLimit);
+		value change = key.next();
+		if (member.second != 0 or change.isNull())
+			continue;
+		if (!first)
+			output += ',';
+		first = false;
+		output.append(key.raw());
+		output += ':';
+		mergePatch(value(), change, output);
+	}
+	output += '}';
+}
+
+void JsonReader::overriddenKeys(const value &object, std::vector<std::uint32_t> &overridden) {
+	overridden.clear();
+	if (!object.reader->repeatedKeys)
+		return;
+
+	//Every name but last of each run of equal ones is overridden
+	const std::vector<std::pair<std::string_view, std::uint32_t>> &names = sortedNames(object);
+	for (std::size_t i = 0; i + 1 < names.size(); i++)
+		if (names[i].first == names[i + 1].first)
+			overridden.push_back(names[i].second);
+	std::sort(overridden.begin(), overridden.end());
+}
+
+const std::vector<std::pair<std::string_view, std::uint32_t>> &JsonReader::sortedNames(const value &object) {
+	thread_local std::vector<std::pair<std::string_view, std::uint32_t>> names;
+	thread_local std::deque<std::string> unescaped;
+	names.clear();
+	unescaped.clear();
+	sortNames(object, names, unescaped);
+	return names;
+}
+
+void JsonReader::sortNames(const value &object, std::vector<std::pair<std::string_view, std::uint32_t>> &names, std::deque<std::string> &unescaped) {
+	//Deque keeps its strings in place as it grows (names are views of them)
+	std::size_t start = names.size();
+	for (value key = object.first(); key.valid(); key = key.next().next()) {
+		std::string_view name = key.view();
+		if (key.hasEscapes()) {
+			unescaped.push_back(key.string());
+			name = unescaped.back();
+		}
+		names.emplace_back(name, key.index);
+	}
+	std::sort(names.begin() + start, names.end());
+}
+
+bool JsonReader::overridden(const value &key, const std::vector<std::uint32_t> &overridden) {
+	return !overridden.empty() and std::binary_search(overridden.begin(), overridden.end(), key.index);
+}
+
+void JsonReader::unescape(std::string_view content, std::string &output) {
+	output.reserve(output.size() + content.size());
+	for (std::size_t i = 0; i < content.size(); i++) {
+		if (content[i] != '\\') {
+			output += content[i];
+			continue;
+		}
+		char c = content[++i];
+		switch (c) {
+			case 'b': output += '\b'; break;
+			case 'f': output += '\f'; break;
+			case 'n': output += '\n'; break;
+			case 'r': output += '\r'; break;
+			case 't': output += '\t'; break;
+			case 'u': {
+				std::uint32_t codePoint = 0;
+				for (std::size_t j = 1; j <= 4; j++)
+					codePoint = (codePoint << 4) | hexValue(content[i + j]);
+				i += 4;
+				//Surrogate pair (UTF-16) is one code point; unpaired surrogates become U+FFFD
+				if (codePoint >= 0xD800 and codePoint <= 0xDBFF and i + 6 < content.size() and content[i + 1] == '\\' and content[i + 2] == 'u') {
+					std::uint32_t low = 0;
+					for (std::size_t j = 3; j <= 6; j++)
+						low = (low << 4) | hexValue(content[i + j]);
+					if (low >= 0xDC00 and low <= 0xDFFF) {
+						codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+						i += 6;
+					}
+				}
+				if (codePoint >= 0xD800 and codePoint <= 0xDFFF)
+					codePoint = 0xFFFD;
+				appendUTF8(output, codePoint);
+				break;
+			}
+			default: output += c;	//'"', '\\' and '/'
+		}
+	}
+}
+
+bool JsonReader::isWhitespace(char c) {
+	return c == ' ' or c == '\n' or c == '\r' or c == '\t';
+}
+
+int JsonReader::hexValue(char c) {
+	if (c >= '0' and c <= '9')
+		return c - '0';
+	if (c >= 'a' and c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' and c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+void JsonReader::appendUTF8(std::string &output, std::uint32_t codePoint) {
+	if (codePoint < 0x80)
+		output += (char) codePoint;
+	else if (codePoint < 0x800) {
+		output += (char) (0xC0 | (codePoint >> 6));
+		output += (char) (0x80 | (codePoint & 0x3F));
+	}
+	else if (codePoint < 0x10000) {
+		output += (char) (0xE0 | (codePoint >> 12));
+		output += (char) (0x80 | ((codePoint >> 6) & 0x3F));
+		output += (char) (0x80 | (codePoint & 0x3F));
+	}
+	else {
+		output += (char) (0xF0 | (codePoint >> 18));
+		output += (char) (0x80 | ((codePoint >> 12) & 0x3F));
+		output += (char) (0x80 | ((codePoint >> 6) & 0x3F));
+		output += (char) (0x80 | (codePoint & 0x3F));
+	}
+}
+
+JsonReader::value::value() : reader(nullptr), index(0), limit(0) {}
+
+JsonReader::value::value(const JsonReader *reader, std::uint32_t index, std::uint32_t limit) : reader(reader), index(index), limit(limit) {}
+
+bool JsonReader::value::valid() const {
+	return reader != nullptr and index < limit;
+}
+
+JsonReader::token_types::type JsonReader::value::type() const {
+	return reader->tokens[index].type;
+}
+
+bool JsonReader::value::isObject() const {
+	return valid() and type() == token_types::type::OBJECT;
+}
+
+bool JsonReader::value::isArray() const {
+	return valid() and type() == token_types::type::ARRAY;
+}
+
+bool JsonReader::value::isString() const {
+	return valid() and type() == token_types::type::STRING;
+}
+
+bool JsonReader::value::isNull() const {
+	return valid() and type() == token_types::type::NULL_VALUE;
+}
+
+std::string_view JsonReader::value::raw() const {
+	const token &t = reader->tokens[index];
+	if (t.type == token_types::type::STRING)
+		return reader->document.substr(t.offset - 1, t.length + 2);
+	return reader->document.substr(t.offset, t.length);
+}
+
+std::string_view JsonReader::value::view() const {
+	const token &t = reader->tokens[index];
+	return reader->document.substr(t.offset, t.length);
+}
+
+bool JsonReader::value::hasEscapes() const {
+	return reader->tokens[index].escaped;
+}
+
+std::string JsonReader::value::string() const {
+	if (!hasEscapes())
+		return std::string(view());
+	std::string unescaped;
+	unescape(view(), unescaped);
+	return unescaped;
+}
+
+bool JsonReader::value::equals(std::string_view text) const {
+	if (!isString())
+		return false;
+	return hasEscapes() ? (string() == text) : (view() == text);
+}
+
+std::size_t JsonReader::value::size() const {
+	std::size_t count = 0;
+	for (value child = first(); child.valid(); child = child.next())
+		count++;
+	return isObject() ? count / 2 : count;
+}
+
+JsonReader::value JsonReader::value::first() const {
+	if (!isObject() and !isArray())
+		return value();
+	return value(reader, index + 1, reader->tokens[index].end);
+}
+
+JsonReader::value JsonReader::value::next() const {
+	return value(reader, reader->tokens[index].end, limit);
+}
+
+JsonReader::value JsonReader::value::member(std::string_view key) const {
+	value found;
+	if (isObject())
+		for (value name = first(); name.valid(); name = name.next().next())
+			if (name.equals(key))
+				found = name.next();
+	return found;
+}
+
+std::string JsonReader::token_types::to_string(type t) {
+	switch (t) {
+		case type::OBJECT:		return "object"; break;
+		case type::ARRAY:		return "array"; break;
+		case type::STRING:		return "string"; break;
+		case type::NUMBER:		return "number"; break;
+		case type::TRUE:		return "true"; break;
+		case type::FALSE:		return "false"; break;
+		case type::NULL_VALUE:	return "null";
+	}
+	return "null";
+}
@@ -0,0 +1,119 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "JsonWriter.h"
+
+
+//In-situ JSON reader: parse() validates a document kept by caller (e.g. body of request, never copied) and indexes it into
+//a flat array of tokens, each one an offset/length into the document plus the index right after its children, so values
+//are skipped in O(1) and strings are views of the document (unescaped only when asked for and when they have escapes)
+//Token array is kept between documents (as the buffer of JsonWriter), so a long-lived reader stops allocating
+//Scan of strings runs 16 bytes at a time with SSE2 (JsonWriter::findEscape)
+class JsonReader {
+	public:
+		class token_types {
+			public:
+				enum class type : std::uint8_t { OBJECT, ARRAY, STRING, NUMBER, TRUE, FALSE, NULL_VALUE };
+				static std::string to_string(type t);
+		};
+
+		class value;
+
+		JsonReader();
+
+		//False when document is not valid JSON (RFC 8259, a single value with optional whitespace around); documents of
+		//4 GiB or more and nesting deeper than MAX_DEPTH are refused as well
+		bool parse(std::string_view document);
+		value root() const;								//Invalid value until a parse succeeded
+		std::string_view getDocument() const;
+		std::size_t getErrorOffset() const;				//Where last parse failed
+		bool isCompact() const;							//Document had no whitespace outside strings
+
+		static const std::size_t MAX_DEPTH = 512;
+
+		//Both write members repeated inside an object once, with their last value (as member() reads them)
+		//Serialized value without whitespace outside strings (strings, numbers and literals copied as they are)
+		static void compact(const value & v, std::string & output);
+		//RFC 7386 merge of patch into target (target may be invalid = absent), written compact
+		static void mergePatch(const value & target, const value & patch, std::string & output);
+
+		//Read-only view of one value of a parsed document, valid while its reader keeps the document
+		class value {
+			public:
+				value();
+
+				bool valid() const;		//False for absent members and for values of a reader with no document
+				token_types::type type() const;
+				bool isObject() const;
+				bool isArray() const;
+				bool isString() const;
+				bool isNull() const;
+
+				std::string_view raw() const;		//Value as in document (strings with their quotes)
+				std::string_view view() const;		//Content of string as in document (escape sequences kept)
+				bool hasEscapes() const;
+				std::string string() const;			//Content of string, unescaped
+				bool equals(std::string_view text) const;	//String whose unescaped content is text (no copy when unescaped)
+
+				//Children of objects are keys and values alternating: value of a key is key.next(), next key is key.next().next()
+				std::size_t size() const;			//Members of object or elements of array
+				value first() const;				//First element of array, or key of first member of object
+				value next() const;					//Value after this one and its children inside same parent, invalid past last
+				value member(std::string_view key) const;	//Value of member of object, invalid when absent (last one wins)
+
+			private:
+				friend class JsonReader;
+				const JsonReader *reader;
+				std::uint32_t index;
+				std::uint32_t limit;	//Index after last sibling (end of parent)
+
+				value(const JsonReader *reader, std::uint32_t index, std::uint32_t limit);
+		};
+
+	private:
+		class token {
+			public:
+				token_types::type type;
+				bool escaped;			//String with escape sequences
+				std::uint32_t offset;	//Of first byte (for strings, the one after opening quote)
+				std::uint32_t length;	//Bytes of value (for strings, content without quotes)
+				std::uint32_t end;		//Index of token after this value and its children
+		};
+
+		std::string_view document;
+		std::vector<token> tokens;
+		std::size_t errorOffset;
+		bool compactDocument;
+		bool repeatedKeys;		//Some object repeats a name
+		bool parsed;
+
+		//Parse of one value at position (whitespace before it already skipped); false when invalid
+		bool parseValue(std::size_t & position, std::size_t depth);
+		bool parseString(std::size_t & position, bool & escaped);
+		bool parseNumber(std::size_t & position);
+		bool parseLiteral(std::size_t & position, const char *literal, std::size_t length);
+		void skipWhitespace(std::size_t & position);
+		bool fail(std::size_t position);
+
+		//Names of members of object (unescaped) with index of their key token, sorted by name then index, appended to names
+		//(unescaped ones kept in unescaped); sortedNames keeps them per thread, valid until its next call
+		static void sortNames(const value & object, std::vector<std::pair<std::string_view, std::uint32_t>> & names, std::deque<std::string> & unescaped);
+		static const std::vector<std::pair<std::string_view, std::uint32_t>> & sortedNames(const value & object);
+		//Token indexes (sorted) of keys of object followed by another one of same name; empty when document has none
+		static void overriddenKeys(const value & object, std::vector<std::uint32_t> & overridden);
+		static bool overridden(const value & key, const std::vector<std::uint32_t> & overridden);
+
+		static void unescape(std::string_view content, std::string & output);
+		static bool isWhitespace(char c);
+		static int hexValue(char c);
+		static void appendUTF8(std::string & output, std::uint32_t codePoint);
+};
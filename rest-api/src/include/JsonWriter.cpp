@@ -0,0 +1,166 @@
+
+#include "JsonWriter.h"
+
+
+JsonWriter::JsonWriter() : afterKey(false) {}
+
+void JsonWriter::reset() {
+	output.clear();
+	scopeHasMembers.clear();
+	afterKey = false;
+}
+
+const std::string &JsonWriter::str() const {
+	return output;
+}
+
+void JsonWriter::separate() {
+	if (afterKey) {
+		afterKey = false;
+		return;
+	}
+	if (scopeHasMembers.empty())
+		return;
+	if (scopeHasMembers.back())
+		output += ',';
+	scopeHasMembers.back() = true;
+}
+
+JsonWriter &JsonWriter::beginObject() {
+	separate();
+	output += '{';
+	scopeHasMembers.push_back(false);
+	return *this;
+}
+
+JsonWriter &JsonWriter::endObject() {
+	output += '}';
+	scopeHasMembers.pop_back();
+	return *this;
+}
+
+JsonWriter &JsonWriter::beginArray() {
+	separate();
+	output += '[';
+	scopeHasMembers.push_back(false);
+	return *this;
+}
+
+JsonWriter &JsonWriter::endArray() {
+	output += ']';
+	scopeHasMembers.pop_back();
+	return *this;
+}
+
+JsonWriter &JsonWriter::key(std::string_view name) {
+	separate();
+	output += '"';
+	appendEscaped(output, name);
+	output += "\":";
+	afterKey = true;
+	return *this;
+}
+
+JsonWriter &JsonWriter::value(std::string_view text) {
+	separate();
+	output += '"';
+	appendEscaped(output, text);
+	output += '"';
+	return *this;
+}
+
+JsonWriter &JsonWriter::value(const char *text) {
+	return (text == nullptr) ? null() : value(std::string_view(text));
+}
+
+JsonWriter &JsonWriter::value(const std::string &text) {
+	return value(std::string_view(text));
+}
+
+JsonWriter &JsonWriter::value(bool flag) {
+	separate();
+	output += flag ? "true" : "false";
+	return *this;
+}
+
+JsonWriter &JsonWriter::value(int number)					{ return integer(number); }
+JsonWriter &JsonWriter::value(long number)					{ return integer(number); }
+JsonWriter &JsonWriter::value(long long number)				{ return integer(number); }
+JsonWriter &JsonWriter::value(unsigned number)				{ return integer(number); }
+JsonWriter &JsonWriter::value(unsigned long number)			{ return integer(number); }
+JsonWriter &JsonWriter::value(unsigned long long number)	{ return integer(number); }
+
+JsonWriter &JsonWriter::value(double number) {
+	if (!std::isfinite(number))
+		return null();
+
+	//Shortest representation that reads back to the same double
+	separate();
+	char digits[32];
+	std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), number);
+	output.append(digits, result.ptr);
+	return *this;
+}
+
+JsonWriter &JsonWriter::null() {
+	separate();
+	output += "null";
+	return *this;
+}
+
+JsonWriter &JsonWriter::raw(std::string_view json) {
+	separate();
+	output.append(json.data(), json.size());
+	return *this;
+}
+
+//Escape sequence of every byte below 0x20 plus '"' and '\\'
+const char *JsonWriter::escapeSequence(unsigned char c) {
+	static const char *const controls[32] = {
+		"\\u0000", "\\u0001", "\\u0002", "\\u0003", "\\u0004", "\\u0005", "\\u0006", "\\u0007",
+		"\\b",     "\\t",     "\\n",     "\\u000b", "\\f",     "\\r",     "\\u000e", "\\u000f",
+		"\\u0010", "\\u0011", "\\u0012", "\\u0013", "\\u0014", "\\u0015", "\\u0016", "\\u0017",
+		"\\u0018", "\\u0019", "\\u001a", "\\u001b", "\\u001c", "\\u001d", "\\u001e", "\\u001f"
+	};
+	if (c < 0x20)
+		return controls[c];
+	if (c == '"')
+		return "\\\"";
+	if (c == '\\')
+		return "\\\\";
+	return nullptr;
+}
+
+std::size_t JsonWriter::findEscape(const char *data, std::size_t position, std::size_t length) {
+#if defined(__SSE2__)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i lastControl = _mm_set1_epi8(0x1f);
+	for (; position + 16 <= length; position += 16) {
+		__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + position));
+		//Unsigned c <= 0x1f is max(c, 0x1f) == 0x1f (SSE2 only compares signed bytes, which would catch UTF-8 too)
+		__m128i control = _mm_cmpeq_epi8(_mm_max_epu8(chunk, lastControl), lastControl);
+		__m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+		int mask = _mm_movemask_epi8(_mm_or_si128(control, special));
+		if (mask != 0)
+			return position + __builtin_ctz(mask);
+	}
+#endif
+	for (; position < length; position++)
+		if (escapeSequence(static_cast<unsigned char>(data[position])) != nullptr)
+			return position;
+	return length;
+}
+
+void JsonWriter::appendEscaped(std::string &output, std::string_view text) {
+	const char *data = text.data();
+	std::size_t length = text.size(), position = 0;
+	while (position < length) {
+		std::size_t next = findEscape(data, position, length);
+		output.append(data + position, next - position);
+		if (next == length)
+			break;
+		output += escapeSequence(static_cast<unsigned char>(data[next]));
+		position = next + 1;
+	}
+}
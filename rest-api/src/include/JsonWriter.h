@@ -0,0 +1,79 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <cmath>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+//Streaming (SAX-like) JSON writer: values are serialized straight into output as they are written, no DOM involved
+//Commas and colons are placed by writer; caller is responsible for balancing begin/end calls and giving a key before
+//each value inside objects. Output buffer is kept between documents (reset() clears it without releasing memory),
+//so a long-lived writer (e.g. one per thread) stops allocating once its buffer reached the size of the largest document
+class JsonWriter {
+	public:
+		JsonWriter();
+
+		void reset();						//Starts a new document reusing buffer
+		const std::string & str() const;	//Document written so far
+
+		JsonWriter & beginObject();
+		JsonWriter & endObject();
+		JsonWriter & beginArray();
+		JsonWriter & endArray();
+		JsonWriter & key(std::string_view name);
+
+		JsonWriter & value(std::string_view text);
+		JsonWriter & value(const char *text);
+		JsonWriter & value(const std::string & text);
+		JsonWriter & value(bool flag);
+		JsonWriter & value(int number);
+		JsonWriter & value(long number);
+		JsonWriter & value(long long number);
+		JsonWriter & value(unsigned number);
+		JsonWriter & value(unsigned long number);
+		JsonWriter & value(unsigned long long number);
+		JsonWriter & value(double number);	//Non-finite numbers are written as null (JSON has no representation for them)
+		JsonWriter & null();
+		JsonWriter & raw(std::string_view json);	//Already serialized JSON value, copied as is
+
+		//Shorthand for key(name).value(v)
+		template<typename T>
+		JsonWriter & member(std::string_view name, const T & v) {
+			key(name);
+			return value(v);
+		}
+
+		//Appends text as the content of a JSON string (no quotes): '"', '\\' and control characters are escaped,
+		//everything else (UTF-8 included) is copied in bulk. Scan for characters to escape runs 16 bytes at a time with SSE2
+		static void appendEscaped(std::string & output, std::string_view text);
+
+		//Offset of first byte needing escape at or after position (length when there is none); inside a serialized string
+		//that is where its plain run ends (closing quote, escape sequence or invalid control character)
+		static std::size_t findEscape(const char *data, std::size_t position, std::size_t length);
+
+	private:
+		std::string output;
+		std::vector<bool> scopeHasMembers;	//One entry per open object/array
+		bool afterKey;
+
+		void separate();	//Comma before every value but the first of its scope (none right after a key)
+
+		static const char *escapeSequence(unsigned char c);	//nullptr when c is copied as is
+
+		template<typename T>
+		JsonWriter & integer(T number) {
+			separate();
+			char digits[24];
+			std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), number);
+			output.append(digits, result.ptr);
+			return *this;
+		}
+};
@@ -0,0 +1,75 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+
+
+//Minimal "{}" formatter writing into a caller buffer (never allocates, output is truncated at buffer end)
+//Accepts strings (std::string, std::string_view, const char*), chars, bools, integers and floating points
+class LogFormat {
+	public:
+		template <typename... Args>
+		static std::size_t format(char *buffer, std::size_t size, std::string_view pattern, const Args &... args) {
+			bool truncated = false;
+			return formatChecked(buffer, size, truncated, pattern, args...);
+		}
+
+		//Same, truncated set when output did not fit in buffer
+		template <typename... Args>
+		static std::size_t formatChecked(char *buffer, std::size_t size, bool & truncated, std::string_view pattern, const Args &... args) {
+			char *out = buffer;
+			formatNext(out, buffer + size, truncated, pattern, args...);
+			return out - buffer;
+		}
+
+	private:
+		static void formatNext(char *& out, char *end, bool & truncated, std::string_view pattern) {
+			write(out, end, truncated, pattern);
+		}
+
+		template <typename First, typename... Rest>
+		static void formatNext(char *& out, char *end, bool & truncated, std::string_view pattern, const First & first, const Rest &... rest) {
+			std::size_t placeholder = pattern.find("{}");
+			if (placeholder == std::string_view::npos) {
+				write(out, end, truncated, pattern);	//More arguments than placeholders, extra ones are ignored
+				return;
+			}
+			write(out, end, truncated, pattern.substr(0, placeholder));
+			writeArgument(out, end, truncated, first);
+			formatNext(out, end, truncated, pattern.substr(placeholder + 2), rest...);
+		}
+
+		static void write(char *& out, char *end, bool & truncated, std::string_view text) {
+			std::size_t length = std::min(text.size(), (std::size_t) (end - out));
+			std::memcpy(out, text.data(), length);
+			out += length;
+			truncated = truncated or (length < text.size());
+		}
+
+		template <typename T>
+		static void writeArgument(char *& out, char *end, bool & truncated, const T & argument) {
+			if constexpr (std::is_same<T, bool>::value)
+				write(out, end, truncated, argument ? "true" : "false");
+			else if constexpr (std::is_same<T, char>::value) {
+				if (out < end)
+					*out++ = argument;
+				else
+					truncated = true;
+			}
+			else if constexpr (std::is_arithmetic<T>::value) {
+				std::to_chars_result result = std::to_chars(out, end, argument);
+				truncated = truncated or (result.ec != std::errc());
+				out = (result.ec == std::errc()) ? result.ptr : end;
+			}
+			else if constexpr (std::is_enum<T>::value)
+				writeArgument(out, end, truncated, static_cast<typename std::underlying_type<T>::type>(argument));
+			else
+				write(out, end, truncated, std::string_view(argument));
+		}
+};
@@ -0,0 +1,82 @@
+
+#include "LogRingBuffer.h"
+
+
+LogRingBuffer::LogRingBuffer(std::size_t capacity) : enqueuePosition(0), dequeuePosition(0) {
+	std::size_t rounded = roundedCapacity(capacity);
+	records.reset(new record[rounded]);
+	mask = rounded - 1;
+	for (std::size_t i = 0; i < rounded; i++)
+		records[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+LogRingBuffer::record *LogRingBuffer::claim() {
+	std::size_t position = enqueuePosition.load(std::memory_order_relaxed);
+	while (true) {
+		record *cell = &records[position & mask];
+		std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		std::ptrdiff_t difference = (std::ptrdiff_t) sequence - (std::ptrdiff_t) position;
+
+		if (difference == 0) {
+			if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				cell->position = position;
+				return cell;
+			}
+		}
+		else if (difference < 0)
+			return nullptr;		//Full
+		else
+			position = enqueuePosition.load(std::memory_order_relaxed);
+	}
+}
+
+void LogRingBuffer::publish(record *claimed) {
+	claimed->sequence.store(claimed->position + 1, std::memory_order_release);
+}
+
+LogRingBuffer::record *LogRingBuffer::consume() {
+	std::size_t position = dequeuePosition.load(std::memory_order_relaxed);
+	while (true) {
+		record *cell = &records[position & mask];
+		std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+		std::ptrdiff_t difference = (std::ptrdiff_t) sequence - (std::ptrdiff_t) (position + 1);
+
+		if (difference == 0) {
+			if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+				cell->position = position;
+				return cell;
+			}
+		}
+		else if (difference < 0)
+			return nullptr;		//Empty (or next record still being formatted by its producer)
+		else
+			position = dequeuePosition.load(std::memory_order_relaxed);
+	}
+}
+
+void LogRingBuffer::release(record *consumed) {
+	consumed->sequence.store(consumed->position + mask + 1, std::memory_order_release);
+}
+
+bool LogRingBuffer::discardOldest() {
+	record *oldest = consume();
+	if (oldest == nullptr)
+		return false;
+	release(oldest);
+	return true;
+}
+
+std::size_t LogRingBuffer::capacity() const {
+	return mask + 1;
+}
+
+std::size_t LogRingBuffer::roundedCapacity(std::size_t capacity) {
+	std::size_t rounded = 2;
+	while (rounded < capacity)
+		rounded <<= 1;
+	return rounded;
+}
+
+bool LogRingBuffer::empty() const {
+	return dequeuePosition.load(std::memory_order_acquire) >= enqueuePosition.load(std::memory_order_acquire);
+}
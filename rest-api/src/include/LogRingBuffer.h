@@ -0,0 +1,49 @@
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+
+//Bounded lock-free queue of fixed-size log records (sequence numbered cells, as in D. Vyukov's MPMC queue)
+//Producers claim a cell, format straight into it and publish it, so no allocation happens per record
+//Any thread may consume, which is what allows a producer to discard the oldest record when buffer is full
+class LogRingBuffer {
+	public:
+		static const std::size_t RECORD_SIZE = 512;
+
+		class record {
+			public:
+				std::atomic<std::size_t> sequence;
+				std::size_t position;
+				std::uint32_t length;
+				char text[RECORD_SIZE];
+		};
+
+		explicit LogRingBuffer(std::size_t capacity);	//Rounded up to a power of 2
+
+		//Producer side: claim() returns nullptr when buffer is full, claimed record must be published
+		record *claim();
+		void publish(record *claimed);
+
+		//Consumer side: consume() returns nullptr when next record is not published yet, consumed record must be released
+		record *consume();
+		void release(record *consumed);
+
+		//Discards oldest published record (returns false if there was none ready)
+		bool discardOldest();
+
+		std::size_t capacity() const;
+		static std::size_t roundedCapacity(std::size_t capacity);	//Capacity a buffer built with capacity gets
+		bool empty() const;
+
+	private:
+		std::unique_ptr<record[]> records;
+		std::size_t mask;
+
+		//Kept in separate cache lines, producers and consumer hammer different ones
+		alignas(64) std::atomic<std::size_t> enqueuePosition;
+		alignas(64) std::atomic<std::size_t> dequeuePosition;
+};
@@ -3,14 +3,18 @@
 
 
 Logger *Logger::instance = nullptr;
-std::ofstream Logger::logFileStream;
+int Logger::logFileDescriptor = -1;
 
-Logger::Logger() { }
+Logger::Logger() : asyncPolicy(overflow_policies::policy::DROP_NEWEST), levelVerbosity(message_types::verbosity(message_types::type::DEBUG)), asyncEnabled(false), writerRunning(false), activeProducers(0), \
+	writtenRecords(0), writtenBatches(0), droppedNewest(0), droppedOldest(0), blockedProducers(0), \
+	maxFileSize(0), fileBytes(0), rotationRunning(false), rotations(0), compressedFiles(0), removedFiles(0), rotationFailures(0), \
+	binaryEnabled(false), crashRingEnabled(nullptr) { }
 
 Logger::~Logger() {
 	if (instance != nullptr) {
-		logFileStream << "Closing..." << std::endl;
-		logFileStream.close();
+		disableAsync();
+		writeFully("Closing...\n", 11);
+		::close(logFileDescriptor);
     }
 }
 
@@ -42,16 +46,592 @@ Logger *Logger::getLogger(std::string logFilenameInput) {
 				else												logFullname = logFolder + DateTimeUtils::currentDate()+".log";
 			}
 
+		instance->logFolder = logFolder;
+		instance->logFilename = (logFullname == logFolder + DateTimeUtils::currentDate() + ".log") ? "" : logFullname.substr(logFolder.size());
+		instance->logFullname = logFullname;
+		instance->logDate = DateTimeUtils::currentDate();
+
 		std::cout << ">> Logging at <" << logFullname << ">\n";
-		logFileStream.open(logFullname, std::fstream::app);
-		logFileStream << std::endl << std::endl;
+		logFileDescriptor = ::open(logFullname.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		struct stat status;
+		if (logFileDescriptor >= 0 and ::fstat(logFileDescriptor, &status) == 0)
+			instance->fileBytes = status.st_size;
+		writeFully("\n\n", 2);
 	}
 	return instance;
 }
 
 void Logger::log(std::string message, message_types::type type) {
-	std::string strMessageType;
-	logFileStream << DateTimeUtils::currentTime() << ": [" << message_types::to_string(type) << "]: " << message << std::endl;
+	if (!isEnabled(type))
+		return;
+
+	if (binaryEnabled.load(std::memory_order_acquire)) {
+		logBinary(type, std::string_view(MESSAGE_TEMPLATE), std::string_view(message));
+		return;
+	}
+	if (!asyncEnabled.load(std::memory_order_acquire)) {
+		//Sync mode: one write() per line (O_APPEND keeps concurrent lines from interleaving)
+		char prefix[PREFIX_MAX_LENGTH];
+		std::string line(prefix, formatPrefix(prefix, type));
+		line.append(message).push_back('\n');
+		copyToRing(line.data(), line.size(), false);
+		writeFully(line.data(), line.size());
+		return;
+	}
+
+	logRecord(type, message);
+}
+
+void Logger::setLevel(message_types::type level) {
+	levelVerbosity.store(message_types::verbosity(level), std::memory_order_relaxed);
+}
+
+Logger::message_types::type Logger::getLevel() const {
+	switch (levelVerbosity.load(std::memory_order_relaxed)) {
+		case 0:		return message_types::type::ERROR;
+		case 1:		return message_types::type::WARNING;
+		case 2:		return message_types::type::INFO;
+		default:	return message_types::type::DEBUG;
+	}
+}
+
+bool Logger::isEnabled(message_types::type type) const {
+	return message_types::verbosity(type) <= levelVerbosity.load(std::memory_order_relaxed);
+}
+
+void Logger::enableAsync(std::size_t capacity, overflow_policies::policy policy) {
+	if (asyncEnabled)
+		return;
+
+	//Buffer is empty and unused while async mode is off (disableAsync drained it), so it can be replaced
+	if (!asyncBuffer or asyncBuffer->capacity() != LogRingBuffer::roundedCapacity(capacity))
+		asyncBuffer.reset(new LogRingBuffer(capacity));
+	asyncPolicy = policy;
+
+	static bool exitHandlerRegistered = false;
+	if (!exitHandlerRegistered)
+		exitHandlerRegistered = (std::atexit(Logger::disableAsyncAtExit) == 0);
+
+	writerRunning = true;
+	writerThread = std::thread(&Logger::writerLoop, this);
+	asyncEnabled.store(true, std::memory_order_release);
+}
+
+void Logger::disableAsync() {
+	if (!asyncEnabled)
+		return;
+
+	//New records go straight to file from now on. Producers that saw async mode still on publish into buffer: they are
+	//waited for (both sides sequentially consistent, so each producer either sees mode off or is counted here), then
+	//writer drains what is left in buffer before leaving
+	asyncEnabled.store(false);
+	while (activeProducers.load() > 0)
+		std::this_thread::yield();
+	writerRunning = false;
+	if (writerThread.joinable())
+		writerThread.join();
+}
+
+Logger::async_stats Logger::getAsyncStats() const {
+	async_stats stats;
+	stats.writtenRecords = writtenRecords.load(std::memory_order_relaxed);
+	stats.writtenBatches = writtenBatches.load(std::memory_order_relaxed);
+	stats.droppedNewest = droppedNewest.load(std::memory_order_relaxed);
+	stats.droppedOldest = droppedOldest.load(std::memory_order_relaxed);
+	stats.blockedProducers = blockedProducers.load(std::memory_order_relaxed);
+	return stats;
+}
+
+LogRingBuffer::record *Logger::claimRecord() {
+	bool blocked = false;
+	LogRingBuffer::record *record;
+
+	while ((record = asyncBuffer->claim()) == nullptr) {
+		switch (asyncPolicy) {
+			case overflow_policies::policy::DROP_NEWEST:
+				droppedNewest.fetch_add(1, std::memory_order_relaxed);
+				return nullptr;
+			case overflow_policies::policy::DROP_OLDEST:
+				if (asyncBuffer->discardOldest())
+					droppedOldest.fetch_add(1, std::memory_order_relaxed);
+				else
+					std::this_thread::yield();
+				break;
+			case overflow_policies::policy::BLOCK:
+				if (!blocked) {
+					blocked = true;
+					blockedProducers.fetch_add(1, std::memory_order_relaxed);
+				}
+				std::this_thread::yield();
+		}
+	}
+	return record;
+}
+
+void Logger::writerLoop() {
+	const std::size_t batchCapacity = 64 * LogRingBuffer::RECORD_SIZE;
+	std::unique_ptr<char[]> batch(new char[batchCapacity]);
+	unsigned int idleRounds = 0;
+
+	while (true) {
+		bool stopping = !writerRunning.load(std::memory_order_acquire);
+
+		std::size_t batchSize = 0, batchRecords = 0;
+		LogRingBuffer::record *record;
+		while (batchSize + LogRingBuffer::RECORD_SIZE <= batchCapacity and (record = asyncBuffer->consume()) != nullptr) {
+			std::memcpy(batch.get() + batchSize, record->text, record->length);
+			batchSize += record->length;
+			batchRecords++;
+			asyncBuffer->release(record);
+		}
+
+		if (batchSize > 0) {
+			if (binaryEnabled.load(std::memory_order_relaxed))
+				appendBinary(batch.get(), batchSize);
+			else
+				writeFully(batch.get(), batchSize);
+			writtenRecords.fetch_add(batchRecords, std::memory_order_relaxed);
+			writtenBatches.fetch_add(1, std::memory_order_relaxed);
+			idleRounds = 0;
+			continue;
+		}
+
+		//Leaves only once records claimed before stop request were published and written
+		if (stopping and asyncBuffer->empty())
+			break;
+
+		//Idle backoff: 50us doubling up to 1ms
+		std::this_thread::sleep_for(std::chrono::microseconds(std::min(50u << std::min(idleRounds, 5u), 1000u)));
+		idleRounds++;
+	}
+}
+
+void Logger::writeFully(const char *data, std::size_t size) {
+	if (instance != nullptr)
+		instance->countWritten(size);
+	while (size > 0) {
+		ssize_t written = ::write(logFileDescriptor, data, size);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return;		//Nothing sensible to do if log file is not writable
+		}
+		data += written;
+		size -= written;
+	}
+}
+
+std::size_t Logger::formatPrefix(char *buffer, message_types::type type) {
+	//"HH.MM.SS: [TYPE ]: "
+	std::size_t length = DateTimeUtils::formatTimeInto(buffer);
+	std::string typeText = message_types::to_string(type);
+
+	std::memcpy(buffer + length, ": [", 3);
+	length += 3;
+	std::memcpy(buffer + length, typeText.data(), typeText.size());
+	length += typeText.size();
+	std::memcpy(buffer + length, "]: ", 3);
+	return length + 3;
+}
+
+void Logger::countWritten(std::size_t size) {
+	//Only the write crossing the cap wakes rotation thread (if it misses the wake-up, it checks again within a second)
+	std::uint64_t before = fileBytes.fetch_add(size, std::memory_order_relaxed);
+	std::size_t limit = maxFileSize.load(std::memory_order_relaxed);
+	if (limit > 0 and before < limit and before + size >= limit)
+		rotationCondition.notify_one();
+}
+
+void Logger::setRotationConfig(const rotation_config &config) {
+	std::lock_guard<std::mutex> lock(rotationMutex);
+	rotationConfig = config;
+	maxFileSize.store(config.maxFileSize, std::memory_order_relaxed);
+	if (rotationRunning)
+		return;
+
+	//Rotated files left uncompressed by a previous run (stopped while compressing) are compressed first
+	boost::system::error_code error;
+	for (boost::filesystem::directory_iterator file(logFolder, error), end; !error and file != end; file.increment(error))
+		if (isRotatedName(file->path().filename().string()) and file->path().extension() != ".gz")
+			pendingCompression.push_back(file->path().string());
+
+	static bool exitHandlerRegistered = false;
+	if (!exitHandlerRegistered)
+		exitHandlerRegistered = (std::atexit(Logger::stopRotationAtExit) == 0);
+
+	rotationRunning = true;
+	rotationThread = std::thread(&Logger::rotationLoop, this);
+	compressionThread = std::thread(&Logger::compressionLoop, this);
+}
+
+Logger::rotation_config Logger::getRotationConfig() {
+	std::lock_guard<std::mutex> lock(rotationMutex);
+	return rotationConfig;
+}
+
+Logger::rotation_stats Logger::getRotationStats() const {
+	rotation_stats stats;
+	stats.rotations = rotations.load(std::memory_order_relaxed);
+	stats.compressedFiles = compressedFiles.load(std::memory_order_relaxed);
+	stats.removedFiles = removedFiles.load(std::memory_order_relaxed);
+	stats.failures = rotationFailures.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void Logger::rotationLoop() {
+	std::unique_lock<std::mutex> lock(rotationMutex);
+	while (rotationRunning) {
+		rotationCondition.wait_for(lock, std::chrono::seconds(1));
+		if (!rotationRunning)
+			break;
+
+		bool dateChanged = rotationConfig.daily and DateTimeUtils::currentDate() != logDate;
+		bool sizeReached = rotationConfig.maxFileSize > 0 and fileBytes.load(std::memory_order_relaxed) >= rotationConfig.maxFileSize;
+		if (dateChanged or sizeReached)
+			rotate();
+	}
+}
+
+void Logger::rotate() {
+	//Called with rotationMutex held. Until dup2, writes keep going to the file being rotated (renamed or not, it is the same
+	//open file); after it, to the new one. Descriptor number never changes, so no write can hit a closed descriptor
+	std::string rotatedName = logFullname + rotationSuffix();
+	while (::access(rotatedName.c_str(), F_OK) == 0 or ::access((rotatedName + ".gz").c_str(), F_OK) == 0) {
+		//Rotated twice within a millisecond: renaming would overwrite the previous file before it is compressed
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		rotatedName = logFullname + rotationSuffix();
+	}
+	std::string date = DateTimeUtils::currentDate();
+	bool binary = binaryEnabled.load(std::memory_order_relaxed);
+	std::string nextFullname = logFolder + (logFilename.empty() ? date + (binary ? ".blog" : ".log") : logFilename);
+
+	if (binary) {
+		if (!reopenBinary(rotatedName, nextFullname)) {
+			rotationFailures.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+	else {
+		if (::rename(logFullname.c_str(), rotatedName.c_str()) != 0) {
+			rotationFailures.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		int next = ::open(nextFullname.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (next < 0 or ::dup2(next, logFileDescriptor) < 0) {
+			if (next >= 0)
+				::close(next);
+			::rename(rotatedName.c_str(), logFullname.c_str());	//Keeps writing where it was, retried on next check
+			rotationFailures.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		::close(next);
+	}
+
+	fileBytes.store(0, std::memory_order_relaxed);
+	logFullname = nextFullname;
+	logDate = date;
+	rotations.fetch_add(1, std::memory_order_relaxed);
+
+	pendingCompression.push_back(rotatedName);
+	compressionCondition.notify_one();
+}
+
+void Logger::compressionLoop() {
+	std::unique_lock<std::mutex> lock(rotationMutex);
+	while (true) {
+		compressionCondition.wait(lock, [this] { return !rotationRunning or !pendingCompression.empty(); });
+		if (!rotationRunning)
+			break;
+
+		std::string path = pendingCompression.front();
+		pendingCompression.pop_front();
+		int level = rotationConfig.compressionLevel;
+		std::size_t retainedFiles = rotationConfig.retainedFiles;
+
+		lock.unlock();	//Rotations go on while compressing
+		if (level > 0) {
+			if (compressFile(path, level))
+				compressedFiles.fetch_add(1, std::memory_order_relaxed);
+			else
+				rotationFailures.fetch_add(1, std::memory_order_relaxed);
+		}
+		if (retainedFiles > 0)
+			removeOldFiles(retainedFiles);
+		lock.lock();
+	}
+}
+
+bool Logger::compressFile(const std::string &path, int level, bool stopWithRotation) {
+	//Written aside and renamed, so a compression cut short (e.g. by exit) leaves the plain file only
+	std::string compressedPath = path + ".gz";
+	std::string temporaryPath = compressedPath + ".tmp";
+	int input = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (input < 0)
+		return false;
+	gzFile output = gzopen(temporaryPath.c_str(), ("wb" + std::to_string(std::min(level, 9))).c_str());
+	if (output == nullptr) {
+		::close(input);
+		return false;
+	}
+
+	std::vector<char> buffer(1 << 16);
+	bool completed = true;
+	ssize_t length;
+	while ((length = ::read(input, buffer.data(), buffer.size())) != 0) {
+		if (length < 0 and errno == EINTR)
+			continue;
+		if (length < 0 or gzwrite(output, buffer.data(), length) != length or (stopWithRotation and !rotationRunning)) {
+			completed = false;
+			break;
+		}
+	}
+	::close(input);
+	completed = (gzclose(output) == Z_OK) and completed;
+
+	if (!completed or ::rename(temporaryPath.c_str(), compressedPath.c_str()) != 0) {
+		::unlink(temporaryPath.c_str());
+		return false;
+	}
+	::unlink(path.c_str());
+	return true;
+}
+
+void Logger::removeOldFiles(std::size_t retainedFiles) {
+	//Rotated files of every day (compressed or not), oldest first: their suffix sorts as time
+	std::vector<std::pair<std::string, boost::filesystem::path>> rotated;
+	boost::system::error_code error;
+	for (boost::filesystem::directory_iterator file(logFolder, error), end; !error and file != end; file.increment(error)) {
+		std::string name = file->path().filename().string();
+		if (!isRotatedName(name))
+			continue;
+		std::string stem = (name.size() > 3 and name.compare(name.size() - 3, 3, ".gz") == 0) ? name.substr(0, name.size() - 3) : name;
+		rotated.emplace_back(stem.substr(stem.size() - 19), file->path());
+	}
+	if (rotated.size() <= retainedFiles)
+		return;
+
+	std::sort(rotated.begin(), rotated.end());
+	for (std::size_t i = 0; i < rotated.size() - retainedFiles; i++)
+		if (boost::filesystem::remove(rotated[i].second, error))
+			removedFiles.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool Logger::isRotatedName(const std::string &name) {
+	//"<file>.YYYYMMDD-HHMMSS-mmm", optionally ".gz"
+	std::size_t end = (name.size() > 3 and name.compare(name.size() - 3, 3, ".gz") == 0) ? name.size() - 3 : name.size();
+	if (end < 21 or name[end - 20] != '.')
+		return false;
+	for (std::size_t i = end - 19; i < end; i++) {
+		bool separator = (i == end - 11 or i == end - 4);
+		if (separator ? (name[i] != '-') : !std::isdigit((unsigned char) name[i]))
+			return false;
+	}
+	return true;
+}
+
+std::string Logger::rotationSuffix() {
+	std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+	std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+	long millis = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+	std::tm local;
+	localtime_r(&seconds, &local);
+
+	char suffix[32];
+	std::size_t length = std::strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &local);
+	std::snprintf(suffix + length, sizeof(suffix) - length, "-%03ld", millis);
+	return suffix;
+}
+
+void Logger::stopRotationAtExit() {
+	if (instance == nullptr)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(instance->rotationMutex);
+		if (!instance->rotationRunning)
+			return;
+		instance->rotationRunning = false;
+	}
+	instance->rotationCondition.notify_all();
+	instance->compressionCondition.notify_all();
+	instance->rotationThread.join();
+	instance->compressionThread.join();
+}
+
+void Logger::enableBinary() {
+	if (binaryEnabled)
+		return;
+
+	//Text records still buffered are written first (as text), async mode goes on afterwards with binary ones
+	bool wasAsync = asyncEnabled;
+	disableAsync();
+
+	std::lock_guard<std::mutex> rotationLock(rotationMutex);
+	std::string binaryFullname = logFullname;
+	if (binaryFullname.size() > 4 and binaryFullname.compare(binaryFullname.size() - 4, 4, ".log") == 0)
+		binaryFullname.resize(binaryFullname.size() - 4);
+	binaryFullname += ".blog";
+	{
+		std::lock_guard<std::mutex> templateLock(templateMutex);
+		std::lock_guard<std::mutex> appendLock(appendMutex);
+		openBinary(binaryFullname);
+	}
+	logFullname = binaryFullname;
+	if (!logFilename.empty())
+		logFilename = binaryFullname.substr(logFolder.size());
+	fileBytes = binaryFile.size();
+
+	static bool exitHandlerRegistered = false;
+	if (!exitHandlerRegistered)
+		exitHandlerRegistered = (std::atexit(Logger::closeBinaryAtExit) == 0);
+
+	binaryEnabled.store(true, std::memory_order_release);
+	if (wasAsync)
+		enableAsync(asyncBuffer->capacity(), asyncPolicy);
+}
+
+bool Logger::isBinary() const {
+	return binaryEnabled.load(std::memory_order_relaxed);
+}
+
+void Logger::openBinary(const std::string &path) {
+	binaryFile.open(path);
+	if (binaryFile.size() == 0)
+		binaryFile.append(BinaryLogFormat::MAGIC, BinaryLogFormat::MAGIC_SIZE);
+	else if (binaryFile.size() < BinaryLogFormat::MAGIC_SIZE or std::memcmp(binaryFile.data(), BinaryLogFormat::MAGIC, BinaryLogFormat::MAGIC_SIZE) != 0) {
+		binaryFile.close();
+		throw std::runtime_error(path + " is not a binary log");
+	}
+	else	//Left open by a previous run: zeroed or torn tail dropped
+		binaryFile.truncate(BinaryLogFormat::MAGIC_SIZE + BinaryLogFormat::validLength(binaryFile.data() + BinaryLogFormat::MAGIC_SIZE, \
+			binaryFile.size() - BinaryLogFormat::MAGIC_SIZE));
+
+	//Every file holds the patterns its records refer to
+	char encoded[LogRingBuffer::RECORD_SIZE];
+	for (std::uint32_t id = 0; id < templates.size(); id++)
+		binaryFile.append(encoded, BinaryLogFormat::encodeTemplate(encoded, sizeof(encoded), id, templates[id]));
+}
+
+bool Logger::reopenBinary(const std::string &rotatedName, const std::string &nextFullname) {
+	//Writers wait for the swap (a close, a rename and an open); producers of async mode never do
+	std::lock_guard<std::mutex> templateLock(templateMutex);
+	std::lock_guard<std::mutex> appendLock(appendMutex);
+	binaryFile.close();
+	if (::rename(logFullname.c_str(), rotatedName.c_str()) != 0) {
+		openBinary(logFullname);
+		return false;
+	}
+	try {
+		openBinary(nextFullname);
+	}
+	catch (const std::exception &) {
+		::rename(rotatedName.c_str(), logFullname.c_str());
+		openBinary(logFullname);
+		return false;
+	}
+	return true;
+}
+
+void Logger::appendBinary(const char *data, std::size_t size) {
+	std::lock_guard<std::mutex> lock(appendMutex);
+	if (!binaryFile.isOpen())
+		return;
+	countWritten(size);
+	try {
+		binaryFile.append(data, size);
+	}
+	catch (const std::system_error &) {}	//Nothing sensible to do if log file cannot grow
+}
+
+std::uint32_t Logger::templateIdOf(std::string_view pattern) {
+	thread_local std::unordered_map<const char *, std::uint32_t> knownIds;
+	auto known = knownIds.find(pattern.data());
+	if (known != knownIds.end())
+		return known->second;
+
+	std::lock_guard<std::mutex> templateLock(templateMutex);
+	auto registered = templateIds.find(pattern.data());
+	if (registered == templateIds.end()) {
+		//Written to file right away (not through async buffer, where it could be dropped), so before any record using it
+		std::uint32_t id = templates.size();
+		registered = templateIds.emplace(pattern.data(), id).first;
+		templates.push_back(pattern);
+
+		char encoded[LogRingBuffer::RECORD_SIZE];
+		appendBinary(encoded, BinaryLogFormat::encodeTemplate(encoded, sizeof(encoded), id, pattern));
+	}
+	knownIds.emplace(pattern.data(), registered->second);
+	return registered->second;
+}
+
+std::string Logger::enableCrashRing(std::size_t slotCount) {
+	if (crashRing)
+		return "";
+
+	//Same name on every start (a dated one would miss rings of runs started on other days)
+	std::lock_guard<std::mutex> lock(rotationMutex);
+	std::string ringName = logFilename.empty() ? "crash" : logFilename;
+	for (const char *extension : {".log", ".blog"})
+		if (ringName.size() > std::strlen(extension) and \
+				ringName.compare(ringName.size() - std::strlen(extension), std::strlen(extension), extension) == 0) {
+			ringName.resize(ringName.size() - std::strlen(extension));
+			break;
+		}
+	std::string ringFullname = logFolder + ringName + ".ring";
+
+	//Renamed as a rotated file, so retention counts it; compressed here rather than by rotation, so name returned is final
+	std::unique_ptr<MappedLogRing> ring(new MappedLogRing());
+	std::string preserved = ring->open(ringFullname, slotCount, rotationSuffix());
+	crashRing = std::move(ring);
+	if (!preserved.empty() and rotationConfig.compressionLevel > 0) {
+		if (compressFile(preserved, rotationConfig.compressionLevel, false)) {
+			compressedFiles.fetch_add(1, std::memory_order_relaxed);
+			preserved += ".gz";
+		}
+		else
+			rotationFailures.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	static bool exitHandlerRegistered = false;
+	if (!exitHandlerRegistered)
+		exitHandlerRegistered = (std::atexit(Logger::markRingCleanAtExit) == 0);
+
+	crashRingEnabled.store(crashRing.get(), std::memory_order_release);
+	return preserved;
+}
+
+std::size_t Logger::renderBinary(const BinaryLogFormat::header &h, const char *payload, const std::vector<std::string> &templates, char *line, std::size_t size) {
+	//Same layout and truncation as formatRecord
+	std::time_t seconds = h.timestamp / 1000000000ULL;
+	std::tm local;
+	localtime_r(&seconds, &local);
+	std::size_t length = std::strftime(line, DateTimeUtils::TIME_LENGTH + 1, "%H.%M.%S", &local);
+
+	length += LogFormat::format(line + length, size - 1 - length, ": [{}]: ", message_types::to_string((message_types::type) h.level));
+	if (h.templateId < templates.size())
+		length += BinaryLogFormat::render(h, payload, templates[h.templateId], line + length, size - 1 - length);
+	else
+		length += LogFormat::format(line + length, size - 1 - length, "<unknown pattern {}>", h.templateId);
+	line[length] = '\n';
+	return length + 1;
+}
+
+void Logger::markRingCleanAtExit() {
+	if (instance != nullptr and instance->crashRing)
+		instance->crashRing->markClean();
+}
+
+void Logger::closeBinaryAtExit() {
+	if (instance == nullptr)
+		return;
+	instance->disableAsync();	//Buffered records written first
+	stopRotationAtExit();
+	std::lock_guard<std::mutex> lock(instance->appendMutex);
+	instance->binaryFile.close();	//Trimmed to records written (later ones are dropped)
+}
+
+void Logger::disableAsyncAtExit() {
+	if (instance != nullptr)
+		instance->disableAsync();
 }
 
 std::string Logger::message_types::to_string(type t) {
@@ -62,4 +642,13 @@ std::string Logger::message_types::to_string(type t) {
 		case type::DEBUG:		return "DEBUG";
 	}
 	return "DEBUG";
-}
\ No newline at end of file
+}
+
+std::string Logger::overflow_policies::to_string(policy p) {
+	switch (p) {
+		case policy::BLOCK:			return "block"; break;
+		case policy::DROP_NEWEST:	return "drop-newest"; break;
+		case policy::DROP_OLDEST:	return "drop-oldest";
+	}
+	return "drop-newest";
+}
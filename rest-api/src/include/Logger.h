@@ -2,18 +2,55 @@
 #pragma once
 
 #include <iostream>
-#include <fstream>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <cctype>
+#include <cstdio>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
 #include <boost/filesystem.hpp>
 #include <boost/dll/runtime_symbol_info.hpp>
 
 #include "DateTimeUtils.h"
+#include "LogRingBuffer.h"
+#include "LogFormat.h"
+#include "BinaryLogFormat.h"
+#include "MappedAppendFile.h"
+#include "MappedLogRing.h"
+
+
+//Least important level kept in binary by templated log (0 ERROR, 1 WARNING, 2 INFO, 3 DEBUG)
+//Release builds (NDEBUG) compile DEBUG calls away unless this is defined otherwise
+#ifndef LOGGER_COMPILED_LEVEL
+	#ifdef NDEBUG
+		#define LOGGER_COMPILED_LEVEL 2
+	#else
+		#define LOGGER_COMPILED_LEVEL 3
+	#endif
+#endif
 
 
 class Logger {
 	private:
 		static Logger *instance;
-		static std::ofstream logFileStream;
-		
+		static int logFileDescriptor;
+
 		Logger();
 		~Logger();
 
@@ -23,9 +60,246 @@ class Logger {
 			public:
 				enum class type {INFO, ERROR, WARNING, DEBUG};
 				static std::string to_string(type t);
+				static constexpr int verbosity(type t) {
+					return (t == type::ERROR) ? 0 : (t == type::WARNING) ? 1 : (t == type::INFO) ? 2 : 3;
+				}
+		};
+
+		//What a producer does when async buffer is full
+		class overflow_policies {
+			public:
+				enum class policy {BLOCK, DROP_NEWEST, DROP_OLDEST};
+				static std::string to_string(policy p);
+		};
+
+		class async_stats {
+			public:
+				std::uint64_t writtenRecords;
+				std::uint64_t writtenBatches;
+				std::uint64_t droppedNewest;	//Discarded by producer (policy DROP_NEWEST)
+				std::uint64_t droppedOldest;	//Evicted from buffer (policy DROP_OLDEST)
+				std::uint64_t blockedProducers;	//Producers that had to wait for room (policy BLOCK)
+		};
+
+		//Current file is closed and a new one started when date changes (daily) or when it reaches maxFileSize; rotated files
+		//are renamed "<file>.<YYYYMMDD-HHMMSS-mmm>" and gzip compressed on a background thread, keeping newest retainedFiles
+		class rotation_config {
+			public:
+				bool daily = true;
+				std::size_t maxFileSize = 0;		//Bytes, 0 = no size cap
+				std::size_t retainedFiles = 14;		//Rotated files kept in log folder (newest ones), 0 = all of them
+				int compressionLevel = 6;			//gzip level of rotated files, 0 = left uncompressed
+		};
+
+		class rotation_stats {
+			public:
+				std::uint64_t rotations;
+				std::uint64_t compressedFiles;
+				std::uint64_t removedFiles;		//By retention
+				std::uint64_t failures;			//Rotations or compressions that failed (file kept as it was)
 		};
 
 		static Logger *getLogger(std::string logFilenameInput = "default.log");
-		void log(std::string message, message_types::type type = message_types::type::INFO);		
-};
+		void log(std::string message, message_types::type type = message_types::type::INFO);
+
+		//Level checked before anything is formatted, message formatted straight into its record (no allocation)
+		//Usage: log<Logger::message_types::type::DEBUG>("GET for path <{}>", path)
+		//Arguments are still evaluated by caller when level is off (compiled away or not): guard costly ones with enabled<Type>()
+		template <message_types::type Type, std::size_t N, typename... Args>
+		void log(const char (&pattern)[N], const Args &... args) {
+			if constexpr (message_types::verbosity(Type) <= LOGGER_COMPILED_LEVEL) {
+				if (isEnabled(Type))
+					logRecord(Type, std::string_view(pattern, N - 1), args...);
+			}
+		}
+
+		//Runtime minimum level: messages less important than it are skipped
+		void setLevel(message_types::type level);
+		message_types::type getLevel() const;
+		bool isEnabled(message_types::type type) const;
+
+		//Compiled and runtime level check, for skipping the arguments of a log<Type> call too:
+		//if (logger->enabled<DEBUG>()) logger->log<DEBUG>("GET for path <{}>", message.request_uri().path())
+		template <message_types::type Type>
+		bool enabled() const {
+			if constexpr (message_types::verbosity(Type) <= LOGGER_COMPILED_LEVEL)
+				return isEnabled(Type);
+			else
+				return false;
+		}
+
+		//Async mode moves file writes to a writer thread (one write() per batch of records)
+		//Enable it at startup, before logging from concurrent threads; capacity applies when buffer is (re)created
+		void enableAsync(std::size_t capacity = 8192, overflow_policies::policy policy = overflow_policies::policy::DROP_NEWEST);
+		void disableAsync();	//Waits for producers already past the mode check, writes pending records, stops writer
+		async_stats getAsyncStats() const;
+
+		//Starts rotation thread on first call, later calls change config (e.g. on config reload). Rotation swaps the file
+		//behind descriptor of log with dup2, so neither producers nor async writer ever wait for it; writes only count bytes
+		void setRotationConfig(const rotation_config & config);
+		rotation_config getRotationConfig();
+		rotation_stats getRotationStats() const;
 
+		//Binary mode: records are encoded as header plus raw arguments (see BinaryLogFormat), no text formatting at all,
+		//and appended to a memory-mapped file next to the text one ("<name>.blog"), rendered back to text by logdecode
+		//Patterns get an id on first use (per thread lookup by address of pattern), their text is written to file once
+		//Enable it at startup; throws std::system_error when file cannot be opened, std::runtime_error when an existing
+		//file is not a binary log
+		void enableBinary();
+		bool isBinary() const;
+
+		//Crash ring: every record is also copied by its producer into a mapped ring file in log folder ("crash.ring", or
+		//"<name>.ring" when log has a fixed name; last slotCount records), which outlives a crash of the process (logextract
+		//reads it back). A ring left by a run that did not exit normally is renamed "<ring>.<YYYYMMDD-HHMMSS-mmm>" first,
+		//gzipped right away unless rotation config has compression off, and kept as rotated files are (retention);
+		//returns its final name (empty when there was none)
+		//Enable it at startup; throws std::system_error when ring cannot be created
+		std::string enableCrashRing(std::size_t slotCount = 1 << 15);
+
+		//Line of a binary record as text mode would have written it, "HH.MM.SS: [TYPE ]: message\n" (patterns by id,
+		//as found in TEMPLATE records); for tools reading binary logs and crash rings
+		static std::size_t renderBinary(const BinaryLogFormat::header & h, const char *payload, const std::vector<std::string> & templates, \
+			char *line, std::size_t size);
+
+	private:
+		std::unique_ptr<LogRingBuffer> asyncBuffer;
+		overflow_policies::policy asyncPolicy;
+		std::atomic<int> levelVerbosity;
+		std::atomic<bool> asyncEnabled;
+		std::atomic<bool> writerRunning;
+		std::thread writerThread;
+		std::atomic<std::size_t> activeProducers;	//Between mode check and publish, waited for by disableAsync
+
+		//Counts a producer for as long as it is alive
+		class producer_guard {
+			public:
+				explicit producer_guard(std::atomic<std::size_t> & counter) : count(counter) { count.fetch_add(1); }
+				~producer_guard() { count.fetch_sub(1, std::memory_order_release); }
+			private:
+				std::atomic<std::size_t> & count;
+		};
+
+		std::atomic<std::uint64_t> writtenRecords;
+		std::atomic<std::uint64_t> writtenBatches;
+		std::atomic<std::uint64_t> droppedNewest;
+		std::atomic<std::uint64_t> droppedOldest;
+		std::atomic<std::uint64_t> blockedProducers;
+
+		//Rotation: checked once per second by rotation thread, or right away when a write crosses maxFileSize
+		std::string logFolder;
+		std::string logFilename;		//As given, empty = dated (one file per day)
+		std::string logFullname;		//Of current file
+		std::string logDate;			//When current file was opened
+		std::mutex rotationMutex;		//Never taken by writes
+		std::condition_variable rotationCondition;
+		std::condition_variable compressionCondition;
+		rotation_config rotationConfig;
+		std::atomic<std::size_t> maxFileSize;
+		std::atomic<std::uint64_t> fileBytes;	//Written to current file
+		std::atomic<bool> rotationRunning;	//Changed under rotationMutex, also read by compression while unlocked
+		std::thread rotationThread;
+		std::thread compressionThread;
+		std::deque<std::string> pendingCompression;	//Rotated files not compressed yet
+
+		std::atomic<std::uint64_t> rotations;
+		std::atomic<std::uint64_t> compressedFiles;
+		std::atomic<std::uint64_t> removedFiles;
+		std::atomic<std::uint64_t> rotationFailures;
+
+		//Binary mode: appends (one per batch of async writer, one per record in sync mode) serialized by appendMutex
+		static constexpr const char *MESSAGE_TEMPLATE = "{}";	//Of log(std::string)
+		std::atomic<bool> binaryEnabled;
+		std::mutex appendMutex;
+		MappedAppendFile binaryFile;
+		std::mutex templateMutex;		//Taken before appendMutex when both are needed
+		std::unordered_map<const char *, std::uint32_t> templateIds;
+		std::vector<std::string_view> templates;	//By id (patterns are literals, alive as long as the program)
+
+		std::unique_ptr<MappedLogRing> crashRing;		//Never unmapped while running (producers hold no reference to it)
+		std::atomic<MappedLogRing *> crashRingEnabled;
+
+		LogRingBuffer::record *claimRecord();
+		void writerLoop();
+		void countWritten(std::size_t size);
+		void rotationLoop();
+		void compressionLoop();
+		void rotate();
+		void removeOldFiles(std::size_t retainedFiles);
+		bool compressFile(const std::string & path, int level, bool stopWithRotation = true);	//Gives up when rotation stops (exit)
+		static bool isRotatedName(const std::string & name);
+		static std::string rotationSuffix();		//".YYYYMMDD-HHMMSS-mmm" of now
+		static void stopRotationAtExit();
+		bool reopenBinary(const std::string & rotatedName, const std::string & nextFullname);	//With rotationMutex held
+		void openBinary(const std::string & path);	//With templateMutex and appendMutex held
+		void appendBinary(const char *data, std::size_t size);
+		std::uint32_t templateIdOf(std::string_view pattern);
+		static void closeBinaryAtExit();
+		static void markRingCleanAtExit();
+
+		void copyToRing(const char *data, std::size_t size, bool binary) {
+			if (MappedLogRing *ring = crashRingEnabled.load(std::memory_order_acquire))
+				ring->write(data, size, binary);
+		}
+		static void writeFully(const char *data, std::size_t size);
+		static const std::size_t PREFIX_MAX_LENGTH = DateTimeUtils::TIME_LENGTH + 16;
+		static std::size_t formatPrefix(char *buffer, message_types::type type);
+
+		template <typename... Args>
+		void logRecord(message_types::type type, std::string_view pattern, const Args &... args) {
+			if (binaryEnabled.load(std::memory_order_acquire)) {
+				logBinary(type, pattern, args...);
+				return;
+			}
+			producer_guard producer(activeProducers);
+			if (!asyncEnabled.load()) {
+				thread_local char line[LogRingBuffer::RECORD_SIZE];
+				std::size_t length = formatRecord(line, sizeof(line), type, pattern, args...);
+				copyToRing(line, length, false);
+				writeFully(line, length);
+				return;
+			}
+
+			LogRingBuffer::record *record = claimRecord();
+			if (record == nullptr)
+				return;
+			record->length = formatRecord(record->text, sizeof(record->text), type, pattern, args...);
+			copyToRing(record->text, record->length, false);
+			asyncBuffer->publish(record);
+		}
+
+		template <typename... Args>
+		void logBinary(message_types::type type, std::string_view pattern, const Args &... args) {
+			std::uint32_t templateId = templateIdOf(pattern);
+			std::uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+			producer_guard producer(activeProducers);
+			if (!asyncEnabled.load()) {
+				thread_local char encoded[LogRingBuffer::RECORD_SIZE];
+				std::size_t length = BinaryLogFormat::encode(encoded, sizeof(encoded), (std::uint8_t) type, templateId, timestamp, args...);
+				copyToRing(encoded, length, true);
+				appendBinary(encoded, length);
+				return;
+			}
+
+			LogRingBuffer::record *record = claimRecord();
+			if (record == nullptr)
+				return;
+			record->length = BinaryLogFormat::encode(record->text, sizeof(record->text), (std::uint8_t) type, templateId, timestamp, args...);
+			copyToRing(record->text, record->length, true);
+			asyncBuffer->publish(record);
+		}
+
+		//"HH.MM.SS: [TYPE ]: message\n", message truncated to fit in size and then ending in TRUNCATION_MARK
+		static constexpr const char *TRUNCATION_MARK = "[...]";
+		static const std::size_t TRUNCATION_MARK_LENGTH = 5;
+		template <typename... Args>
+		static std::size_t formatRecord(char *buffer, std::size_t size, message_types::type type, std::string_view pattern, const Args &... args) {
+			bool truncated = false;
+			std::size_t length = formatPrefix(buffer, type);
+			length += LogFormat::formatChecked(buffer + length, size - 1 - length, truncated, pattern, args...);
+			if (truncated)	//Buffer is full: mark replaces its tail
+				std::memcpy(buffer + length - TRUNCATION_MARK_LENGTH, TRUNCATION_MARK, TRUNCATION_MARK_LENGTH);
+			buffer[length] = '\n';
+			return length + 1;
+		}
+		static void disableAsyncAtExit();
+};
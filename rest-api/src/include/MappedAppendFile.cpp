@@ -0,0 +1,85 @@
+
+#include "MappedAppendFile.h"
+
+
+MappedAppendFile::MappedAppendFile() : descriptor(-1), mapping(nullptr), mappedSize(0), length(0) {}
+
+MappedAppendFile::~MappedAppendFile() {
+	close();
+}
+
+void MappedAppendFile::open(const std::string &path) {
+	close();
+	descriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (descriptor < 0)
+		throw std::system_error(errno, std::generic_category(), "open " + path);
+
+	struct stat status;
+	if (::fstat(descriptor, &status) != 0) {
+		int error = errno;
+		::close(descriptor);
+		descriptor = -1;
+		throw std::system_error(error, std::generic_category(), "fstat " + path);
+	}
+	length = status.st_size;
+	try {
+		grow(length + 1);
+	}
+	catch (const std::system_error &) {
+		::close(descriptor);
+		descriptor = -1;
+		throw;
+	}
+}
+
+void MappedAppendFile::close() {
+	if (descriptor < 0)
+		return;
+	if (mapping != nullptr)
+		::munmap(mapping, mappedSize);
+	if (::ftruncate(descriptor, length) != 0) {}	//Zeroed tail is ignored by readers anyway
+	::close(descriptor);
+	descriptor = -1;
+	mapping = nullptr;
+	mappedSize = 0;
+	length = 0;
+}
+
+void MappedAppendFile::append(const char *data, std::size_t size) {
+	if (length + size > mappedSize)
+		grow(length + size);
+	std::memcpy(mapping + length, data, size);
+	length += size;
+}
+
+void MappedAppendFile::truncate(std::size_t newLength) {
+	if (newLength >= length)
+		return;
+	std::memset(mapping + newLength, 0, length - newLength);
+	length = newLength;
+}
+
+bool MappedAppendFile::isOpen() const {
+	return descriptor >= 0;
+}
+
+const char *MappedAppendFile::data() const {
+	return mapping;
+}
+
+std::size_t MappedAppendFile::size() const {
+	return length;
+}
+
+void MappedAppendFile::grow(std::size_t needed) {
+	std::size_t newSize = (needed + GROWTH_SIZE - 1) / GROWTH_SIZE * GROWTH_SIZE;
+	if (::ftruncate(descriptor, newSize) != 0)
+		throw std::system_error(errno, std::generic_category(), "ftruncate");
+
+	void *grown = (mapping == nullptr) ? ::mmap(nullptr, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0) \
+		: ::mremap(mapping, mappedSize, newSize, MREMAP_MAYMOVE);
+	if (grown == MAP_FAILED)
+		throw std::system_error(errno, std::generic_category(), "mmap");
+	mapping = static_cast<char *>(grown);
+	mappedSize = newSize;
+}
@@ -0,0 +1,47 @@
+
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstring>
+#include <cerrno>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+//Append-only file written through a shared memory mapping: appends are a memcpy into page cache (no syscall), the file
+//and its mapping grow by GROWTH_SIZE at a time (ftruncate + mremap). Until close() trims it, the file ends with zeros
+//past the bytes appended, so readers of a file not closed (e.g. after a crash) must stop at the first zeroed record
+//Not thread-safe: one writer at a time (see Logger)
+class MappedAppendFile {
+	public:
+		static const std::size_t GROWTH_SIZE = 16 << 20;
+
+		MappedAppendFile();
+		~MappedAppendFile();	//Closes file
+
+		MappedAppendFile(const MappedAppendFile &) = delete;
+		MappedAppendFile & operator=(const MappedAppendFile &) = delete;
+
+		//Creates file or maps the existing one (appends go after its current size); throws std::system_error
+		void open(const std::string & path);
+		void close();	//Unmaps and trims file to bytes appended
+
+		void append(const char *data, std::size_t size);	//Throws std::system_error when file cannot grow
+		void truncate(std::size_t length);					//Drops bytes past length (e.g. a torn tail)
+
+		bool isOpen() const;
+		const char *data() const;
+		std::size_t size() const;
+
+	private:
+		int descriptor;
+		char *mapping;
+		std::size_t mappedSize;
+		std::size_t length;
+
+		void grow(std::size_t needed);
+};
@@ -0,0 +1,114 @@
+
+#include "MappedLogRing.h"
+
+
+MappedLogRing::MappedLogRing() : descriptor(-1), mapping(nullptr), mappedSize(0), slotCount(0), nextSequence(1) {}
+
+MappedLogRing::~MappedLogRing() {
+	if (mapping == nullptr)
+		return;
+	markClean();
+	::munmap(mapping, mappedSize);
+	::close(descriptor);
+}
+
+std::string MappedLogRing::open(const std::string &path, std::size_t count, const std::string &suffix) {
+	//Previous ring kept aside unless its process marked it clean
+	std::string preserved;
+	int previous = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (previous >= 0) {
+		char header[MAGIC_SIZE + 24];
+		bool clean = true;
+		if (::pread(previous, header, sizeof(header), 0) == (ssize_t) sizeof(header) and std::memcmp(header, MAGIC, MAGIC_SIZE) == 0) {
+			std::uint64_t cleanWord;
+			std::memcpy(&cleanWord, header + MAGIC_SIZE + 16, 8);
+			clean = (cleanWord != 0);
+		}
+		::close(previous);
+		if (!clean) {
+			preserved = path + suffix;
+			if (::rename(path.c_str(), preserved.c_str()) != 0)
+				throw std::system_error(errno, std::generic_category(), "rename " + path);
+		}
+	}
+
+	slotCount = std::max<std::size_t>(1, count);
+	mappedSize = SLOT_SIZE * (slotCount + 1);
+	std::string temporary = path + ".tmp";
+	descriptor = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (descriptor < 0)
+		throw std::system_error(errno, std::generic_category(), "open " + temporary);
+	if (::ftruncate(descriptor, mappedSize) != 0) {
+		int error = errno;
+		::close(descriptor);
+		throw std::system_error(error, std::generic_category(), "ftruncate " + temporary);
+	}
+	void *mapped = ::mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	if (mapped == MAP_FAILED) {
+		int error = errno;
+		::close(descriptor);
+		throw std::system_error(error, std::generic_category(), "mmap " + temporary);
+	}
+	mapping = static_cast<char *>(mapped);
+
+	//Header complete before ring takes the name, so a ring found at path always has one
+	std::uint64_t sizes[2] = {slotCount, SLOT_SIZE};
+	std::memcpy(mapping, MAGIC, MAGIC_SIZE);
+	std::memcpy(mapping + MAGIC_SIZE, sizes, sizeof(sizes));
+	wordAt(mapping + MAGIC_SIZE + 16).store(0, std::memory_order_relaxed);
+	if (::rename(temporary.c_str(), path.c_str()) != 0)
+		throw std::system_error(errno, std::generic_category(), "rename " + temporary);
+	return preserved;
+}
+
+void MappedLogRing::markClean() {
+	if (mapping != nullptr)
+		wordAt(mapping + MAGIC_SIZE + 16).store(1, std::memory_order_release);
+}
+
+void MappedLogRing::write(const char *data, std::size_t size, bool binary) {
+	std::uint64_t sequence = nextSequence.fetch_add(1, std::memory_order_relaxed);
+	char *slot = mapping + SLOT_SIZE * (1 + sequence % slotCount);
+	std::uint32_t length = std::min(size, SLOT_SIZE - SLOT_HEADER_SIZE);
+	std::uint32_t flags = binary ? FLAG_BINARY : 0;
+
+	//end cleared before begin is set: a slot caught halfway (crash, or a writer a whole lap ahead) never has begin == end
+	wordAt(slot + 8).store(0, std::memory_order_relaxed);
+	wordAt(slot).store(sequence, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(slot + 16, &length, 4);
+	std::memcpy(slot + 20, &flags, 4);
+	std::memcpy(slot + SLOT_HEADER_SIZE, data, length);
+	wordAt(slot + 8).store(sequence, std::memory_order_release);
+}
+
+std::vector<MappedLogRing::entry> MappedLogRing::extract(std::string_view content, bool &wasClean) {
+	if (content.size() < SLOT_SIZE or content.compare(0, MAGIC_SIZE, std::string_view(MAGIC, MAGIC_SIZE)) != 0)
+		throw std::runtime_error("not a log ring");
+	std::uint64_t header[3];
+	std::memcpy(header, content.data() + MAGIC_SIZE, sizeof(header));
+	if (header[1] != SLOT_SIZE)
+		throw std::runtime_error("log ring of another slot size (" + std::to_string(header[1]) + ")");
+	wasClean = (header[2] != 0);
+
+	std::vector<entry> entries;
+	std::size_t slots = std::min<std::uint64_t>(header[0], content.size() / SLOT_SIZE - 1);
+	for (std::size_t i = 0; i < slots; i++) {
+		const char *slot = content.data() + SLOT_SIZE * (1 + i);
+		std::uint64_t begin, end;
+		std::uint32_t length, flags;
+		std::memcpy(&begin, slot, 8);
+		std::memcpy(&end, slot + 8, 8);
+		std::memcpy(&length, slot + 16, 4);
+		std::memcpy(&flags, slot + 20, 4);
+		if (begin == 0 or begin != end or length > SLOT_SIZE - SLOT_HEADER_SIZE)
+			continue;
+		entries.push_back(entry{begin, (flags & FLAG_BINARY) != 0, std::string_view(slot + SLOT_HEADER_SIZE, length)});
+	}
+	std::sort(entries.begin(), entries.end(), [](const entry & a, const entry & b) { return a.sequence < b.sequence; });
+	return entries;
+}
+
+std::atomic<std::uint64_t> &MappedLogRing::wordAt(char *address) {
+	return *reinterpret_cast<std::atomic<std::uint64_t> *>(address);
+}
@@ -0,0 +1,67 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+//Fixed-size file mapped shared and used as a circular buffer of log records (the newest SLOT_SIZE * slotCount bytes)
+//Records are memcpy'd into page cache, so they survive a crash of the process (not of the machine) with no write() or
+//fsync per record; extract() gives them back in order. Writers are lock-free: each record gets a sequence number, hence
+//a slot, and marks it [begin = sequence, data, end = sequence], so a slot torn by a crash (begin != end) is skipped
+//File: [MAGIC][slot count: u64][slot size: u64][clean: u64] padded to SLOT_SIZE, then slots:
+//  [begin: u64][end: u64][length: u32][flags: u32, FLAG_BINARY][data: up to SLOT_SIZE - SLOT_HEADER_SIZE bytes]
+class MappedLogRing {
+	public:
+		static const std::size_t SLOT_SIZE = 512;
+		static const std::size_t SLOT_HEADER_SIZE = 24;
+		static const std::size_t MAGIC_SIZE = 8;
+		static constexpr const char *MAGIC = "RESTRNG1";
+		static const std::uint32_t FLAG_BINARY = 1;		//Data is a BinaryLogFormat record, not a text line
+
+		class entry {
+			public:
+				std::uint64_t sequence;
+				bool binary;
+				std::string_view data;	//Into content given to extract()
+		};
+
+		MappedLogRing();
+		~MappedLogRing();	//Marks ring clean and unmaps it
+
+		MappedLogRing(const MappedLogRing &) = delete;
+		MappedLogRing & operator=(const MappedLogRing &) = delete;
+
+		//Creates ring of slotCount slots at path. A ring left there by a process that did not close it (crashed) is
+		//renamed to "<path><suffix>" first and that name returned (empty otherwise); throws std::system_error
+		std::string open(const std::string & path, std::size_t slotCount, const std::string & suffix);
+		void markClean();	//Process is exiting normally (records written after it are still kept)
+
+		void write(const char *data, std::size_t size, bool binary);	//Any thread, truncated to a slot
+
+		//Complete records of a ring file (as read from disk) ordered by sequence; throws std::runtime_error when content
+		//is not a ring. wasClean tells whether the process that wrote it closed it
+		static std::vector<entry> extract(std::string_view content, bool & wasClean);
+
+	private:
+		int descriptor;
+		char *mapping;
+		std::size_t mappedSize;
+		std::size_t slotCount;
+		std::atomic<std::uint64_t> nextSequence;
+
+		static std::atomic<std::uint64_t> & wordAt(char *address);	//Words of mapping are 8-byte aligned
+};
@@ -0,0 +1,104 @@
+
+#include "NativeListener.h"
+
+thread_local NativeListener::inline_reply *NativeListener::inlineReply = nullptr;
+
+int NativeListener::listenSocket(const std::string &host, unsigned short port, int backlog, int flags) {
+	std::string address = (host.size() > 1 and host.front() == '[' and host.back() == ']') ? host.substr(1, host.size() - 2) : host;
+
+	addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+	addrinfo *resolved = nullptr;
+	int error = getaddrinfo(address.empty() ? nullptr : address.c_str(), std::to_string(port).c_str(), &hints, &resolved);
+	if (error != 0)
+		throw std::system_error(std::make_error_code(std::errc::invalid_argument), "cannot resolve " + address + ": " + gai_strerror(error));
+
+	int enable = 1;
+	int descriptor = socket(resolved->ai_family, resolved->ai_socktype | SOCK_CLOEXEC | flags, resolved->ai_protocol);
+	bool listening = descriptor >= 0 \
+		and setsockopt(descriptor, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) == 0 \
+		and setsockopt(descriptor, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == 0 \
+		and bind(descriptor, resolved->ai_addr, resolved->ai_addrlen) == 0 \
+		and listen(descriptor, backlog) == 0;
+	int listenError = errno;
+	freeaddrinfo(resolved);
+
+	if (!listening) {
+		if (descriptor >= 0)
+			::close(descriptor);
+		throw std::system_error(listenError, std::generic_category(), "cannot listen on " + host + ":" + std::to_string(port));
+	}
+	return descriptor;
+}
+
+std::string NativeListener::peerAddress(const sockaddr_storage &address) {
+	char text[INET6_ADDRSTRLEN] = "";
+	if (address.ss_family == AF_INET)
+		inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in &>(address).sin_addr, text, sizeof(text));
+	else if (address.ss_family == AF_INET6) {
+		const in6_addr &ip = reinterpret_cast<const sockaddr_in6 &>(address).sin6_addr;
+		if (IN6_IS_ADDR_V4MAPPED(&ip))
+			inet_ntop(AF_INET, ip.s6_addr + 12, text, sizeof(text));
+		else
+			inet_ntop(AF_INET6, &ip, text, sizeof(text));
+	}
+	return text;
+}
+
+void NativeListener::setMaxBodyLength(std::size_t length) {
+	maxBodyLength = length;
+}
+
+bool NativeListener::handle(const HttpCodec::request_handler &handler, const HttpCodec::request &request, HttpCodec::response &reply, \
+	const std::shared_ptr<reply_mailbox> &mailbox, std::uint64_t connection, std::uint64_t requestId) {
+
+	inline_reply current{mailbox.get(), requestId, &reply, false};
+	inline_reply *outer = inlineReply;
+	inlineReply = &current;
+	try {
+		handler(request, [mailbox, connection, requestId](HttpCodec::response &&response) {
+			inline_reply *handling = inlineReply;
+			if (handling != nullptr and handling->mailbox == mailbox.get() and handling->request == requestId) {
+				*handling->reply = std::move(response);
+				handling->replied = true;
+				return;
+			}
+			mailbox->post(reply_mailbox::delivery{connection, requestId, std::move(response)});
+		});
+	}
+	catch (...) {
+		//Loop stops waiting for a reply still to come (dropped on arrival, its request id no longer awaited)
+		reply = HttpCodec::response();
+		reply.status = 500;
+		current.replied = true;
+	}
+	inlineReply = outer;
+	return current.replied;
+}
+
+NativeListener::reply_mailbox::reply_mailbox(int wakeDescriptor) : wakeDescriptor(wakeDescriptor), closed(false) {}
+
+void NativeListener::reply_mailbox::post(delivery &&item) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (closed)
+		return;
+	deliveries.push_back(std::move(item));
+	std::uint64_t wake = 1;
+	if (deliveries.size() == 1 and write(wakeDescriptor, &wake, sizeof(wake)) < 0) { }	//Loop takes every delivery on one wake
+}
+
+std::vector<NativeListener::reply_mailbox::delivery> NativeListener::reply_mailbox::take() {
+	std::vector<delivery> taken;
+	std::lock_guard<std::mutex> lock(mutex);
+	taken.swap(deliveries);
+	return taken;
+}
+
+void NativeListener::reply_mailbox::close() {
+	//Descriptor is closed by loop after this: no post writes to it (or to whatever reuses its number) from then on
+	std::lock_guard<std::mutex> lock(mutex);
+	closed = true;
+	deliveries.clear();
+}
@@ -0,0 +1,85 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <cstdint>
+#include <cerrno>
+#include <system_error>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "HttpCodec.h"
+
+
+//Common lifecycle of listeners owning their sockets (answering through HttpCodec::request_handler)
+class NativeListener {
+	public:
+		virtual ~NativeListener() {}
+
+		virtual void open() = 0;	//Throws std::system_error when it can not listen
+		virtual void close() = 0;
+
+		virtual std::uint64_t acceptedConnections() const = 0;
+		virtual std::vector<std::uint64_t> servedRequests() const = 0;	//One entry per event loop (or shard)
+
+		//Before open(): requests with a larger body are answered 413 (and connection closed) without reading it
+		void setMaxBodyLength(std::size_t length);
+
+	protected:
+		std::size_t maxBodyLength = HttpCodec::DEFAULT_MAX_BODY_LENGTH;
+
+		//Replies given by handlers after returning (from any thread), taken by the event loop of their connection
+		//Posting wakes loop through its eventfd; once closed (loop stopped) posts are dropped
+		class reply_mailbox {
+			public:
+				class delivery {
+					public:
+						std::uint64_t connection;	//Descriptor or slot, as loop knows it
+						std::uint64_t request;		//Id given by loop (tells it from a request of a later connection on same descriptor)
+						HttpCodec::response reply;
+				};
+
+				explicit reply_mailbox(int wakeDescriptor);
+
+				void post(delivery && item);
+				std::vector<delivery> take();
+				void close();
+
+			private:
+				std::mutex mutex;
+				std::vector<delivery> deliveries;
+				int wakeDescriptor;
+				bool closed;
+		};
+
+		//Calls handler on loop thread: true when it replied before returning (reply filled), false when reply comes
+		//later through mailbox (with connection and request given here); a throwing handler is answered with 500
+		static bool handle(const HttpCodec::request_handler & handler, const HttpCodec::request & request, HttpCodec::response & reply, \
+			const std::shared_ptr<reply_mailbox> & mailbox, std::uint64_t connection, std::uint64_t requestId);
+
+		//Listening socket with SO_REUSEPORT (several ones may share host:port), IPv6 hosts in URI form ([::1]) accepted
+		//Throws std::system_error; flags are added to socket type (e.g. SOCK_NONBLOCK)
+		static int listenSocket(const std::string & host, unsigned short port, int backlog, int flags = 0);
+
+		//IP of an accepted peer as text (IPv4-mapped IPv6 addresses as plain IPv4), empty if unknown
+		static std::string peerAddress(const sockaddr_storage & address);
+
+	private:
+		//Request being handled by this thread, so replies given before handler returns skip the mailbox
+		class inline_reply {
+			public:
+				reply_mailbox *mailbox;
+				std::uint64_t request;
+				HttpCodec::response *reply;
+				bool replied;
+		};
+		static thread_local inline_reply *inlineReply;
+};
@@ -0,0 +1,11 @@
+
+#include "ReusePortListener.h"
+
+
+ReusePortListener::ReusePortListener(const std::string &host, unsigned short port, std::size_t threadCount, request_handler handler, int backlog) : \
+	EpollListener(host, port, threadCount, handler, backlog, true, std::chrono::seconds(IDLE_TIMEOUT_SECONDS)) {}
+
+std::vector<std::uint64_t> ReusePortListener::servedRequests() const {
+	std::vector<std::uint64_t> perThread = EpollListener::servedRequests();
+	return {std::accumulate(perThread.begin(), perThread.end(), (std::uint64_t) 0)};
+}
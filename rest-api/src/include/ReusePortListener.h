@@ -0,0 +1,25 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <numeric>
+
+#include "EpollListener.h"
+
+
+//One shard of a listening port: its own socket bound with SO_REUSEPORT plus its own group of threads
+//Several shards on the same address/port let the kernel spread incoming connections among them,
+//instead of funneling every accept through one socket. Threads of a shard are event loops (as in EpollListener)
+//sharing its socket, so each one serves any number of connections (keep-alive and pipelined requests included);
+//a connection is closed by its peer or once idle for IDLE_TIMEOUT_SECONDS
+class ReusePortListener : public EpollListener {
+	public:
+		static constexpr int IDLE_TIMEOUT_SECONDS = 30;
+
+		ReusePortListener(const std::string & host, unsigned short port, std::size_t threadCount, request_handler handler, int backlog = 1024);
+
+		std::vector<std::uint64_t> servedRequests() const override;	//Single entry (one shard)
+};
@@ -0,0 +1,86 @@
+
+#pragma once
+
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+
+//Read-mostly value replaced as a whole (RCU-like): publish() swaps in a new immutable snapshot, readers keep the one they got
+//Readers take no lock: each thread caches the snapshot it last saw and reloads it only when the version moved (a relaxed
+//load otherwise). A reader pins the cache of its thread, so nested readers (e.g. sub-requests of a batch handled by the same
+//thread) see the very same snapshot; an old snapshot is freed once no thread caches it any more
+//Meant for one instance per type (threads switching between instances of a type reload on every switch)
+template <typename T>
+class SnapshotPointer {
+	public:
+		explicit SnapshotPointer(std::shared_ptr<const T> initial) : current(std::move(initial)), version(1) {}
+
+		void publish(std::shared_ptr<const T> next) {
+			std::atomic_store(&current, std::move(next));
+			version.fetch_add(1, std::memory_order_release);
+		}
+
+		std::shared_ptr<const T> load() const {	//Lock of shared_ptr atomics (address-hashed mutex): for writers, not per request
+			return std::atomic_load(&current);
+		}
+
+		std::uint64_t getVersion() const {
+			return version.load(std::memory_order_relaxed);
+		}
+
+		//Snapshot held for the lifetime of reader
+		class reader {
+			public:
+				explicit reader(const SnapshotPointer & pointer) : local(threadCache()), pinned(false) {
+					if (local.depth > 0 and local.owner != &pointer) {
+						held = pointer.load();	//Nested reader of another instance: copy of its own
+						snapshot = held.get();
+						return;
+					}
+					if (local.depth == 0 and (local.owner != &pointer or local.version != pointer.version.load(std::memory_order_acquire))) {
+						//Version first: a publish in between leaves an older version with the newer snapshot (reloaded again next time)
+						local.version = pointer.version.load(std::memory_order_acquire);
+						local.snapshot = pointer.load();
+						local.owner = &pointer;
+					}
+					local.depth++;
+					pinned = true;
+					snapshot = local.snapshot.get();
+				}
+
+				~reader() {
+					if (pinned)
+						local.depth--;
+				}
+
+				reader(const reader &) = delete;
+				reader & operator=(const reader &) = delete;
+
+				const T & operator*() const { return *snapshot; }
+				const T * operator->() const { return snapshot; }
+
+			private:
+				class thread_cache {
+					public:
+						const SnapshotPointer *owner = nullptr;
+						std::uint64_t version = 0;
+						std::shared_ptr<const T> snapshot;
+						std::size_t depth = 0;	//Readers alive on thread (cache is not reloaded meanwhile)
+				};
+
+				thread_cache & local;
+				bool pinned;
+				std::shared_ptr<const T> held;
+				const T *snapshot;
+
+				static thread_cache & threadCache() {
+					static thread_local thread_cache cache;
+					return cache;
+				}
+		};
+
+	private:
+		std::shared_ptr<const T> current;
+		std::atomic<std::uint64_t> version;
+};
@@ -0,0 +1,415 @@
+
+#include "UringListener.h"
+
+
+UringListener::UringListener(const std::string &host, unsigned short port, std::size_t loopCount, request_handler handler, int backlog) : \
+	host(host), port(port), handler(handler), backlog(backlog), running(false) {
+
+	for (std::size_t i = 0; i < std::max<std::size_t>(1, loopCount); i++)
+		eventLoops.emplace_back(new event_loop());
+}
+
+UringListener::~UringListener() {
+	close();
+}
+
+bool UringListener::supported() {
+	static const bool available = [] {
+		io_uring_params params = {};
+		int descriptor = syscall(__NR_io_uring_setup, 8, &params);
+		if (descriptor < 0)
+			return false;	//ENOSYS (old kernel), EPERM (disabled by sysctl or seccomp)
+
+		//Feature of 5.17, by when direct accept and close of fixed files were also in
+		bool complete = (params.features & IORING_FEAT_CQE_SKIP) and (params.features & IORING_FEAT_SINGLE_MMAP);
+
+		std::vector<char> probeMemory(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+		io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(probeMemory.data());
+		complete = complete and syscall(__NR_io_uring_register, descriptor, IORING_REGISTER_PROBE, probe, 256) == 0;
+		for (int operation : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_CLOSE, IORING_OP_READ_FIXED, IORING_OP_READ})
+			complete = complete and operation <= probe->last_op and (probe->ops[operation].flags & IO_URING_OP_SUPPORTED);
+
+		::close(descriptor);
+		return complete;
+	}();
+	return available;
+}
+
+void UringListener::open() {
+	try {
+		for (std::unique_ptr<event_loop> & loop : eventLoops)
+			openLoop(*loop);
+	}
+	catch (std::exception &) {
+		for (std::unique_ptr<event_loop> & loop : eventLoops)
+			closeLoop(*loop);
+		throw;
+	}
+
+	running = true;
+	for (std::unique_ptr<event_loop> & loop : eventLoops)
+		threads.emplace_back(&UringListener::runLoop, this, std::ref(*loop));
+}
+
+void UringListener::close() {
+	if (!running.exchange(false))
+		return;
+
+	std::uint64_t wake = 1;
+	for (std::unique_ptr<event_loop> & loop : eventLoops)
+		if (write(loop->wakeDescriptor, &wake, sizeof(wake)) < 0) { }
+	for (std::thread & thread : threads)
+		thread.join();
+	threads.clear();
+
+	for (std::unique_ptr<event_loop> & loop : eventLoops)
+		closeLoop(*loop);
+}
+
+std::size_t UringListener::loops() const {
+	return eventLoops.size();
+}
+
+std::uint64_t UringListener::acceptedConnections() const {
+	std::uint64_t total = 0;
+	for (const std::unique_ptr<event_loop> & loop : eventLoops)
+		total += loop->accepted.load(std::memory_order_relaxed);
+	return total;
+}
+
+std::vector<std::uint64_t> UringListener::servedRequests() const {
+	std::vector<std::uint64_t> served;
+	for (const std::unique_ptr<event_loop> & loop : eventLoops)
+		served.push_back(loop->served.load(std::memory_order_relaxed));
+	return served;
+}
+
+void UringListener::openLoop(event_loop &loop) {
+	loop.listenDescriptor = listenSocket(host, port, backlog);
+	int enable = 1;
+	setsockopt(loop.listenDescriptor, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));	//Inherited by accepted sockets (fixed files take no setsockopt)
+
+	loop.wakeDescriptor = eventfd(0, EFD_CLOEXEC);
+	if (loop.wakeDescriptor < 0)
+		throw std::system_error(errno, std::generic_category(), "cannot create event loop");
+	loop.mailbox = std::make_shared<reply_mailbox>(loop.wakeDescriptor);
+	setupRing(loop.uring, RING_ENTRIES);
+
+	//Sparse table of fixed files (-1 = free slot), connections are accepted straight into it
+	std::vector<int> files(MAX_CONNECTIONS, -1);
+	if (syscall(__NR_io_uring_register, loop.uring.descriptor, IORING_REGISTER_FILES, files.data(), (unsigned) files.size()) != 0)
+		throw std::system_error(errno, std::generic_category(), "cannot register io_uring file table");
+
+	loop.buffers.assign(MAX_CONNECTIONS * BUFFER_SIZE, 0);
+	iovec bufferArea = {loop.buffers.data(), loop.buffers.size()};
+	loop.fixedBuffers = syscall(__NR_io_uring_register, loop.uring.descriptor, IORING_REGISTER_BUFFERS, &bufferArea, 1) == 0;
+
+	loop.connections.assign(MAX_CONNECTIONS, connection());
+	loop.peers.assign(MAX_CONNECTIONS, sockaddr_storage());
+	loop.peerLengths.assign(MAX_CONNECTIONS, 0);
+	loop.freeSlots.clear();
+	for (std::size_t slot = MAX_CONNECTIONS; slot > 0; slot--)
+		loop.freeSlots.push_back(slot - 1);
+}
+
+void UringListener::runLoop(event_loop &loop) {
+	armWake(loop);
+	armAccept(loop);
+
+	while (running) {
+		//Single syscall: publishes every submission prepared since last time and waits for at least one completion
+		if (enter(loop.uring, 1) < 0 and errno != EINTR and errno != EAGAIN and errno != EBUSY)
+			return;
+
+		unsigned head = *loop.uring.cqHead;
+		unsigned tail = __atomic_load_n(loop.uring.cqTail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++)
+			complete(loop, loop.uring.cqes[head & *loop.uring.cqMask]);
+		__atomic_store_n(loop.uring.cqHead, head, __ATOMIC_RELEASE);
+	}
+}
+
+void UringListener::complete(event_loop &loop, const io_uring_cqe &completion) {
+	operation_types::type operation = static_cast<operation_types::type>(completion.user_data & 0xff);
+	unsigned slot = completion.user_data >> 8;
+	connection &client = loop.connections[slot];
+
+	//One operation in flight per connection at most: receive -> (send ->)* receive ... -> close
+	switch (operation) {
+		case operation_types::type::ACCEPT:
+			loop.acceptsArmed--;
+			if (completion.res < 0)
+				loop.freeSlots.push_back(slot);
+			else {
+				client = connection();
+				client.remoteAddress = peerAddress(loop.peers[slot]);
+				loop.accepted.fetch_add(1, std::memory_order_relaxed);
+				armReceive(loop, slot);
+			}
+			armAccept(loop);
+			break;
+
+		case operation_types::type::RECEIVE:
+			if (completion.res <= 0) {
+				armClose(loop, slot);	//Closed by peer or failed
+				break;
+			}
+			client.input.append(loop.buffers.data() + slot * BUFFER_SIZE, completion.res);
+			serve(loop, slot);
+			break;
+
+		case operation_types::type::SEND:
+			if (completion.res < 0) {
+				armClose(loop, slot);
+				break;
+			}
+			client.outputSent += completion.res;
+			if (client.outputSent < client.output.size()) {
+				armSend(loop, slot);
+				break;
+			}
+			client.output.clear();
+			client.outputSent = 0;
+			if (client.closeAfterOutput and client.awaitedReply == 0 and !client.replyArrived)
+				armClose(loop, slot);
+			else
+				serve(loop, slot);	//Requests held back by pending output (or next receive)
+			break;
+
+		case operation_types::type::CLOSE:
+			client = connection();
+			loop.freeSlots.push_back(slot);
+			armAccept(loop);
+			break;
+
+		case operation_types::type::WAKE:
+			//close() clears running before waking; otherwise replies were posted (read is armed again after taking them)
+			if (!running)
+				break;
+			deliverReplies(loop);
+			armWake(loop);
+			break;
+	}
+}
+
+void UringListener::serve(event_loop &loop, unsigned slot) {
+	//Nothing is armed for a connection waiting for a reply with nothing to send (its delivery serves it again)
+	connection &client = loop.connections[slot];
+	processInput(loop, slot);
+	if (!client.output.empty())
+		armSend(loop, slot);
+	else if (client.awaitedReply == 0)
+		armReceive(loop, slot);
+}
+
+void UringListener::armAccept(event_loop &loop) {
+	//A few accepts kept in flight, each one reserving the fixed file slot it fills
+	while (loop.acceptsArmed < ACCEPTS_IN_FLIGHT and !loop.freeSlots.empty()) {
+		unsigned slot = loop.freeSlots.back();
+		loop.freeSlots.pop_back();
+
+		io_uring_sqe *submission = nextSubmission(loop.uring);
+		submission->opcode = IORING_OP_ACCEPT;
+		submission->fd = loop.listenDescriptor;
+		loop.peerLengths[slot] = sizeof(sockaddr_storage);
+		submission->addr = reinterpret_cast<std::uint64_t>(&loop.peers[slot]);
+		submission->addr2 = reinterpret_cast<std::uint64_t>(&loop.peerLengths[slot]);
+		submission->file_index = slot + 1;	//Direct accept: 0 would mean a regular descriptor
+		submission->user_data = userData(operation_types::type::ACCEPT, slot);
+		loop.acceptsArmed++;
+	}
+}
+
+void UringListener::armReceive(event_loop &loop, unsigned slot) {
+	io_uring_sqe *submission = nextSubmission(loop.uring);
+	submission->opcode = loop.fixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_RECV;
+	submission->fd = slot;
+	submission->flags = IOSQE_FIXED_FILE;
+	submission->addr = reinterpret_cast<std::uint64_t>(loop.buffers.data() + slot * BUFFER_SIZE);
+	submission->len = BUFFER_SIZE;
+	submission->buf_index = 0;	//Whole buffer area is one registered buffer
+	submission->user_data = userData(operation_types::type::RECEIVE, slot);
+}
+
+void UringListener::armSend(event_loop &loop, unsigned slot) {
+	connection &client = loop.connections[slot];
+	io_uring_sqe *submission = nextSubmission(loop.uring);
+	submission->opcode = IORING_OP_SEND;
+	submission->fd = slot;
+	submission->flags = IOSQE_FIXED_FILE;
+	submission->addr = reinterpret_cast<std::uint64_t>(client.output.data() + client.outputSent);
+	submission->len = client.output.size() - client.outputSent;
+	submission->msg_flags = MSG_NOSIGNAL;
+	submission->user_data = userData(operation_types::type::SEND, slot);
+}
+
+void UringListener::armClose(event_loop &loop, unsigned slot) {
+	io_uring_sqe *submission = nextSubmission(loop.uring);
+	submission->opcode = IORING_OP_CLOSE;
+	submission->file_index = slot + 1;
+	submission->user_data = userData(operation_types::type::CLOSE, slot);
+}
+
+void UringListener::armWake(event_loop &loop) {
+	io_uring_sqe *submission = nextSubmission(loop.uring);
+	submission->opcode = IORING_OP_READ;
+	submission->fd = loop.wakeDescriptor;
+	submission->addr = reinterpret_cast<std::uint64_t>(&loop.wakeValue);
+	submission->len = sizeof(loop.wakeValue);
+	submission->user_data = userData(operation_types::type::WAKE, 0);
+}
+
+void UringListener::processInput(event_loop &loop, unsigned slot) {
+	connection &client = loop.connections[slot];
+	if (client.replyArrived) {
+		HttpCodec::serialize(client.arrivedReply, !client.closeAfterOutput, client.output, client.awaitedWithBody);
+		client.arrivedReply = HttpCodec::response();
+		client.replyArrived = false;
+	}
+
+	HttpCodec::request parsed;
+	parsed.remoteAddress = client.remoteAddress;
+	parsed.receivedAt = std::chrono::steady_clock::now();	//Input was received just before (pipelined requests queue from here)
+	std::size_t position = 0, consumed = 0;
+	while (!client.closeAfterOutput and client.awaitedReply == 0 and client.output.size() < MAX_PENDING_OUTPUT) {
+		HttpCodec::parse_status::status status = HttpCodec::parse(client.input.data() + position, client.input.size() - position, parsed, consumed, maxBodyLength);
+		if (status == HttpCodec::parse_status::status::INCOMPLETE)
+			break;
+
+		HttpCodec::response reply;
+		bool withBody = true;
+		if (status != HttpCodec::parse_status::status::COMPLETE) {
+			reply.status = HttpCodec::errorStatus(status);
+			client.closeAfterOutput = true;
+		}
+		else {
+			position += consumed;
+			client.closeAfterOutput = !parsed.keepAlive;
+			std::uint64_t request = ++loop.nextRequest;
+			bool replied = handle(handler, parsed, reply, loop.mailbox, slot, request);
+			loop.served.fetch_add(1, std::memory_order_relaxed);
+			withBody = (parsed.method != "HEAD");
+			if (!replied) {
+				client.awaitedReply = request;
+				client.awaitedWithBody = withBody;
+				break;
+			}
+		}
+		HttpCodec::serialize(reply, !client.closeAfterOutput, client.output, withBody);
+	}
+	client.input.erase(0, position);
+}
+
+void UringListener::deliverReplies(event_loop &loop) {
+	for (reply_mailbox::delivery & item : loop.mailbox->take()) {
+		connection &client = loop.connections[item.connection];
+		if (client.awaitedReply != item.request)
+			continue;	//Connection closed meanwhile (slot may belong to another one by now)
+
+		//Output is only appended while no send is in flight (its buffer is in use by kernel): a pending send
+		//serves connection again once done
+		client.awaitedReply = 0;
+		client.arrivedReply = std::move(item.reply);
+		client.replyArrived = true;
+		if (client.output.empty())
+			serve(loop, static_cast<unsigned>(item.connection));
+	}
+}
+
+io_uring_sqe *UringListener::nextSubmission(ring &uring) {
+	//Ring full: hand what is there to kernel (it takes them synchronously) to make room
+	while (uring.localTail - __atomic_load_n(uring.sqHead, __ATOMIC_ACQUIRE) >= uring.entries)
+		enter(uring, 0);
+
+	unsigned index = uring.localTail & *uring.sqMask;
+	io_uring_sqe *submission = &uring.sqes[index];
+	std::memset(submission, 0, sizeof(*submission));
+	uring.sqArray[index] = index;
+	uring.localTail++;
+	return submission;
+}
+
+int UringListener::enter(ring &uring, unsigned minimumCompletions) {
+	__atomic_store_n(uring.sqTail, uring.localTail, __ATOMIC_RELEASE);
+	unsigned pending = uring.localTail - __atomic_load_n(uring.sqHead, __ATOMIC_ACQUIRE);
+	return syscall(__NR_io_uring_enter, uring.descriptor, pending, minimumCompletions, (minimumCompletions > 0) ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+}
+
+void UringListener::setupRing(ring &uring, unsigned entries) {
+	//Deferred task work (5.19+) saves interrupting the loop thread; older kernels refuse the flag
+	io_uring_params params = {};
+	params.flags = IORING_SETUP_COOP_TASKRUN;
+	uring.descriptor = syscall(__NR_io_uring_setup, entries, &params);
+	if (uring.descriptor < 0 and errno == EINVAL) {
+		params = io_uring_params();
+		uring.descriptor = syscall(__NR_io_uring_setup, entries, &params);
+	}
+	if (uring.descriptor < 0)
+		throw std::system_error(errno, std::generic_category(), "cannot set up io_uring");
+
+	//Submission and completion rings share one mapping (IORING_FEAT_SINGLE_MMAP, required by supported())
+	uring.sqMemorySize = std::max<std::size_t>(params.sq_off.array + params.sq_entries * sizeof(unsigned), \
+		params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+	uring.sqesMemorySize = params.sq_entries * sizeof(io_uring_sqe);
+	uring.sqMemory = mmap(nullptr, uring.sqMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.descriptor, IORING_OFF_SQ_RING);
+	void *sqesMemory = mmap(nullptr, uring.sqesMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.descriptor, IORING_OFF_SQES);
+	if (uring.sqMemory == MAP_FAILED or sqesMemory == MAP_FAILED) {
+		int mapError = errno;
+		uring.sqMemory = (uring.sqMemory == MAP_FAILED) ? nullptr : uring.sqMemory;
+		uring.sqes = (sqesMemory == MAP_FAILED) ? nullptr : static_cast<io_uring_sqe *>(sqesMemory);
+		throw std::system_error(mapError, std::generic_category(), "cannot map io_uring");
+	}
+
+	char *rings = static_cast<char *>(uring.sqMemory);
+	uring.sqHead = reinterpret_cast<unsigned *>(rings + params.sq_off.head);
+	uring.sqTail = reinterpret_cast<unsigned *>(rings + params.sq_off.tail);
+	uring.sqMask = reinterpret_cast<unsigned *>(rings + params.sq_off.ring_mask);
+	uring.sqArray = reinterpret_cast<unsigned *>(rings + params.sq_off.array);
+	uring.cqHead = reinterpret_cast<unsigned *>(rings + params.cq_off.head);
+	uring.cqTail = reinterpret_cast<unsigned *>(rings + params.cq_off.tail);
+	uring.cqMask = reinterpret_cast<unsigned *>(rings + params.cq_off.ring_mask);
+	uring.cqes = reinterpret_cast<io_uring_cqe *>(rings + params.cq_off.cqes);
+	uring.sqes = static_cast<io_uring_sqe *>(sqesMemory);
+	uring.entries = params.sq_entries;
+	uring.localTail = *uring.sqTail;
+}
+
+void UringListener::closeRing(ring &uring) {
+	if (uring.sqes != nullptr)
+		munmap(uring.sqes, uring.sqesMemorySize);
+	if (uring.sqMemory != nullptr)
+		munmap(uring.sqMemory, uring.sqMemorySize);
+	if (uring.descriptor >= 0)
+		::close(uring.descriptor);	//Cancels operations in flight and closes fixed files (connections)
+	uring = ring();
+}
+
+void UringListener::closeLoop(event_loop &loop) {
+	if (loop.mailbox)
+		loop.mailbox->close();
+	loop.mailbox.reset();
+	closeRing(loop.uring);
+	for (int *descriptor : {&loop.listenDescriptor, &loop.wakeDescriptor})
+		if (*descriptor >= 0) {
+			::close(*descriptor);
+			*descriptor = -1;
+		}
+	loop.connections.clear();
+	loop.freeSlots.clear();
+	loop.acceptsArmed = 0;
+}
+
+std::uint64_t UringListener::userData(operation_types::type operation, unsigned slot) {
+	return (static_cast<std::uint64_t>(slot) << 8) | static_cast<std::uint64_t>(operation);
+}
+
+std::string UringListener::operation_types::to_string(type t) {
+	switch (t) {
+		case type::ACCEPT:	return "accept"; break;
+		case type::RECEIVE:	return "receive"; break;
+		case type::SEND:	return "send"; break;
+		case type::CLOSE:	return "close"; break;
+		case type::WAKE:	return "wake";
+	}
+	return "wake";
+}
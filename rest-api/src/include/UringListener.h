@@ -0,0 +1,134 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <system_error>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+
+#include "NativeListener.h"
+
+
+//HTTP/1.1 server on io_uring (raw syscalls, no liburing), one ring and one event loop per thread
+//Accept, recv, send and close are queued as submissions and go to the kernel in one io_uring_enter per loop
+//iteration, together with the wait for completions. Connections are fixed files (accepted straight into the
+//ring's file table, never getting a regular descriptor) and are read into buffers registered with the ring
+//(plain recv when registration is refused, e.g. RLIMIT_MEMLOCK). As in EpollListener, every loop owns its
+//SO_REUSEPORT socket, handlers are called inline and must not block (or reply later from another thread),
+//keep-alive and pipelining are supported
+class UringListener : public NativeListener {
+	public:
+		typedef HttpCodec::request_handler request_handler;
+
+		static const unsigned RING_ENTRIES = 1024;
+		static const std::size_t MAX_CONNECTIONS = 1024;	//Per loop (fixed file slots)
+		static const std::size_t BUFFER_SIZE = 4096;		//Registered receive buffer per connection slot
+		static const std::size_t MAX_PENDING_OUTPUT = 1024 * 1024;
+		static const std::size_t ACCEPTS_IN_FLIGHT = 16;
+
+		UringListener(const std::string & host, unsigned short port, std::size_t loopCount, request_handler handler, int backlog = 1024);
+		~UringListener();	//Closes listener
+
+		//Kernel has io_uring with every operation used here (5.17+), otherwise EpollListener should be used instead
+		static bool supported();
+
+		void open() override;	//Throws std::system_error when a socket or ring can not be set up
+		void close() override;	//Stops loops, rings are torn down with their connections (pending output is discarded)
+
+		std::size_t loops() const;
+		std::uint64_t acceptedConnections() const override;
+		std::vector<std::uint64_t> servedRequests() const override;
+
+	private:
+		class operation_types {
+			public:
+				enum class type : std::uint64_t { ACCEPT, RECEIVE, SEND, CLOSE, WAKE };
+				static std::string to_string(type t);
+		};
+
+		class connection {
+			public:
+				std::string remoteAddress;
+				std::string input;
+				std::string output;
+				std::size_t outputSent = 0;
+				bool closeAfterOutput = false;
+				std::uint64_t awaitedReply = 0;		//Request whose reply comes later (0 = none), next ones wait for it
+				bool awaitedWithBody = true;
+				bool replyArrived = false;			//Delivered while a send was in flight, written by next serve()
+				HttpCodec::response arrivedReply;
+		};
+
+		//Memory shared with kernel: submission ring (indexes into sqes) and completion ring
+		class ring {
+			public:
+				int descriptor = -1;
+				unsigned *sqHead = nullptr, *sqTail = nullptr, *sqMask = nullptr, *sqArray = nullptr;
+				unsigned *cqHead = nullptr, *cqTail = nullptr, *cqMask = nullptr;
+				io_uring_sqe *sqes = nullptr;
+				io_uring_cqe *cqes = nullptr;
+				void *sqMemory = nullptr;	//Both rings (single mapping)
+				std::size_t sqMemorySize = 0, sqesMemorySize = 0;
+				unsigned entries = 0;
+				unsigned localTail = 0;		//Includes submissions prepared but not published to kernel yet
+		};
+
+		class alignas(64) event_loop {
+			public:
+				ring uring;
+				int listenDescriptor = -1;
+				int wakeDescriptor = -1;
+				std::uint64_t wakeValue = 0;
+				std::size_t acceptsArmed = 0;
+				bool fixedBuffers = false;
+				std::vector<char> buffers;				//MAX_CONNECTIONS * BUFFER_SIZE
+				std::vector<connection> connections;	//Indexed by fixed file slot
+				std::vector<sockaddr_storage> peers;	//Filled by kernel on accept, per slot
+				std::vector<socklen_t> peerLengths;
+				std::vector<unsigned> freeSlots;
+				std::shared_ptr<reply_mailbox> mailbox;
+				std::uint64_t nextRequest = 0;
+				std::atomic<std::uint64_t> accepted{0};
+				std::atomic<std::uint64_t> served{0};
+		};
+
+		std::string host;
+		unsigned short port;
+		request_handler handler;
+		int backlog;
+
+		std::atomic<bool> running;
+		std::vector<std::unique_ptr<event_loop>> eventLoops;
+		std::vector<std::thread> threads;
+
+		void openLoop(event_loop & loop);
+		void runLoop(event_loop & loop);
+		void complete(event_loop & loop, const io_uring_cqe & completion);
+		void serve(event_loop & loop, unsigned slot);
+
+		void armAccept(event_loop & loop);
+		void armReceive(event_loop & loop, unsigned slot);
+		void armSend(event_loop & loop, unsigned slot);
+		void armClose(event_loop & loop, unsigned slot);
+		void armWake(event_loop & loop);
+
+		void processInput(event_loop & loop, unsigned slot);
+		void deliverReplies(event_loop & loop);
+
+		static io_uring_sqe *nextSubmission(ring & uring);
+		static int enter(ring & uring, unsigned minimumCompletions);
+		static void setupRing(ring & uring, unsigned entries);
+		static void closeRing(ring & uring);
+		static void closeLoop(event_loop & loop);
+		static std::uint64_t userData(operation_types::type operation, unsigned slot);
+};
@@ -0,0 +1,212 @@
+
+#include "WorkStealingPool.h"
+
+
+thread_local WorkStealingPool *WorkStealingPool::currentPool = nullptr;
+thread_local std::size_t WorkStealingPool::currentWorker = 0;
+
+WorkStealingPool::WorkStealingPool(std::size_t workerCount, affinity_modes::mode affinity) : \
+	running(true), nextQueue(0), pendingTasks(0), sleepingWorkers(0), executed(0), stolen(0) {
+
+	if (workerCount == 0)
+		workerCount = std::max(1u, std::thread::hardware_concurrency());
+
+	for (std::size_t i = 0; i < workerCount; i++)
+		queues.emplace_back(new worker_queue());
+	active = workerCount;
+
+	for (std::size_t i = 0; i < workerCount; i++) {
+		workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+		pinWorker(i, affinity);
+	}
+}
+
+WorkStealingPool::~WorkStealingPool() {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		running = false;
+	}
+	wakeCondition.notify_all();
+	parkCondition.notify_all();
+
+	for (std::thread & worker : workers)
+		worker.join();
+}
+
+void WorkStealingPool::submit(procedure task, void *parameter) {
+	std::size_t index = (currentPool == this) ? currentWorker : \
+		nextQueue.fetch_add(1, std::memory_order_relaxed) % active.load(std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->tasks.push_back(task_entry{task, parameter});
+	}
+
+	//Both counters are sequentially consistent: either a sleeping worker sees the new task or we see it sleeping
+	pendingTasks++;
+	if (sleepingWorkers > 0) {
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		wakeCondition.notify_one();
+	}
+}
+
+void WorkStealingPool::setActiveWorkers(std::size_t count) {
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		active = std::min(std::max<std::size_t>(1, count), workers.size());
+	}
+	wakeCondition.notify_all();
+	parkCondition.notify_all();
+}
+
+std::size_t WorkStealingPool::activeWorkers() const {
+	return active.load(std::memory_order_relaxed);
+}
+
+std::size_t WorkStealingPool::size() const {
+	return workers.size();
+}
+
+std::uint64_t WorkStealingPool::executedTasks() const {
+	return executed.load(std::memory_order_relaxed);
+}
+
+std::uint64_t WorkStealingPool::stolenTasks() const {
+	return stolen.load(std::memory_order_relaxed);
+}
+
+void WorkStealingPool::workerLoop(std::size_t index) {
+	currentPool = this;
+	currentWorker = index;
+
+	while (true) {
+		if (index >= active) {
+			//Parked: on shutdown active workers run what is left, including tasks of this queue
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			parkCondition.wait(lock, [this, index] { return index < active or !running; });
+			if (!running)
+				return;
+			continue;
+		}
+
+		task_entry entry;
+		if (popOwn(index, entry) or steal(index, entry)) {
+			pendingTasks--;
+			entry.task(entry.parameter);
+			executed.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		sleepingWorkers++;
+		wakeCondition.wait(lock, [this, index] { return pendingTasks > 0 or !running or index >= active; });
+		sleepingWorkers--;
+
+		if (!running and pendingTasks == 0)
+			return;
+	}
+}
+
+bool WorkStealingPool::popOwn(std::size_t index, task_entry &entry) {
+	worker_queue &own = *queues[index];
+	std::lock_guard<std::mutex> lock(own.mutex);
+	if (own.tasks.empty())
+		return false;
+
+	entry = own.tasks.back();
+	own.tasks.pop_back();
+	return true;
+}
+
+bool WorkStealingPool::steal(std::size_t index, task_entry &entry) {
+	for (std::size_t offset = 1; offset < queues.size(); offset++) {
+		worker_queue &victim = *queues[(index + offset) % queues.size()];
+		std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+		if (!lock.owns_lock() or victim.tasks.empty())
+			continue;
+
+		entry = victim.tasks.front();
+		victim.tasks.pop_front();
+		stolen.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+void WorkStealingPool::pinWorker(std::size_t index, affinity_modes::mode affinity) {
+	std::vector<int> cpus;
+	if (affinity == affinity_modes::mode::CORE) {
+		std::vector<int> allowed = allowedCpus();
+		if (!allowed.empty())
+			cpus.push_back(allowed[index % allowed.size()]);
+	}
+	else if (affinity == affinity_modes::mode::NUMA_NODE) {
+		std::vector<std::vector<int>> nodes = numaNodeCpus();
+		if (!nodes.empty())
+			cpus = nodes[index % nodes.size()];
+	}
+	if (cpus.empty())
+		return;
+
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	for (int cpu : cpus)
+		CPU_SET(cpu, &cpuSet);
+	pthread_setaffinity_np(workers[index].native_handle(), sizeof(cpuSet), &cpuSet);
+}
+
+std::vector<int> WorkStealingPool::allowedCpus() {
+	std::vector<int> cpus;
+	cpu_set_t cpuSet;
+	if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) != 0)
+		return cpus;
+
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &cpuSet))
+			cpus.push_back(cpu);
+	return cpus;
+}
+
+std::vector<std::vector<int>> WorkStealingPool::numaNodeCpus() {
+	std::vector<std::vector<int>> nodes;
+	for (int node = 0; ; node++) {
+		std::ifstream cpuListFile("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+		std::string cpuList;
+		if (!cpuListFile or !std::getline(cpuListFile, cpuList))
+			break;
+
+		std::vector<int> cpus = parseCpuList(cpuList);
+		if (!cpus.empty())
+			nodes.push_back(cpus);
+	}
+	return nodes;
+}
+
+std::vector<int> WorkStealingPool::parseCpuList(const std::string &list) {
+	//Kernel format, e.g. "0-3,8-11"
+	std::vector<int> cpus;
+	std::size_t position = 0;
+	while (position < list.size()) {
+		std::size_t comma = list.find(',', position);
+		std::string range = list.substr(position, (comma == std::string::npos) ? std::string::npos : comma - position);
+		position = (comma == std::string::npos) ? list.size() : comma + 1;
+
+		std::size_t dash = range.find('-');
+		try {
+			int first = std::stoi(range.substr(0, dash));
+			int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+			for (int cpu = first; cpu <= last; cpu++)
+				cpus.push_back(cpu);
+		}
+		catch (std::exception &) { }
+	}
+	return cpus;
+}
+
+std::string WorkStealingPool::affinity_modes::to_string(mode m) {
+	switch (m) {
+		case mode::NONE:		return "none"; break;
+		case mode::CORE:		return "core"; break;
+		case mode::NUMA_NODE:	return "numa-node";
+	}
+	return "none";
+}
@@ -0,0 +1,85 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <condition_variable>
+#include <pthread.h>
+#include <sched.h>
+
+
+//Fixed pool of worker threads, each one owning a queue of tasks
+//Workers take from back of their own queue (most recent, still hot in cache) and, when it is empty,
+//steal from front of the others. Tasks submitted by a worker go to its own queue, external ones are spread round-robin
+class WorkStealingPool {
+	public:
+		typedef void (*procedure)(void *);
+
+		//Optional pinning of workers: one core each, or all cores of one NUMA node each (round-robin)
+		class affinity_modes {
+			public:
+				enum class mode { NONE, CORE, NUMA_NODE };
+				static std::string to_string(mode m);
+		};
+
+		WorkStealingPool(std::size_t workerCount = 0, affinity_modes::mode affinity = affinity_modes::mode::NONE);	//0 = one per core
+		~WorkStealingPool();	//Runs pending tasks, then joins workers
+
+		void submit(procedure task, void *parameter);
+
+		//Workers taking tasks, 1 to size() (threads are created once: extra ones park until raised again); tasks left in
+		//queues of parked workers are stolen by active ones
+		void setActiveWorkers(std::size_t count);
+		std::size_t activeWorkers() const;
+
+		std::size_t size() const;
+		std::uint64_t executedTasks() const;
+		std::uint64_t stolenTasks() const;
+
+	private:
+		class task_entry {
+			public:
+				procedure task;
+				void *parameter;
+		};
+
+		class alignas(64) worker_queue {
+			public:
+				std::mutex mutex;
+				std::deque<task_entry> tasks;
+		};
+
+		std::vector<std::unique_ptr<worker_queue>> queues;
+		std::vector<std::thread> workers;
+		std::atomic<bool> running;
+		std::atomic<std::size_t> nextQueue;
+		std::atomic<std::size_t> pendingTasks;
+		std::atomic<std::size_t> sleepingWorkers;
+		std::atomic<std::size_t> active;
+		std::atomic<std::uint64_t> executed;
+		std::atomic<std::uint64_t> stolen;
+		std::mutex sleepMutex;
+		std::condition_variable wakeCondition;
+		std::condition_variable parkCondition;	//Apart from wakeCondition, so notify_one of submit never wakes a parked worker
+
+		//Lets submit() know whether it is being called from one of this pool's workers
+		static thread_local WorkStealingPool *currentPool;
+		static thread_local std::size_t currentWorker;
+
+		void workerLoop(std::size_t index);
+		bool popOwn(std::size_t index, task_entry & entry);
+		bool steal(std::size_t index, task_entry & entry);
+		void pinWorker(std::size_t index, affinity_modes::mode affinity);
+
+		static std::vector<int> allowedCpus();
+		static std::vector<std::vector<int>> numaNodeCpus();
+		static std::vector<int> parseCpuList(const std::string & list);
+};
@@ -0,0 +1,354 @@
+
+#include "WriteAheadLog.h"
+
+
+WriteAheadLog::WriteAheadLog(const std::string &directory, durability_modes::mode mode, std::chrono::milliseconds flushInterval) : \
+	directory(directory), mode(mode), flushInterval(flushInterval), descriptor(-1), segment(0), \
+	appendedSequence(0), durableSequence(0), running(false), failure(0), fsyncCount(0) {}
+
+WriteAheadLog::~WriteAheadLog() {
+	close();
+}
+
+void WriteAheadLog::open() {
+	if (mode == durability_modes::mode::NONE)
+		return;
+
+	createDirectory(directory);
+	std::vector<std::uint64_t> segments = listSegments(directory);
+	openSegment(segments.empty() ? 1 : segments.back() + 1);
+
+	running = true;
+	if (mode == durability_modes::mode::ASYNC or mode == durability_modes::mode::GROUP)
+		flusher = std::thread(&WriteAheadLog::flushLoop, this);
+}
+
+void WriteAheadLog::close() {
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		if (!running)
+			return;
+		running = false;
+	}
+	pendingCondition.notify_all();
+	if (flusher.joinable())
+		flusher.join();
+
+	//Called by destructor too, so errors are only recorded (waiters are woken by fail and throw)
+	std::lock_guard<std::mutex> fileLock(fileMutex);
+	if (failure == 0) {
+		try {
+			flushPending();
+			if (mode == durability_modes::mode::SYNC)
+				sync();
+		}
+		catch (const std::system_error & error) {
+			fail(error);
+		}
+	}
+	::close(descriptor);
+	descriptor = -1;
+}
+
+std::uint64_t WriteAheadLog::append(std::string_view payload) {
+	if (mode == durability_modes::mode::NONE)
+		return 0;
+
+	std::uint32_t header[2] = {static_cast<std::uint32_t>(payload.size()), crc32(payload.data(), payload.size())};
+	if (mode == durability_modes::mode::SYNC) {
+		std::lock_guard<std::mutex> fileLock(fileMutex);
+		{
+			std::lock_guard<std::mutex> lock(stateMutex);
+			if (failure != 0)
+				throw std::system_error(failure, std::generic_category(), "write-ahead log failed");
+		}
+		try {
+			writeFully(reinterpret_cast<const char *>(header), sizeof(header));
+			writeFully(payload.data(), payload.size());
+		}
+		catch (const std::system_error & error) {
+			fail(error);
+			throw;
+		}
+		std::lock_guard<std::mutex> lock(stateMutex);
+		return ++appendedSequence;
+	}
+
+	std::uint64_t sequence;
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		if (failure != 0)
+			throw std::system_error(failure, std::generic_category(), "write-ahead log failed");
+		pending.append(reinterpret_cast<const char *>(header), sizeof(header));
+		pending.append(payload.data(), payload.size());
+		sequence = ++appendedSequence;
+	}
+	if (mode == durability_modes::mode::GROUP)
+		pendingCondition.notify_one();
+	return sequence;
+}
+
+void WriteAheadLog::waitDurable(std::uint64_t sequence) {
+	if (sequence == 0)
+		return;
+
+	if (mode == durability_modes::mode::SYNC) {
+		std::lock_guard<std::mutex> fileLock(fileMutex);
+		try {
+			sync();
+		}
+		catch (const std::system_error & error) {
+			fail(error);
+			throw;
+		}
+		std::lock_guard<std::mutex> lock(stateMutex);
+		durableSequence = std::max(durableSequence, sequence);
+		return;
+	}
+
+	if (mode != durability_modes::mode::GROUP)
+		return;
+	std::unique_lock<std::mutex> lock(stateMutex);
+	durableCondition.wait(lock, [this, sequence] { return durableSequence >= sequence or failure != 0; });
+	if (durableSequence < sequence)
+		throw std::system_error(failure, std::generic_category(), "write-ahead log failed");
+}
+
+std::uint64_t WriteAheadLog::rotate() {
+	if (mode == durability_modes::mode::NONE)
+		return 0;
+
+	std::lock_guard<std::mutex> fileLock(fileMutex);
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		if (failure != 0)
+			throw std::system_error(failure, std::generic_category(), "write-ahead log failed");
+	}
+	try {
+		flushPending();
+		if (mode == durability_modes::mode::SYNC)
+			sync();
+		::close(descriptor);
+		descriptor = -1;
+		openSegment(segment + 1);
+	}
+	catch (const std::system_error & error) {
+		fail(error);
+		throw;
+	}
+	return segment;
+}
+
+void WriteAheadLog::removeSegmentsBefore(std::uint64_t first) {
+	for (std::uint64_t id : listSegments(directory))
+		if (id < first)
+			unlink(segmentPath(directory, id).c_str());
+	syncDirectory(directory);
+}
+
+WriteAheadLog::durability_modes::mode WriteAheadLog::getMode() const {
+	return mode;
+}
+
+std::uint64_t WriteAheadLog::appendedRecords() const {
+	std::lock_guard<std::mutex> lock(stateMutex);
+	return appendedSequence;
+}
+
+std::uint64_t WriteAheadLog::fsyncs() const {
+	return fsyncCount.load(std::memory_order_relaxed);
+}
+
+void WriteAheadLog::flushLoop() {
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(stateMutex);
+			if (mode == durability_modes::mode::GROUP)
+				pendingCondition.wait(lock, [this] { return !pending.empty() or !running; });
+			else
+				pendingCondition.wait_for(lock, flushInterval, [this] { return !running; });
+			if (!running)
+				return;	//Remaining records are flushed by close()
+		}
+
+		//Records appended while this fsync runs are left for next iteration (and share its fsync)
+		std::lock_guard<std::mutex> fileLock(fileMutex);
+		try {
+			flushPending();
+		}
+		catch (const std::system_error & error) {
+			fail(error);
+			return;
+		}
+	}
+}
+
+void WriteAheadLog::flushPending() {
+	std::string writing;
+	std::uint64_t sequence;
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		if (pending.empty())
+			return;
+		writing.swap(pending);
+		sequence = appendedSequence;
+	}
+
+	writeFully(writing.data(), writing.size());
+	sync();
+
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		durableSequence = sequence;
+		//Buffer goes back for reuse when nothing was appended meanwhile
+		if (pending.empty()) {
+			writing.clear();
+			pending.swap(writing);
+		}
+	}
+	durableCondition.notify_all();
+}
+
+void WriteAheadLog::writeFully(const char *data, std::size_t length) {
+	std::size_t written = 0;
+	while (written < length) {
+		ssize_t result = write(descriptor, data + written, length - written);
+		if (result < 0 and errno == EINTR)
+			continue;
+		if (result <= 0)
+			throw std::system_error(errno, std::generic_category(), "cannot write to " + segmentPath(directory, segment));
+		written += result;
+	}
+}
+
+void WriteAheadLog::sync() {
+	if (fdatasync(descriptor) != 0)
+		throw std::system_error(errno, std::generic_category(), "cannot sync " + segmentPath(directory, segment));
+	fsyncCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void WriteAheadLog::fail(const std::system_error &error) {
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		failure = error.code().value();
+	}
+	durableCondition.notify_all();
+}
+
+void WriteAheadLog::openSegment(std::uint64_t id) {
+	std::string path = segmentPath(directory, id);
+	descriptor = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (descriptor < 0)
+		throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+	segment = id;
+	syncDirectory(directory);
+}
+
+std::vector<std::uint64_t> WriteAheadLog::listSegments(const std::string &directory) {
+	std::vector<std::uint64_t> segments;
+	DIR *listing = opendir(directory.c_str());
+	if (listing == nullptr)
+		return segments;
+
+	while (dirent *file = readdir(listing)) {
+		unsigned long long id = 0;
+		int length = 0;
+		if (std::sscanf(file->d_name, "wal-%llu.log%n", &id, &length) == 1 and file->d_name[length] == '\0')
+			segments.push_back(id);
+	}
+	closedir(listing);
+	std::sort(segments.begin(), segments.end());
+	return segments;
+}
+
+WriteAheadLog::replay_stats WriteAheadLog::replaySegment(const std::string &directory, std::uint64_t segment, const record_visitor &visitor) {
+	replay_stats stats;
+	std::string path = segmentPath(directory, segment);
+	int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0)
+		throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+
+	std::string data;
+	char chunk[64 * 1024];
+	for (ssize_t received; (received = read(file, chunk, sizeof(chunk))) != 0;) {
+		if (received < 0 and errno == EINTR)
+			continue;
+		if (received < 0) {
+			int readError = errno;
+			::close(file);
+			throw std::system_error(readError, std::generic_category(), "cannot read " + path);
+		}
+		data.append(chunk, received);
+	}
+	::close(file);
+
+	stats.segments = 1;
+	std::size_t position = 0;
+	while (data.size() - position >= 8) {
+		std::uint32_t header[2];
+		std::memcpy(header, data.data() + position, sizeof(header));
+		if (data.size() - position - 8 < header[0] or crc32(data.data() + position + 8, header[0]) != header[1])
+			break;
+		visitor(std::string_view(data.data() + position + 8, header[0]));
+		position += 8 + header[0];
+		stats.records++;
+	}
+	stats.discardedBytes = data.size() - position;
+	return stats;
+}
+
+std::uint32_t WriteAheadLog::crc32(const void *data, std::size_t length, std::uint32_t crc) {
+	//Reflected CRC-32 (polynomial 0xEDB88320, same as zlib/Ethernet), one table lookup per byte
+	static const std::vector<std::uint32_t> table = [] {
+		std::vector<std::uint32_t> entries(256);
+		for (std::uint32_t i = 0; i < 256; i++) {
+			std::uint32_t value = i;
+			for (int bit = 0; bit < 8; bit++)
+				value = (value & 1) ? (0xEDB88320u ^ (value >> 1)) : (value >> 1);
+			entries[i] = value;
+		}
+		return entries;
+	}();
+
+	const unsigned char *bytes = static_cast<const unsigned char *>(data);
+	crc = ~crc;
+	for (std::size_t i = 0; i < length; i++)
+		crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+void WriteAheadLog::createDirectory(const std::string &directory) {
+	if (mkdir(directory.c_str(), 0755) != 0 and errno != EEXIST)
+		throw std::system_error(errno, std::generic_category(), "cannot create directory " + directory);
+}
+
+void WriteAheadLog::syncDirectory(const std::string &directory) {
+	int handle = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (handle < 0)
+		return;
+	fsync(handle);
+	::close(handle);
+}
+
+std::string WriteAheadLog::segmentPath(const std::string &directory, std::uint64_t segment) {
+	char name[32];
+	std::snprintf(name, sizeof(name), "wal-%016llu.log", static_cast<unsigned long long>(segment));
+	return directory + "/" + name;
+}
+
+std::string WriteAheadLog::durability_modes::to_string(mode m) {
+	switch (m) {
+		case mode::NONE:	return "none"; break;
+		case mode::ASYNC:	return "async"; break;
+		case mode::GROUP:	return "group"; break;
+		case mode::SYNC:	return "sync";
+	}
+	return "none";
+}
+
+WriteAheadLog::durability_modes::mode WriteAheadLog::durability_modes::from_string(const std::string &name) {
+	for (mode m : {mode::NONE, mode::ASYNC, mode::GROUP, mode::SYNC})
+		if (to_string(m) == name)
+			return m;
+	throw std::runtime_error("unknown durability mode: " + name);
+}
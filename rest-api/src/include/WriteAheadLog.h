@@ -0,0 +1,115 @@
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <system_error>
+#include <condition_variable>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+//Append-only log of opaque records, split into segment files (wal-<id>.log) inside a directory
+//Every record is framed as [payload length: 4 bytes][CRC-32 of payload: 4 bytes][payload], so a torn or corrupted
+//tail (crash in the middle of a write) is detected on replay and everything after it is ignored
+//How appends reach disk depends on durability mode:
+//  NONE : nothing is written
+//  ASYNC: appends are buffered and written/fsynced by a background thread every flush interval (no waiting)
+//  GROUP: same thread writes as soon as there are records and callers wait for the fsync covering theirs, so
+//         concurrent appends arriving while one fsync is in progress share the next one (group commit)
+//  SYNC : each append is written right away and each waitDurable runs its own fsync (one fsync per record)
+//Appends are cheap in every mode (no fsync), so they can be done while holding locks; waiting is done after releasing them
+class WriteAheadLog {
+	public:
+		class durability_modes {
+			public:
+				enum class mode { NONE, ASYNC, GROUP, SYNC };
+				static std::string to_string(mode m);
+				static mode from_string(const std::string & name);	//Throws std::runtime_error on unknown names
+		};
+
+		//Called once per valid record, in log order
+		typedef std::function<void(std::string_view payload)> record_visitor;
+
+		class replay_stats {
+			public:
+				std::size_t segments = 0;
+				std::uint64_t records = 0;
+				std::uint64_t discardedBytes = 0;	//Torn or corrupted tails
+		};
+
+		WriteAheadLog(const std::string & directory, durability_modes::mode mode, std::chrono::milliseconds flushInterval = std::chrono::milliseconds(10));
+		~WriteAheadLog();	//Closes log
+
+		//Starts a new segment after the existing ones (those are never appended to again); throws std::system_error
+		void open();
+		void close();	//Writes and fsyncs everything appended so far (a failure is recorded, not thrown)
+
+		//Returns sequence number of record (0 when mode is NONE)
+		//Both throw std::system_error once a write or fsync failed
+		std::uint64_t append(std::string_view payload);
+		void waitDurable(std::uint64_t sequence);	//Blocks (GROUP and SYNC) until record of sequence is fsynced
+
+		//Closes current segment and starts next one (throws std::system_error, log is failed from then on); segments before returned id can be removed once
+		//everything they hold is persisted somewhere else (see removeSegmentsBefore)
+		std::uint64_t rotate();
+		void removeSegmentsBefore(std::uint64_t segment);
+
+		durability_modes::mode getMode() const;
+		std::uint64_t appendedRecords() const;
+		std::uint64_t fsyncs() const;
+
+		//Ids of segments found in directory, ascending
+		static std::vector<std::uint64_t> listSegments(const std::string & directory);
+		static std::string segmentPath(const std::string & directory, std::uint64_t segment);
+		//Visits every valid record of one segment, stopping at first torn/corrupted one
+		static replay_stats replaySegment(const std::string & directory, std::uint64_t segment, const record_visitor & visitor);
+
+		static std::uint32_t crc32(const void *data, std::size_t length, std::uint32_t crc = 0);
+		static void createDirectory(const std::string & directory);	//Throws std::system_error
+		static void syncDirectory(const std::string & directory);		//Makes creation/rename/removal of files durable
+
+	private:
+		std::string directory;
+		durability_modes::mode mode;
+		std::chrono::milliseconds flushInterval;
+
+		int descriptor;
+		std::uint64_t segment;
+
+		//fileMutex serializes writes and fsyncs of current segment (and rotation); stateMutex guards buffers and counters
+		//Lock order: fileMutex, then stateMutex
+		std::mutex fileMutex;
+		mutable std::mutex stateMutex;
+		std::condition_variable pendingCondition;
+		std::condition_variable durableCondition;
+		std::string pending;					//Framed records not written yet
+		std::uint64_t appendedSequence;
+		std::uint64_t durableSequence;
+		bool running;
+		int failure;	//errno of a failed write/fsync/open (log is unusable from then on)
+		std::thread flusher;
+
+		std::atomic<std::uint64_t> fsyncCount;
+
+		void flushLoop();
+		void writeFully(const char *data, std::size_t length);	//Caller holds fileMutex
+		void sync();											//Caller holds fileMutex
+		void flushPending();									//Caller holds fileMutex
+		void fail(const std::system_error & error);
+		void openSegment(std::uint64_t id);
+};
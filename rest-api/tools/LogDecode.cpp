@@ -0,0 +1,59 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "include/Logger.h"
+#include "include/BinaryLogFormat.h"
+
+
+//Renders binary logs (Logger::enableBinary) back to the text format of Logger, "HH.MM.SS: [TYPE ]: message", to stdout
+//Files may be gzip compressed (as rotated ones are); a file left open by a crashed process is read up to its last complete record
+//execution = ./bin/logdecode.app <file.blog[.gz]> [more files]
+
+static bool decode(const char *path) {
+	std::string content;
+	if (!BinaryLogFormat::readFile(path, content)) {
+		std::cerr << "logdecode: cannot read " << path << "\n";
+		return false;
+	}
+	if (content.size() < BinaryLogFormat::MAGIC_SIZE or content.compare(0, BinaryLogFormat::MAGIC_SIZE, BinaryLogFormat::MAGIC) != 0) {
+		std::cerr << "logdecode: " << path << " is not a binary log\n";
+		return false;
+	}
+
+	std::vector<std::string> templates;
+	std::string output;
+	char line[LogRingBuffer::RECORD_SIZE];
+	std::size_t position = BinaryLogFormat::MAGIC_SIZE;
+	BinaryLogFormat::header h;
+	while (BinaryLogFormat::readHeader(content.data() + position, content.size() - position, h)) {
+		const char *payload = content.data() + position + BinaryLogFormat::HEADER_SIZE;
+		position += h.size;
+
+		if (h.kind == BinaryLogFormat::record_kinds::kind::TEMPLATE) {
+			if (h.templateId >= templates.size())
+				templates.resize(h.templateId + 1);
+			templates[h.templateId].assign(payload, h.size - BinaryLogFormat::HEADER_SIZE);
+			continue;
+		}
+
+		output.append(line, Logger::renderBinary(h, payload, templates, line, sizeof(line)));
+	}
+	std::cout << output;
+
+	if (position < content.size() and content.find_first_not_of('\0', position) != std::string::npos)
+		std::cerr << "logdecode: " << path << " has " << content.size() - position << " bytes after last complete record\n";
+	return true;
+}
+
+int main(int argc, const char * argv[]) {
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " <file.blog[.gz]> [more files]\n";
+		return 2;
+	}
+	bool decoded = true;
+	for (int i = 1; i < argc; i++)
+		decoded = decode(argv[i]) and decoded;
+	return decoded ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "include/Logger.h"
+#include "include/MappedLogRing.h"
+#include "include/BinaryLogFormat.h"
+
+
+//Prints records kept by a crash ring (Logger::enableCrashRing), oldest first, as text lines of Logger
+//Records of binary mode need the patterns of their run: pass the binary log(s) written by it after the ring
+//Ring may be gzip compressed (as preserved rings are, unless log compression is off)
+//execution = ./bin/logextract.app <file.ring[.<suffix>][.gz]> [file.blog[.gz] ...]
+
+//Patterns of TEMPLATE records of a binary log (ids are the same in every file of a run)
+static bool readTemplates(const char *path, std::vector<std::string> & templates) {
+	std::string content;
+	if (!BinaryLogFormat::readFile(path, content) or content.compare(0, BinaryLogFormat::MAGIC_SIZE, BinaryLogFormat::MAGIC) != 0)
+		return false;
+
+	std::size_t position = BinaryLogFormat::MAGIC_SIZE;
+	BinaryLogFormat::header h;
+	while (BinaryLogFormat::readHeader(content.data() + position, content.size() - position, h)) {
+		if (h.kind == BinaryLogFormat::record_kinds::kind::TEMPLATE) {
+			if (h.templateId >= templates.size())
+				templates.resize(h.templateId + 1);
+			templates[h.templateId].assign(content.data() + position + BinaryLogFormat::HEADER_SIZE, h.size - BinaryLogFormat::HEADER_SIZE);
+		}
+		position += h.size;
+	}
+	return true;
+}
+
+int main(int argc, const char * argv[]) {
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " <file.ring> [file.blog ...]\n";
+		return 2;
+	}
+
+	std::string content;
+	if (!BinaryLogFormat::readFile(argv[1], content)) {
+		std::cerr << "logextract: cannot read " << argv[1] << "\n";
+		return 1;
+	}
+	std::vector<std::string> templates;
+	for (int i = 2; i < argc; i++)
+		if (!readTemplates(argv[i], templates))
+			std::cerr << "logextract: " << argv[i] << " is not a binary log, ignored\n";
+
+	bool wasClean;
+	std::vector<MappedLogRing::entry> entries;
+	try {
+		entries = MappedLogRing::extract(content, wasClean);
+	}
+	catch (const std::runtime_error & error) {
+		std::cerr << "logextract: " << argv[1] << ": " << error.what() << "\n";
+		return 1;
+	}
+
+	std::string output;
+	char line[LogRingBuffer::RECORD_SIZE];
+	for (const MappedLogRing::entry & record : entries) {
+		BinaryLogFormat::header h;
+		if (!record.binary)
+			output.append(record.data);
+		else if (BinaryLogFormat::readHeader(record.data.data(), record.data.size(), h) and h.kind == BinaryLogFormat::record_kinds::kind::MESSAGE)
+			output.append(line, Logger::renderBinary(h, record.data.data() + BinaryLogFormat::HEADER_SIZE, templates, line, sizeof(line)));
+	}
+	std::cout << output;
+
+	std::cerr << "logextract: " << entries.size() << " records" << (entries.empty() ? "" : " (sequence " + std::to_string(entries.front().sequence) \
+		+ " to " + std::to_string(entries.back().sequence) + ")") << ", writer " << (wasClean ? "exited normally" : "did not exit normally") << "\n";
+	return 0;
+}